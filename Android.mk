@@ -21,8 +21,24 @@ LOCAL_MODULE := raig_shared
 LOCAL_MODULE_FILENAME := libraig
 
 LOCAL_SRC_FILES :=	$(LOCAL_PATH)/src/client/raig_client.cc \
-					$(LOCAL_PATH)/src/base/vector3.cc \
-					$(LOCAL_PATH)/src/net/net_manager.cc
+					$(LOCAL_PATH)/src/client/path_cache.cc \
+					$(LOCAL_PATH)/src/client/path_tracker.cc \
+					$(LOCAL_PATH)/src/ai/grid_search.cc \
+					$(LOCAL_PATH)/src/ai/hierarchical_search.cc \
+					$(LOCAL_PATH)/src/ai/path_smoother.cc \
+					$(LOCAL_PATH)/src/base/cell_batch.cc \
+					$(LOCAL_PATH)/src/base/cell_grid.cc \
+					$(LOCAL_PATH)/src/base/cell_kernels.cc \
+					$(LOCAL_PATH)/src/base/event.cc \
+					$(LOCAL_PATH)/src/base/io_buffer.cc \
+					$(LOCAL_PATH)/src/base/log.cc \
+					$(LOCAL_PATH)/src/base/path_buffer.cc \
+					$(LOCAL_PATH)/src/base/spsc_ring.cc \
+					$(LOCAL_PATH)/src/base/stats.cc \
+					$(LOCAL_PATH)/src/http/http_client.cc \
+					$(LOCAL_PATH)/src/net/net_manager.cc \
+					$(LOCAL_PATH)/src/net/packet.cc \
+					$(LOCAL_PATH)/src/net/poller.cc
 
 LOCAL_EXPORT_C_INCLUDES :=	$(LOCAL_PATH)/include \
 							$(LOCAL_PATH)/src 
@@ -0,0 +1,265 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "bench/loopback_server.h"
+
+#include <arpa/inet.h> // htonl()
+#include <errno.h> // errno
+#include <fcntl.h> // fcntl()
+#include <netinet/in.h> // sockaddr_in
+#include <netinet/tcp.h> // TCP_NODELAY
+#include <poll.h> // poll()
+#include <sys/socket.h> // socket()
+#include <unistd.h> // close()
+
+#include <cstring> // memset()
+
+namespace bench{
+
+#define LOOPBACK_READ_SIZE (64 * 1024)
+#define LOOPBACK_MAX_WRITE_SIZE (4 * 1024 * 1024) // Replies not taken by a client before it is no longer read
+#define LOOPBACK_POLL_MS 10 // Longest wait before Stop() is noticed
+
+static void SetNonBlocking(int socket)
+{
+	fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+}
+
+LoopbackServer::LoopbackServer()
+	: m_iListenSocket(-1), m_iPort(-1), m_bIsRunning(false)
+{
+}
+
+LoopbackServer::~LoopbackServer()
+{
+	Stop();
+}
+
+int LoopbackServer::Start()
+{
+	m_iListenSocket = socket(AF_INET, SOCK_STREAM, 0);
+	if(m_iListenSocket == -1)
+	{
+		return -1;
+	}
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+
+	socklen_t length = sizeof(address);
+	if(bind(m_iListenSocket, (struct sockaddr*)&address, sizeof(address)) == -1
+		|| listen(m_iListenSocket, 64) == -1
+		|| getsockname(m_iListenSocket, (struct sockaddr*)&address, &length) == -1)
+	{
+		close(m_iListenSocket);
+		m_iListenSocket = -1;
+		return -1;
+	}
+
+	SetNonBlocking(m_iListenSocket);
+	m_iPort = ntohs(address.sin_port);
+
+	m_bIsRunning = true;
+	m_Thread = std::thread(&LoopbackServer::Run, this);
+	return m_iPort;
+}
+
+void LoopbackServer::Stop()
+{
+	if(!m_bIsRunning)
+	{
+		return;
+	}
+
+	m_bIsRunning = false;
+	m_Thread.join();
+
+	for(size_t i = 0; i < m_vConnections.size(); i++)
+	{
+		close(m_vConnections[i]->m_iSocket);
+	}
+	m_vConnections.clear();
+
+	close(m_iListenSocket);
+	m_iListenSocket = -1;
+}
+
+void LoopbackServer::Run()
+{
+	std::vector<struct pollfd> sockets;
+
+	while(m_bIsRunning)
+	{
+		// The listening socket first, then one entry per connection
+		sockets.resize(m_vConnections.size() + 1);
+		sockets[0].fd = m_iListenSocket;
+		sockets[0].events = POLLIN;
+		for(size_t i = 0; i < m_vConnections.size(); i++)
+		{
+			Connection *connection = m_vConnections[i].get();
+			sockets[i + 1].fd = connection->m_iSocket;
+			sockets[i + 1].events = (IsFull(connection) ? 0 : POLLIN) | (connection->m_uSent < connection->m_vWrite.size() ? POLLOUT : 0);
+		}
+
+		if(poll(&sockets[0], sockets.size(), LOOPBACK_POLL_MS) <= 0)
+		{
+			continue;
+		}
+
+		// Connections accepted below are polled from the next loop
+		size_t count = m_vConnections.size();
+		size_t kept = 0;
+		for(size_t i = 0; i < count; i++)
+		{
+			Connection *connection = m_vConnections[i].get();
+			bool isOpen = true;
+			if(sockets[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+			{
+				isOpen = Receive(connection);
+			}
+			if(isOpen && connection->m_uSent < connection->m_vWrite.size())
+			{
+				isOpen = Send(connection);
+			}
+
+			if(isOpen)
+			{
+				m_vConnections[kept++].swap(m_vConnections[i]);
+			}
+			else
+			{
+				close(connection->m_iSocket);
+			}
+		}
+		m_vConnections.erase(m_vConnections.begin() + kept, m_vConnections.begin() + count);
+
+		if(sockets[0].revents & POLLIN)
+		{
+			Accept();
+		}
+	}
+}
+
+void LoopbackServer::Accept()
+{
+	int socket = -1;
+	while((socket = accept(m_iListenSocket, NULL, NULL)) != -1)
+	{
+		SetNonBlocking(socket);
+
+		// Replies are written whole, do not hold them back for more
+		int noDelay = 1;
+		setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+		std::unique_ptr<Connection> connection(new Connection());
+		connection->m_iSocket = socket;
+		connection->m_uSent = 0;
+		m_vConnections.push_back(std::move(connection));
+	}
+}
+
+bool LoopbackServer::Receive(Connection *connection)
+{
+	std::vector<char> &data = connection->m_vRead;
+	while(!IsFull(connection))
+	{
+		size_t size = data.size();
+		data.resize(size + LOOPBACK_READ_SIZE);
+
+		ssize_t bytes = recv(connection->m_iSocket, &data[size], LOOPBACK_READ_SIZE, 0);
+		data.resize(size + (bytes > 0 ? bytes : 0));
+
+		if(bytes == 0 || (bytes == -1 && errno != EAGAIN && errno != EWOULDBLOCK))
+		{
+			return false;
+		}
+		if(bytes == -1)
+		{
+			break;
+		}
+
+		// Only the last packet, still arriving, is kept between reads
+		if(!ProcessPackets(connection) || !Send(connection))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool LoopbackServer::IsFull(const Connection *connection) const
+{
+	return connection->m_vWrite.size() - connection->m_uSent > LOOPBACK_MAX_WRITE_SIZE;
+}
+
+bool LoopbackServer::ProcessPackets(Connection *connection)
+{
+	// Clients send 20 byte ASCII packets
+	std::vector<char> &data = connection->m_vRead;
+	size_t offset = 0;
+	while(offset < data.size())
+	{
+		size_t size = net::Packet::GetPacketSize(&data[offset], data.size() - offset, PACKET_ASCII_SEND_SIZE);
+		if(size > MAX_PACKET_SIZE)
+		{
+			return false;
+		}
+		if(size == 0 || offset + size > data.size())
+		{
+			break;
+		}
+
+		if(!ProcessPacket(connection, &data[offset], size))
+		{
+			return false;
+		}
+		offset += size;
+	}
+	data.erase(data.begin(), data.begin() + offset);
+	return true;
+}
+
+bool LoopbackServer::Send(Connection *connection)
+{
+	std::vector<char> &data = connection->m_vWrite;
+	while(connection->m_uSent < data.size())
+	{
+		ssize_t bytes = send(connection->m_iSocket, &data[connection->m_uSent], data.size() - connection->m_uSent, MSG_NOSIGNAL);
+		if(bytes == -1)
+		{
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		connection->m_uSent += bytes;
+	}
+
+	data.clear();
+	connection->m_uSent = 0;
+	return true;
+}
+
+bool LoopbackServer::ProcessPacket(Connection *connection, const char *packet, size_t size)
+{
+	if(!m_Reader.Parse(packet, size))
+	{
+		return true;
+	}
+
+	server::Session &session = connection->m_Session;
+	if(!session.ProcessPacket(m_Reader, &connection->m_vWrite, &m_vJobs))
+	{
+		return false;
+	}
+	for(size_t i = 0; i < m_vJobs.size(); i++)
+	{
+		m_Solver.Solve(*session.GetGrid(), m_vJobs[i], session.GetFraming(), &connection->m_vWrite);
+	}
+	m_vJobs.clear();
+	return true;
+}
+
+} // namespace bench
@@ -0,0 +1,90 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef BENCH_LOOPBACK_SERVER_H_
+#define BENCH_LOOPBACK_SERVER_H_
+
+#include <stddef.h> // size_t
+
+#include <atomic> // atomic<>()
+#include <memory> // unique_ptr<>()
+#include <thread> // thread
+#include <vector> // vector<>()
+
+#include "net/packet.h"
+#include "server/path_solver.h"
+#include "server/session.h"
+
+namespace bench{
+
+// Stand-in for the RAIG server on 127.0.0.1 so the client can be measured
+// on one machine without a network. Uses the protocol and search of
+// server::RaigServer, every connection has its own server::Session.
+//
+// One thread serves all connections with poll() and answers each path as
+// it arrives, the server is not what is being measured.
+class LoopbackServer{
+public:
+	LoopbackServer();
+
+	~LoopbackServer();
+
+	// Listens on an ephemeral port of 127.0.0.1 and starts the server
+	// thread. Returns the port or -1.
+	int Start();
+
+	void Stop();
+
+	int GetPort() const { return m_iPort; }
+
+private:
+	struct Connection{
+		int m_iSocket;
+
+		// Bytes received and not processed yet
+		std::vector<char> m_vRead;
+
+		// Bytes to send, m_uSent of them are sent
+		std::vector<char> m_vWrite;
+		size_t m_uSent;
+
+		server::Session m_Session;
+	};
+
+	void Run();
+
+	void Accept();
+
+	// Returns false once the connection is closed. A client that does not
+	// take its replies is not read until it does.
+	bool Receive(Connection *connection);
+
+	// More than LOOPBACK_MAX_WRITE_SIZE bytes of replies are left to send
+	bool IsFull(const Connection *connection) const;
+
+	bool Send(Connection *connection);
+
+	// Returns false if the client broke the protocol and is to be dropped
+	bool ProcessPackets(Connection *connection);
+
+	// Returns false if the client broke the protocol and is to be dropped
+	bool ProcessPacket(Connection *connection, const char *packet, size_t size);
+
+	int m_iListenSocket;
+	int m_iPort;
+
+	std::vector<std::unique_ptr<Connection> > m_vConnections;
+
+	net::PacketReader m_Reader;
+	std::vector<server::PathJob> m_vJobs;
+	server::PathSolver m_Solver;
+
+	std::thread m_Thread;
+	std::atomic<bool> m_bIsRunning;
+};
+
+} // namespace bench
+
+#endif
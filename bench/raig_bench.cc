@@ -0,0 +1,400 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+// End-to-end benchmark of FindPath() -> Update() -> GetPathData() against
+// bench::LoopbackServer. For each grid size, obstacle density, path length
+// and number of concurrent clients it reports the paths per second, the
+// round trip latency percentiles and the CPU time per path. Requests that
+// fail are counted apart and kept out of the latencies, a run that does
+// not finish within BENCH_RUN_TIMEOUT_MS is reported as stalled.
+//
+//		raig_bench [paths per client]
+
+#include <stdint.h> // uint64_t
+#include <sys/resource.h> // getrusage()
+#include <time.h> // clock_gettime()
+
+#include <algorithm> // std::sort()
+#include <chrono> // steady_clock
+#include <cstdio> // printf()
+#include <cstdlib> // atoi()
+#include <random> // minstd_rand
+#include <string> // string
+#include <thread> // thread
+#include <vector> // vector<>()
+
+#include "bench/loopback_server.h"
+#include "raig/raig_client.h"
+
+#define BENCH_DEFAULT_PATHS 2000 // Paths requested by each client per run
+#define BENCH_WINDOW 32 // Requests each client keeps in flight
+#define BENCH_IDLE_SLEEP_US 20 // Client sleep when an update finished nothing
+#define BENCH_SYNC_TIMEOUT_MS 2000 // Longest wait for a client to be accepted
+#define BENCH_RUN_TIMEOUT_MS 60000 // Longest run of one configuration
+
+namespace bench{
+
+typedef std::chrono::steady_clock Clock;
+
+struct Config{
+	int m_iSize; // Width and height of the grid
+	double m_dDensity; // Fraction of blocked cells
+	int m_iLength; // Manhattan distance from start to goal
+	int m_iClients;
+};
+
+// Results of one client
+struct ClientResult{
+	std::vector<double> m_vLatencyUs; // Completed requests only
+	uint64_t m_uNodes;
+	uint64_t m_uFailed;
+	int m_iFinished; // Completed and failed requests
+	double m_dCpuUs; // Thread CPU time of the client
+	bool m_bIsSynced;
+	bool m_bIsStalled; // Stopped at the deadline of the run
+};
+
+// A client with BENCH_WINDOW requests in flight, the callback records the
+// latency of each and reads its path
+class ClientRun{
+public:
+	ClientRun(const Config &config, const std::vector<unsigned char> &cells, const std::vector<int> &components, int port, int paths, unsigned int seed)
+		: m_Config(config), m_Cells(cells), m_Components(components), m_iPort(port), m_iPaths(paths), m_Random(seed), m_iInFlight(0), m_iCompleted(0)
+	{
+		m_Result.m_uNodes = 0;
+		m_Result.m_uFailed = 0;
+		m_Result.m_iFinished = 0;
+		m_Result.m_dCpuUs = 0;
+		m_Result.m_bIsSynced = false;
+		m_Result.m_bIsStalled = false;
+	}
+
+	// Gives up at deadline if the requests have not all finished
+	void Run(Clock::time_point deadline)
+	{
+		raig::RaigClient client;
+		client.InitConnection(std::make_shared<std::string>("127.0.0.1"), std::make_shared<std::string>(std::to_string(m_iPort)));
+		client.CreateGameWorld(m_Config.m_iSize, m_Config.m_iSize, raig::RaigClient::ASTAR, &m_Cells[0]);
+
+		// The first request goes out once the server has answered HELLO and
+		// holds the world
+		base::Vector3 start;
+		base::Vector3 goal;
+		PickPath(&start, &goal);
+		Clock::time_point syncDeadline = Clock::now() + std::chrono::milliseconds(BENCH_SYNC_TIMEOUT_MS);
+		while(!Request(&client, &start, &goal))
+		{
+			if(Clock::now() > syncDeadline)
+			{
+				return;
+			}
+			client.Update();
+			std::this_thread::sleep_for(std::chrono::microseconds(BENCH_IDLE_SLEEP_US));
+		}
+		m_Result.m_bIsSynced = true;
+
+		double cpuStart = GetThreadCpuUs();
+		int issued = 1;
+		while(m_iCompleted < m_iPaths)
+		{
+			while(m_iInFlight < BENCH_WINDOW && issued < m_iPaths)
+			{
+				PickPath(&start, &goal);
+				if(!Request(&client, &start, &goal))
+				{
+					break;
+				}
+				issued++;
+			}
+
+			int completed = m_iCompleted;
+			client.Update();
+			if(Clock::now() > deadline)
+			{
+				m_Result.m_bIsStalled = m_iCompleted < m_iPaths;
+				break;
+			}
+			if(m_iCompleted == completed)
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(BENCH_IDLE_SLEEP_US));
+			}
+		}
+		m_Result.m_iFinished = m_iCompleted;
+		m_Result.m_dCpuUs = GetThreadCpuUs() - cpuStart;
+	}
+
+	const ClientResult &GetResult() const { return m_Result; }
+
+private:
+	static void OnPath(int requestId, bool isComplete, void *userData)
+	{
+		ClientRun *run = (ClientRun*)userData;
+		run->m_iInFlight--;
+		run->m_iCompleted++;
+		if(!isComplete)
+		{
+			run->m_Result.m_uFailed++;
+			return;
+		}
+
+		double latency = std::chrono::duration<double, std::micro>(Clock::now() - run->m_StartTimes[requestId % BENCH_WINDOW_SLOTS]).count();
+		run->m_Result.m_vLatencyUs.push_back(latency);
+
+		int size = 0;
+		run->m_pClient->GetPathData(requestId, &size);
+		run->m_Result.m_uNodes += size;
+	}
+
+	bool Request(raig::RaigClient *client, base::Vector3 *start, base::Vector3 *goal)
+	{
+		m_pClient = client;
+		Clock::time_point now = Clock::now();
+		int requestId = client->FindPath(start, goal, OnPath, this);
+		if(requestId == -1)
+		{
+			return false;
+		}
+
+		m_StartTimes[requestId % BENCH_WINDOW_SLOTS] = now;
+		m_iInFlight++;
+		return true;
+	}
+
+	// Open start and goal cells about m_iLength apart with a path between
+	// them, a goal that can not be reached is searched over its whole
+	// component and measures that instead
+	void PickPath(base::Vector3 *start, base::Vector3 *goal)
+	{
+		int size = m_Config.m_iSize;
+		while(true)
+		{
+			int startX = m_Random() % size;
+			int startZ = m_Random() % size;
+			int dx = m_Random() % (m_Config.m_iLength + 1);
+			int dz = m_Config.m_iLength - dx;
+			int goalX = startX + (m_Random() % 2 ? dx : -dx);
+			int goalZ = startZ + (m_Random() % 2 ? dz : -dz);
+
+			if(goalX < 0 || goalZ < 0 || goalX >= size || goalZ >= size
+				|| m_Cells[startZ * size + startX] || m_Cells[goalZ * size + goalX]
+				|| m_Components[startZ * size + startX] != m_Components[goalZ * size + goalX])
+			{
+				continue;
+			}
+
+			*start = base::Vector3(startX, 0, startZ);
+			*goal = base::Vector3(goalX, 0, goalZ);
+			return;
+		}
+	}
+
+	static double GetThreadCpuUs()
+	{
+		struct timespec time;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+		return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+	}
+
+	// Request ids wrap at 10000, every in-flight id has its own slot
+	enum { BENCH_WINDOW_SLOTS = 64 };
+
+	const Config &m_Config;
+	const std::vector<unsigned char> &m_Cells;
+	const std::vector<int> &m_Components;
+	int m_iPort;
+	int m_iPaths;
+	std::minstd_rand m_Random;
+
+	raig::RaigClient *m_pClient;
+	Clock::time_point m_StartTimes[BENCH_WINDOW_SLOTS];
+	int m_iInFlight;
+	int m_iCompleted;
+
+	ClientResult m_Result;
+};
+
+static double GetProcessCpuUs()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// Numbers the open cells by the group of cells they are connected to,
+// through the four neighbours the server searches
+static void FindComponents(const std::vector<unsigned char> &cells, int size, std::vector<int> *components)
+{
+	components->assign(cells.size(), -1);
+
+	std::vector<int> open;
+	int component = 0;
+	for(size_t i = 0; i < cells.size(); i++)
+	{
+		if(cells[i] || (*components)[i] != -1)
+		{
+			continue;
+		}
+
+		(*components)[i] = component;
+		open.push_back((int)i);
+		while(!open.empty())
+		{
+			int index = open.back();
+			open.pop_back();
+
+			int x = index % size;
+			int neighbours[4] = { x > 0 ? index - 1 : -1, x < size - 1 ? index + 1 : -1, index - size, index + size };
+			for(int n = 0; n < 4; n++)
+			{
+				int neighbour = neighbours[n];
+				if(neighbour >= 0 && neighbour < (int)cells.size() && !cells[neighbour] && (*components)[neighbour] == -1)
+				{
+					(*components)[neighbour] = component;
+					open.push_back(neighbour);
+				}
+			}
+		}
+		component++;
+	}
+}
+
+static double GetPercentile(const std::vector<double> &sorted, double fraction)
+{
+	if(sorted.empty())
+	{
+		return 0;
+	}
+
+	size_t index = (size_t)(fraction * (sorted.size() - 1));
+	return sorted[index];
+}
+
+static void RunConfig(const Config &config, int port, int paths)
+{
+	// Same obstacles for every client of the run
+	std::minstd_rand random(config.m_iSize * 31 + (int)(config.m_dDensity * 100));
+	std::vector<unsigned char> cells((size_t)config.m_iSize * config.m_iSize);
+	for(size_t i = 0; i < cells.size(); i++)
+	{
+		cells[i] = (random() % 1000) < config.m_dDensity * 1000;
+	}
+	std::vector<int> components;
+	FindComponents(cells, config.m_iSize, &components);
+
+	std::vector<std::unique_ptr<ClientRun> > runs;
+	for(int i = 0; i < config.m_iClients; i++)
+	{
+		runs.push_back(std::unique_ptr<ClientRun>(new ClientRun(config, cells, components, port, paths, i + 1)));
+	}
+
+	double cpuStart = GetProcessCpuUs();
+	Clock::time_point start = Clock::now();
+	Clock::time_point deadline = start + std::chrono::milliseconds(BENCH_RUN_TIMEOUT_MS);
+
+	std::vector<std::thread> threads;
+	for(int i = 0; i < config.m_iClients; i++)
+	{
+		threads.push_back(std::thread(&ClientRun::Run, runs[i].get(), deadline));
+	}
+	for(size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	double processCpuUs = GetProcessCpuUs() - cpuStart;
+
+	std::vector<double> latencies;
+	uint64_t nodes = 0;
+	uint64_t failed = 0;
+	int finished = 0;
+	bool isStalled = false;
+	double clientCpuUs = 0;
+	for(size_t i = 0; i < runs.size(); i++)
+	{
+		const ClientResult &result = runs[i]->GetResult();
+		if(!result.m_bIsSynced)
+		{
+			printf("%5d %5.2f %5d %3d   client %d was not accepted by the server\n",
+				config.m_iSize, config.m_dDensity, config.m_iLength, config.m_iClients, (int)i);
+			return;
+		}
+
+		latencies.insert(latencies.end(), result.m_vLatencyUs.begin(), result.m_vLatencyUs.end());
+		nodes += result.m_uNodes;
+		failed += result.m_uFailed;
+		finished += result.m_iFinished;
+		isStalled = isStalled || result.m_bIsStalled;
+		clientCpuUs += result.m_dCpuUs;
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	if(isStalled)
+	{
+		printf("%5d %5.2f %5d %3d   stalled, %d of %d requests finished in %d ms\n",
+			config.m_iSize, config.m_dDensity, config.m_iLength, config.m_iClients,
+			finished, paths * config.m_iClients, BENCH_RUN_TIMEOUT_MS);
+		return;
+	}
+
+	// CPU is spent on failed requests too, rates and nodes are of the
+	// completed ones
+	double count = (double)latencies.size();
+	double perPath = count > 0 ? count : 1;
+	printf("%5d %5.2f %5d %3d %10.0f %9.1f %9.1f %9.1f %10.1f %10.1f %7.1f %6llu\n",
+		config.m_iSize, config.m_dDensity, config.m_iLength, config.m_iClients,
+		count / seconds, GetPercentile(latencies, 0.5), GetPercentile(latencies, 0.99), latencies.empty() ? 0 : latencies.back(),
+		clientCpuUs / finished, processCpuUs / finished, nodes / perPath, (unsigned long long)failed);
+}
+
+} // namespace bench
+
+int main(int argc, char **argv)
+{
+	int paths = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_PATHS;
+	if(paths <= 0)
+	{
+		printf("usage: raig_bench [paths per client]\n");
+		return 1;
+	}
+
+	// Connection messages would break up the table
+	raig::RaigClient::SetLogLevel(raig::RaigClient::LOG_WARNING);
+
+	bench::LoopbackServer server;
+	int port = server.Start();
+	if(port == -1)
+	{
+		printf("raig_bench: could not listen on 127.0.0.1\n");
+		return 1;
+	}
+
+	// Client CPU is the time of the client threads, process CPU adds the
+	// server's search and I/O
+	printf(" grid  dens   len cli     path/s   p50(us)   p99(us)   max(us) cpu/path(us) +server(us)   nodes failed\n");
+
+	const int sizes[] = { 64, 256, 1024 };
+	const double densities[] = { 0.0, 0.2 };
+	const int clients[] = { 1, 4 };
+	for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		// A short path and one across half the grid
+		const int lengths[] = { 16, sizes[s] / 2 };
+		for(size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++)
+		{
+			for(size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+			{
+				for(size_t c = 0; c < sizeof(clients) / sizeof(clients[0]); c++)
+				{
+					bench::Config config = { sizes[s], densities[d], lengths[l], clients[c] };
+					bench::RunConfig(config, port, paths);
+				}
+			}
+		}
+	}
+
+	server.Stop();
+	return 0;
+}
@@ -6,10 +6,12 @@
 #ifndef BASE_VECTOR3_H_
 #define BASE_VECTOR3_H_
 
-#include "export/raig_Export.h"
-
 namespace base{
 
+// Location of a path node. Defined in the header so the copies and
+// comparisons made per node inline into the caller instead of calling
+// into the library, and trivially copyable so arrays of nodes can be
+// copied and scanned as plain memory.
 class Vector3{
 public:
 	int m_iX;
@@ -17,11 +19,32 @@ public:
 	int m_iZ;
 	int m_iId;
 
-	raig_EXPORT Vector3();
-	raig_EXPORT ~Vector3();
-	raig_EXPORT Vector3(int x, int y, int z);
-	raig_EXPORT Vector3(int id, int x, int y, int z);
-	int raig_EXPORT Compare(const Vector3 *other);
+	constexpr Vector3()
+		: m_iX(0), m_iY(0), m_iZ(0), m_iId(0)
+	{
+	}
+
+	constexpr Vector3(int x, int y, int z)
+		: m_iX(x), m_iY(y), m_iZ(z), m_iId(0)
+	{
+	}
+
+	constexpr Vector3(int id, int x, int y, int z)
+		: m_iX(x), m_iY(y), m_iZ(z), m_iId(id)
+	{
+	}
+
+	// Returns 1 if both are at the same location, the id is ignored
+	int Compare(const Vector3 *other) const
+	{
+		return m_iX == other->m_iX && m_iY == other->m_iY && m_iZ == other->m_iZ ? 1 : 0;
+	}
+
+	// Same cell of the grid, y is not part of a cell
+	constexpr bool IsSameCell(const Vector3 &other) const
+	{
+		return m_iX == other.m_iX && m_iZ == other.m_iZ;
+	}
 };
 
 } // namespace base
@@ -6,14 +6,24 @@
 #ifndef RAIG_RAIG_H
 #define RAIG_RAIG_H
 
+#include <stdint.h>
+
 #include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "export/raig_Export.h"
 #include "base/vector3.h"
 
+namespace base{
+class Observer;
+}
+
 namespace raig{
 
+#define RAIG_STATS_BUCKETS 24 // Buckets of a RaigClient::StatsHistogram
+
 class RaigClient
 {
 public:
@@ -26,22 +36,276 @@ public:
 		DFS // Depth first search
 	};
 
+	// Where paths are searched for
+	enum PathMode{
+		REMOTE, // On the RAIG server (the default)
+		LOCAL, // In process over the blocked cells set on this client
+		AUTO, // In process if start and goal are within the local distance or
+			// the server is unreachable, on the server otherwise
+		HIERARCHICAL // In process over a graph of map clusters, the path is
+			// refined to cells over the following updates
+	};
+
+	// Which server of the pool gets a path request, see AddServer()
+	enum ShardPolicy{
+		LEAST_OUTSTANDING, // Fewest requests waiting on it (the default)
+		ROUND_ROBIN, // Each server in turn
+		REGION // By the column of the start cell, the world is split into one
+			// strip per server
+	};
+
+	// Post-processing of completed paths, see SetPathSmoothing()
+	enum PathSmoothing{
+		NO_SMOOTHING, // One node per cell (the default)
+		CORNERS, // Only the nodes where the path turns
+		LINE_OF_SIGHT // Straight lines between nodes in line of sight over
+			// the blocked cells set on this client
+	};
+
+	// Messages of the library, see SetLogLevel()
+	enum LogLevel{
+		LOG_DEBUG,
+		LOG_INFO, // The default
+		LOG_WARNING,
+		LOG_ERROR,
+		LOG_NONE
+	};
+
+	// Called on the log thread with each message, level is a LogLevel
+	typedef void (*LogCallback)(int level, const char *file, int line, const char *message, void *userData);
+
+	// Called from Update() once a request completes or fails
+	typedef void (*PathCallback)(int requestId, bool isComplete, void *userData);
+
+	// Counters of the path cache, see SetPathCacheCapacity()
+	struct PathCacheStats{
+		int m_iHits;
+		int m_iMisses;
+		int m_iEvictions; // Least recently used paths dropped to make room
+		int m_iInvalidations; // Paths dropped because the world changed
+	};
+
+	// Power of two histogram, bucket i counts the values from 2^i to
+	// 2^(i + 1) - 1, bucket 0 also counts 0 and the last bucket every
+	// larger value
+	struct StatsHistogram{
+		uint64_t m_uBuckets[RAIG_STATS_BUCKETS];
+		uint64_t m_uCount;
+		uint64_t m_uSum;
+		uint64_t m_uMax;
+	};
+
+	// Counters since the client was created, see GetStats()
+	struct Stats{
+		StatsHistogram m_RequestLatency; // Microseconds from FindPath() to
+			// the END of a server request
+		StatsHistogram m_PathNodes; // Nodes of each completed path
+		StatsHistogram m_UpdateTime; // Microseconds spent in Update()
+
+		uint64_t m_uRequests; // FindPath() calls, FindPaths() counts each pair
+		uint64_t m_uCompleted;
+		uint64_t m_uFailed; // No path, or abandoned
+		uint64_t m_uDropped; // FindPath() returned -1
+		uint64_t m_uAbandoned; // Pending when the connection was lost
+
+		// Summed over the servers
+		uint64_t m_uBytesSent;
+		uint64_t m_uBytesReceived;
+		uint64_t m_uSendCalls;
+		uint64_t m_uRecvCalls;
+		uint64_t m_uReconnects;
+		uint64_t m_uConnectFailures;
+		uint64_t m_uDroppedSends; // Messages not queued, not connected or
+			// the queue to the network thread was full
+
+		// Events accepted by the telemetry endpoint, and events not posted
+		// because the queue was full or a post failed, see SetTelemetry()
+		uint64_t m_uTelemetryPosted;
+		uint64_t m_uTelemetryDropped;
+
+		// Depths when the snapshot was taken
+		uint64_t m_uSendQueueBytes;
+		int m_iPendingRequests;
+	};
+
+	// Called from Update() with a snapshot, see SetStatsDump()
+	typedef void (*StatsCallback)(const Stats &stats, void *userData);
+
 	raig_EXPORT RaigClient();
 
+	raig_EXPORT ~RaigClient();
+
+	// Opt-in, call before InitConnection(). A background thread connects,
+	// reconnects, sends and receives so a slow network never stalls the
+	// game thread, Update() only processes what the thread has received.
+	void raig_EXPORT SetThreadedNetwork(bool isThreaded);
+
 	int raig_EXPORT InitConnection(std::shared_ptr<std::string> hostname, std::shared_ptr<std::string> service);
 
+	// Adds another RAIG server to the pool. Every server is sent the world
+	// and the cell updates so each holds a replica, path requests are
+	// spread across the connected servers by the shard policy. The sockets
+	// are read only when epoll reports data. Returns the server index,
+	// InitConnection() is server 0.
+	int raig_EXPORT AddServer(std::shared_ptr<std::string> hostname, std::shared_ptr<std::string> service);
+
+	void raig_EXPORT SetShardPolicy(ShardPolicy policy);
+
 	void raig_EXPORT CreateGameWorld(int width, int height, AiService serviceType);
 
+	// Creates the world with its obstacles in one message instead of a
+	// packet per blocked cell. cells holds width * height bytes in row major
+	// order, cell x, z at z * width + x, non-zero for a blocked cell. The
+	// grid is sent run-length encoded or as a bitmap, whichever is smaller.
+	// Servers that only speak ASCII get a packet per blocked cell.
+	void raig_EXPORT CreateGameWorld(int width, int height, AiService serviceType, const unsigned char *cells);
+
+	// As above with one bit per cell, cell i = z * width + x is bit i % 32 of
+	// bitmap[i / 32]
+	void raig_EXPORT CreateGameWorld(int width, int height, AiService serviceType, const uint32_t *bitmap);
+
 	void raig_EXPORT SetCellOpen(base::Vector3 cell);
 
 	void raig_EXPORT SetCellBlocked(base::Vector3 cell);
 
-	void raig_EXPORT FindPath(base::Vector3 *start, base::Vector3 *goal);
+	// Cell updates are sent to the server once per Update() as a single
+	// message. Blocking and then opening a cell in the same frame sends
+	// nothing.
+	void raig_EXPORT SetCellsOpen(const base::Vector3 *cells, int count);
+
+	void raig_EXPORT SetCellsBlocked(const base::Vector3 *cells, int count);
+
+	// Rectangle of width x height cells with its corner at x, z
+	void raig_EXPORT SetRegionOpen(int x, int z, int width, int height);
+
+	void raig_EXPORT SetRegionBlocked(int x, int z, int width, int height);
+
+	// Sends a path request to the server. Several requests can be in flight
+	// at once. Returns the request id or -1 if the request was not sent.
+	int raig_EXPORT FindPath(base::Vector3 *start, base::Vector3 *goal);
+
+	// Local searches complete before FindPath() returns, HIERARCHICAL
+	// searches are complete once refined. Returns -1 if a local search finds
+	// no path.
+	int raig_EXPORT FindPath(base::Vector3 *start, base::Vector3 *goal, PathMode mode);
+
+	// Same as FindPath() in the mode set by SetPathMode(), callback is called
+	// with userData when the request completes or fails so the game does not
+	// have to poll IsPathComplete().
+	int raig_EXPORT FindPath(base::Vector3 *start, base::Vector3 *goal, PathCallback callback, void *userData);
 
+	// Requests a path for each start and goal pair in the mode set by
+	// SetPathMode(). The requests sent to the server go in one message and
+	// are answered per request. Writes the request id of each pair to
+	// requestIds, -1 if the pair was not requested, so results are read by
+	// index with GetPathData(requestIds[i]). Returns the number of requests.
+	int raig_EXPORT FindPaths(const std::pair<base::Vector3, base::Vector3> *paths, int count, int *requestIds);
+
+	// Mode used by FindPath() without a mode. localDistance is the Manhattan
+	// distance in cells under which AUTO searches locally.
+	void raig_EXPORT SetPathMode(PathMode mode, int localDistance);
+
+	// Post-processing of the nodes read with GetPathData() and CopyPath().
+	// The client keeps the path of every cell, repairs and the path cache
+	// work on it, and a smoothed path is rebuilt when it is read after the
+	// blocked cells changed. While smoothing, binary servers are asked for
+	// the corners of each path only and the cells between them are filled
+	// in by the client, which saves the NODE packets of straight runs.
+	void raig_EXPORT SetPathSmoothing(PathSmoothing smoothing);
+
+	// Streamed paths are sent by binary servers from the start to the goal.
+	// GetPathData() returns the nodes received so far while the request is
+	// pending and observers get NODE for each node as it arrives, so an
+	// agent can start moving before the whole path is received. The prefix
+	// is not smoothed and IsPathComplete() stays false until the goal
+	// arrives. ASCII servers send the whole path as before.
+	void raig_EXPORT SetPathStreaming(bool isStreaming);
+
+	// Path of the most recently completed request. Kept for existing games,
+	// allocates a copy of every node. Use GetPathData() or CopyPath().
 	std::vector<std::unique_ptr<base::Vector3> > raig_EXPORT &GetPath();
 
+	bool raig_EXPORT IsPathComplete(int requestId);
+
+	// Nodes of a completed request from start to goal, NULL until the request
+	// is complete. The nodes are owned by the client and stay valid until
+	// the request's slot is reused by a later FindPath(). While a
+	// HIERARCHICAL request is refined its nodes are the refined part of the
+	// path from the start, and while a streamed request is pending the part
+	// received so far.
+	const base::Vector3 raig_EXPORT *GetPathData(int requestId, int *size);
+
+	// Copies up to capacity nodes of a completed request into out. Returns the
+	// number of nodes copied.
+	int raig_EXPORT CopyPath(int requestId, base::Vector3 *out, int capacity);
+
+	// Completed paths are cached by start and goal so a repeated FindPath()
+	// completes without a round-trip to the server. Capacity is the number of
+	// paths kept, 0 disables the cache (the default).
+	void raig_EXPORT SetPathCacheCapacity(int capacity);
+
+	PathCacheStats raig_EXPORT GetPathCacheStats();
+
+	// A tracked path is repaired when a cell on it is blocked. Only the
+	// blocked segment is searched again, locally or with a request for the
+	// segment to the server. A tracked path stays readable with
+	// GetPathData() until it is untracked, later requests are not given its
+	// id meanwhile. Returns false if the request is not complete.
+	bool raig_EXPORT TrackPath(int requestId);
+
+	void raig_EXPORT UntrackPath(int requestId);
+
+	// Writes up to capacity ids of tracked paths changed by repairs since the
+	// last call. A path that could not be repaired is empty. Returns the
+	// number of ids written.
+	int raig_EXPORT GetChangedPaths(int *ids, int capacity);
+
+	// Observers are notified from Update() with a raig::PathNode, see
+	// client/path_node.h. NODE for each node received from the server and
+	// FINISH when a request completes or fails. The client does not own the
+	// observer.
+	void raig_EXPORT AddObserver(base::Observer *observer);
+
+	void raig_EXPORT RemoveObserver(base::Observer *observer);
+
+	// Messages to the server are queued and sent together at the end of
+	// Update(). While more than bytes are queued FindPath() returns -1 for
+	// server requests and cell updates are held back. Default 256KB.
+	void raig_EXPORT SetSendHighWaterMark(size_t bytes);
+
+	// Sends the queued messages now instead of at the end of Update().
+	// Returns the number of bytes the socket did not take yet or -1 if the
+	// connection failed.
+	int raig_EXPORT Flush();
+
 	void raig_EXPORT Update();
 
+	// Snapshot of the counters. The counters are lock-free atomics bumped
+	// where the work is done, the network thread counts its own I/O.
+	Stats raig_EXPORT GetStats();
+
+	// Calls callback with userData and a snapshot from Update() every
+	// intervalMs milliseconds. A NULL callback logs a summary at LOG_INFO,
+	// an interval of 0 stops the dump (the default).
+	void raig_EXPORT SetStatsDump(int intervalMs, StatsCallback callback, void *userData);
+
+	// Posts a line of telemetry for each finished server request to url,
+	// an http:// endpoint, from a background thread. Lines are batched into
+	// one POST every intervalMs or batchEvents lines (0 for the defaults,
+	// 1000ms and 256). The game thread never waits on the endpoint, lines
+	// are dropped when it falls behind. An empty url stops the telemetry.
+	// Returns false if url is not an http:// url.
+	bool raig_EXPORT SetTelemetry(const std::string &url, int intervalMs, int batchEvents);
+
+	// Messages below level are not logged, for every client in the process.
+	// Messages are formatted and written to stdout on a background thread,
+	// repeats from one place are rate limited. Levels below the
+	// RAIG_LOG_LEVEL the library was built with are compiled out.
+	static void raig_EXPORT SetLogLevel(LogLevel level);
+
+	// Messages go to callback instead of stdout, NULL restores stdout
+	static void raig_EXPORT SetLogCallback(LogCallback callback, void *userData);
+
 private:
 	class RaigClientImpl;
 	std::unique_ptr<RaigClientImpl> m_Impl;
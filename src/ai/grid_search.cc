@@ -0,0 +1,322 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "ai/grid_search.h"
+
+#include <cstdlib> // abs()
+
+namespace ai{
+
+GridSearch::GridSearch()
+{
+	m_iWidth = 0;
+	m_iHeight = 0;
+	m_iGoalX = 0;
+	m_iGoalZ = 0;
+	m_iExpandedCount = 0;
+	m_iMaxExpanded = 0;
+	m_uGeneration = 0;
+}
+
+bool GridSearch::FindPath(const base::CellGrid &grid, int startX, int startZ, int goalX, int goalZ, Algorithm algorithm, base::PathBuffer *path, int maxExpanded)
+{
+	m_iExpandedCount = 0;
+	m_iMaxExpanded = maxExpanded;
+
+	if(!grid.IsInside(startX, startZ) || !grid.IsInside(goalX, goalZ) ||
+		grid.IsBlocked(startX, startZ) || grid.IsBlocked(goalX, goalZ))
+	{
+		return false;
+	}
+
+	Prepare(grid);
+	m_iGoalX = goalX;
+	m_iGoalZ = goalZ;
+
+	int start = startZ * m_iWidth + startX;
+	int goal = goalZ * m_iWidth + goalX;
+
+	bool found = false;
+	switch(algorithm)
+	{
+	case BFS:
+		found = SearchBFS(grid, start, goal);
+		break;
+	case DFS:
+		found = SearchDFS(grid, start, goal);
+		break;
+	default:
+		found = SearchAStar(grid, start, goal);
+		break;
+	}
+
+	if(!found)
+	{
+		return false;
+	}
+
+	// Walk back from the goal, nodes are added in front so the path ends up
+	// in order from start to goal
+	path->Clear();
+	for(int index = goal; index != -1; index = m_vParent[index])
+	{
+		path->PushFront(base::Vector3(m_vDepth[index], index % m_iWidth, 0, index / m_iWidth));
+	}
+
+	return true;
+}
+
+void GridSearch::Prepare(const base::CellGrid &grid)
+{
+	size_t size = (size_t)grid.GetWidth() * grid.GetHeight();
+	if(m_iWidth != grid.GetWidth() || m_iHeight != grid.GetHeight() || m_vReached.size() != size)
+	{
+		m_iWidth = grid.GetWidth();
+		m_iHeight = grid.GetHeight();
+		m_vReached.assign(size, 0);
+		m_vClosed.assign(size, 0);
+		m_vParent.resize(size);
+		m_vDepth.resize(size);
+		m_uGeneration = 0;
+	}
+
+	if(++m_uGeneration == 0)
+	{
+		// Generation wrapped, stamps from old searches could match again
+		m_vReached.assign(size, 0);
+		m_vClosed.assign(size, 0);
+		m_uGeneration = 1;
+	}
+
+	m_vHeap.clear();
+	m_vFrontier.clear();
+}
+
+bool GridSearch::Reach(const base::CellGrid &grid, int index, int parent)
+{
+	if(m_vReached[index] == m_uGeneration)
+	{
+		return false;
+	}
+
+	if(grid.IsBlocked(index % m_iWidth, index / m_iWidth))
+	{
+		// Stamp blocked cells so they are only looked up once per search
+		m_vReached[index] = m_uGeneration;
+		m_vClosed[index] = m_uGeneration;
+		return false;
+	}
+
+	m_vReached[index] = m_uGeneration;
+	m_vParent[index] = parent;
+	m_vDepth[index] = parent == -1 ? 0 : m_vDepth[parent] + 1;
+	return true;
+}
+
+int GridSearch::GetNeighbours(int index, int *neighbours) const
+{
+	int x = index % m_iWidth;
+	int z = index / m_iWidth;
+	int count = 0;
+
+	if(x > 0) neighbours[count++] = index - 1;
+	if(x < m_iWidth - 1) neighbours[count++] = index + 1;
+	if(z > 0) neighbours[count++] = index - m_iWidth;
+	if(z < m_iHeight - 1) neighbours[count++] = index + m_iWidth;
+
+	return count;
+}
+
+bool GridSearch::SearchAStar(const base::CellGrid &grid, int start, int goal)
+{
+	Reach(grid, start, -1);
+	HeapNode first = { abs(start % m_iWidth - m_iGoalX) + abs(start / m_iWidth - m_iGoalZ), 0, start };
+	PushHeap(first);
+
+	int neighbours[4];
+	while(!m_vHeap.empty())
+	{
+		HeapNode node = PopHeap();
+		if(m_vClosed[node.m_iIndex] == m_uGeneration)
+		{
+			// Stale entry, the cell was reached again with a lower cost
+			continue;
+		}
+		m_vClosed[node.m_iIndex] = m_uGeneration;
+		if(!Expand())
+		{
+			return false;
+		}
+
+		if(node.m_iIndex == goal)
+		{
+			return true;
+		}
+
+		int count = GetNeighbours(node.m_iIndex, neighbours);
+		for(int i = 0; i < count; i++)
+		{
+			int next = neighbours[i];
+			if(m_vClosed[next] == m_uGeneration)
+			{
+				continue;
+			}
+
+			int depth = node.m_iDepth + 1;
+			if(m_vReached[next] == m_uGeneration)
+			{
+				if(depth >= m_vDepth[next])
+				{
+					continue;
+				}
+
+				// Shorter route to an open cell
+				m_vParent[next] = node.m_iIndex;
+				m_vDepth[next] = depth;
+			}
+			else if(!Reach(grid, next, node.m_iIndex))
+			{
+				continue;
+			}
+
+			int heuristic = abs(next % m_iWidth - m_iGoalX) + abs(next / m_iWidth - m_iGoalZ);
+			HeapNode open = { depth + heuristic, depth, next };
+			PushHeap(open);
+		}
+	}
+
+	return false;
+}
+
+bool GridSearch::SearchBFS(const base::CellGrid &grid, int start, int goal)
+{
+	Reach(grid, start, -1);
+	m_vFrontier.push_back(start);
+
+	int neighbours[4];
+	for(size_t head = 0; head < m_vFrontier.size(); head++)
+	{
+		int index = m_vFrontier[head];
+		if(!Expand())
+		{
+			return false;
+		}
+
+		if(index == goal)
+		{
+			return true;
+		}
+
+		int count = GetNeighbours(index, neighbours);
+		for(int i = 0; i < count; i++)
+		{
+			if(Reach(grid, neighbours[i], index))
+			{
+				m_vFrontier.push_back(neighbours[i]);
+			}
+		}
+	}
+
+	return false;
+}
+
+bool GridSearch::SearchDFS(const base::CellGrid &grid, int start, int goal)
+{
+	Reach(grid, start, -1);
+	m_vFrontier.push_back(start);
+
+	int neighbours[4];
+	while(!m_vFrontier.empty())
+	{
+		int index = m_vFrontier.back();
+		m_vFrontier.pop_back();
+		if(!Expand())
+		{
+			return false;
+		}
+
+		if(index == goal)
+		{
+			return true;
+		}
+
+		int count = GetNeighbours(index, neighbours);
+		for(int i = 0; i < count; i++)
+		{
+			if(Reach(grid, neighbours[i], index))
+			{
+				m_vFrontier.push_back(neighbours[i]);
+			}
+		}
+	}
+
+	return false;
+}
+
+bool GridSearch::Expand()
+{
+	m_iExpandedCount++;
+	return m_iMaxExpanded == 0 || m_iExpandedCount <= m_iMaxExpanded;
+}
+
+bool GridSearch::IsBefore(const HeapNode &a, const HeapNode &b)
+{
+	return a.m_iCost < b.m_iCost || (a.m_iCost == b.m_iCost && a.m_iDepth > b.m_iDepth);
+}
+
+void GridSearch::PushHeap(const HeapNode &node)
+{
+	// Sift up
+	size_t index = m_vHeap.size();
+	m_vHeap.push_back(node);
+	while(index > 0)
+	{
+		size_t parent = (index - 1) / 2;
+		if(!IsBefore(node, m_vHeap[parent]))
+		{
+			break;
+		}
+		m_vHeap[index] = m_vHeap[parent];
+		index = parent;
+	}
+	m_vHeap[index] = node;
+}
+
+GridSearch::HeapNode GridSearch::PopHeap()
+{
+	HeapNode top = m_vHeap[0];
+	HeapNode last = m_vHeap.back();
+	m_vHeap.pop_back();
+
+	// Sift down
+	size_t size = m_vHeap.size();
+	size_t index = 0;
+	while(size > 0)
+	{
+		size_t child = index * 2 + 1;
+		if(child >= size)
+		{
+			break;
+		}
+		if(child + 1 < size && IsBefore(m_vHeap[child + 1], m_vHeap[child]))
+		{
+			child++;
+		}
+		if(!IsBefore(m_vHeap[child], last))
+		{
+			break;
+		}
+		m_vHeap[index] = m_vHeap[child];
+		index = child;
+	}
+	if(size > 0)
+	{
+		m_vHeap[index] = last;
+	}
+
+	return top;
+}
+
+} // namespace ai
@@ -0,0 +1,95 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef AI_GRID_SEARCH_H_
+#define AI_GRID_SEARCH_H_
+
+#include <stdint.h> // uint32_t
+
+#include <vector> // vector<>()
+
+#include "base/cell_grid.h"
+#include "base/path_buffer.h"
+
+namespace ai{
+
+// In process path search over the blocked cell grid mirrored by the client.
+// Cells are 4-connected and only cells inside the grid are walkable.
+//
+// Per cell state lives in flat arrays sized to the grid and reused between
+// searches. Each search stamps the cells it touches with a new generation
+// so the arrays are never cleared, and the A* open list is a binary heap in
+// a preallocated array.
+class GridSearch{
+public:
+	enum Algorithm{
+		ASTAR,
+		BFS,
+		DFS
+	};
+
+	GridSearch();
+
+	// Writes the path from start to goal into path and returns true, or
+	// returns false if there is no path. A search that expands more than
+	// maxExpanded cells gives up, 0 is no limit.
+	bool FindPath(const base::CellGrid &grid, int startX, int startZ, int goalX, int goalZ, Algorithm algorithm, base::PathBuffer *path, int maxExpanded = 0);
+
+	// Number of cells expanded by the last search
+	int GetExpandedCount() const { return m_iExpandedCount; }
+
+private:
+	struct HeapNode{
+		int m_iCost; // f = g + h
+		int m_iDepth; // g, ties prefer deeper nodes
+		int m_iIndex;
+	};
+
+	void Prepare(const base::CellGrid &grid);
+
+	bool SearchAStar(const base::CellGrid &grid, int start, int goal);
+
+	bool SearchBFS(const base::CellGrid &grid, int start, int goal);
+
+	bool SearchDFS(const base::CellGrid &grid, int start, int goal);
+
+	// Counts an expanded cell, returns false once the search is over its limit
+	bool Expand();
+
+	// Marks the cell as reached from parent. Returns false if it was
+	// already reached or is blocked.
+	bool Reach(const base::CellGrid &grid, int index, int parent);
+
+	int GetNeighbours(int index, int *neighbours) const;
+
+	void PushHeap(const HeapNode &node);
+
+	HeapNode PopHeap();
+
+	static bool IsBefore(const HeapNode &a, const HeapNode &b);
+
+	int m_iWidth;
+	int m_iHeight;
+	int m_iGoalX;
+	int m_iGoalZ;
+	int m_iExpandedCount;
+	int m_iMaxExpanded;
+
+	uint32_t m_uGeneration;
+
+	// Per cell state, valid where m_vReached equals m_uGeneration
+	std::vector<uint32_t> m_vReached;
+	std::vector<uint32_t> m_vClosed;
+	std::vector<int> m_vParent;
+	std::vector<int> m_vDepth;
+
+	// A* open list, BFS queue and DFS stack
+	std::vector<HeapNode> m_vHeap;
+	std::vector<int> m_vFrontier;
+};
+
+} // namespace ai
+
+#endif
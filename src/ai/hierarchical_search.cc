@@ -0,0 +1,464 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "ai/hierarchical_search.h"
+
+#include <algorithm> // std::push_heap(), std::pop_heap()
+#include <climits> // INT_MAX
+#include <cstdlib> // abs()
+
+namespace ai{
+
+HierarchicalSearch::HierarchicalSearch()
+{
+	m_iWidth = 0;
+	m_iHeight = 0;
+	m_iClustersX = 0;
+	m_iClustersZ = 0;
+	m_iGoalCell = -1;
+	m_iGoalCost = INT_MAX;
+	m_iGoalParent = -1;
+	m_iExpandedCount = 0;
+	m_uGeneration = 0;
+}
+
+void HierarchicalSearch::OnCellChanged(int x, int z)
+{
+	if(x < 0 || z < 0 || x >= m_iWidth || z >= m_iHeight)
+	{
+		// Outside the clusters, or the clusters are not built yet
+		return;
+	}
+
+	int clusterX = x / CLUSTER_SIZE;
+	int clusterZ = z / CLUSTER_SIZE;
+	m_vClusters[clusterZ * m_iClustersX + clusterX].m_bIsDirty = true;
+
+	// Entrances on a border belong to the clusters on both sides
+	if(x % CLUSTER_SIZE == 0 && clusterX > 0)
+	{
+		m_vClusters[clusterZ * m_iClustersX + clusterX - 1].m_bIsDirty = true;
+	}
+	if(x % CLUSTER_SIZE == CLUSTER_SIZE - 1 && clusterX < m_iClustersX - 1)
+	{
+		m_vClusters[clusterZ * m_iClustersX + clusterX + 1].m_bIsDirty = true;
+	}
+	if(z % CLUSTER_SIZE == 0 && clusterZ > 0)
+	{
+		m_vClusters[(clusterZ - 1) * m_iClustersX + clusterX].m_bIsDirty = true;
+	}
+	if(z % CLUSTER_SIZE == CLUSTER_SIZE - 1 && clusterZ < m_iClustersZ - 1)
+	{
+		m_vClusters[(clusterZ + 1) * m_iClustersX + clusterX].m_bIsDirty = true;
+	}
+}
+
+bool HierarchicalSearch::FindPath(const base::CellGrid &grid, int startX, int startZ, int goalX, int goalZ, base::PathBuffer *waypoints)
+{
+	m_iExpandedCount = 0;
+
+	if(!grid.IsInside(startX, startZ) || !grid.IsInside(goalX, goalZ) ||
+		grid.IsBlocked(startX, startZ) || grid.IsBlocked(goalX, goalZ))
+	{
+		return false;
+	}
+
+	Prepare(grid);
+
+	int start = startZ * m_iWidth + startX;
+	int goal = goalZ * m_iWidth + goalX;
+	Cluster &startCluster = m_vClusters[GetClusterIndex(start)];
+	Cluster &goalCluster = m_vClusters[GetClusterIndex(goal)];
+
+	waypoints->Clear();
+	waypoints->PushFront(base::Vector3(goalX, 0, goalZ));
+
+	if(&startCluster == &goalCluster)
+	{
+		FillField(grid, startCluster, start);
+		if(GetField(startCluster, goal) >= 0)
+		{
+			// Connected inside the cluster, no need for the abstract graph
+			if(start != goal)
+			{
+				waypoints->PushFront(base::Vector3(startX, 0, startZ));
+			}
+			return true;
+		}
+	}
+
+	m_iGoalCell = goal;
+	m_iGoalCost = INT_MAX;
+	m_iGoalParent = -1;
+	m_vHeap.clear();
+
+	// Connect the goal to the nodes of its cluster
+	FillField(grid, goalCluster, goal);
+	m_vGoalDistances.resize(goalCluster.m_vNodes.size());
+	for(size_t i = 0; i < goalCluster.m_vNodes.size(); i++)
+	{
+		m_vGoalDistances[i] = GetField(goalCluster, goalCluster.m_vNodes[i].m_iCell);
+	}
+
+	// and the start to the nodes of its cluster
+	FillField(grid, startCluster, start);
+	for(size_t i = 0; i < startCluster.m_vNodes.size(); i++)
+	{
+		int distance = GetField(startCluster, startCluster.m_vNodes[i].m_iCell);
+		if(distance >= 0)
+		{
+			Relax(startCluster.m_vNodes[i].m_iCell, distance, -1);
+		}
+	}
+
+	while(!m_vHeap.empty())
+	{
+		std::pop_heap(m_vHeap.begin(), m_vHeap.end(), HeapOrder());
+		HeapNode node = m_vHeap.back();
+		m_vHeap.pop_back();
+
+		if(node.m_iCell == -1)
+		{
+			break;
+		}
+
+		Cluster &cluster = m_vClusters[GetClusterIndex(node.m_iCell)];
+		int slot = m_vNodeSlot[node.m_iCell];
+		if(cluster.m_vClosed[slot] == m_uGeneration)
+		{
+			// Stale entry, the node was reached again with a lower cost
+			continue;
+		}
+		cluster.m_vClosed[slot] = m_uGeneration;
+		m_iExpandedCount++;
+
+		int cost = cluster.m_vCost[slot];
+		int count = (int)cluster.m_vNodes.size();
+		for(int i = 0; i < count; i++)
+		{
+			int distance = cluster.m_vDistances[slot * count + i];
+			if(distance > 0)
+			{
+				Relax(cluster.m_vNodes[i].m_iCell, cost + distance, node.m_iCell);
+			}
+		}
+
+		const Node &entrance = cluster.m_vNodes[slot];
+		for(int i = 0; i < entrance.m_iPartnerCount; i++)
+		{
+			Relax(entrance.m_iPartners[i], cost + 1, node.m_iCell);
+		}
+
+		if(&cluster == &goalCluster && m_vGoalDistances[slot] >= 0 && cost + m_vGoalDistances[slot] < m_iGoalCost)
+		{
+			m_iGoalCost = cost + m_vGoalDistances[slot];
+			m_iGoalParent = node.m_iCell;
+
+			HeapNode open = { m_iGoalCost, m_iGoalCost, -1 };
+			m_vHeap.push_back(open);
+			std::push_heap(m_vHeap.begin(), m_vHeap.end(), HeapOrder());
+		}
+	}
+
+	if(m_iGoalParent == -1)
+	{
+		waypoints->Clear();
+		return false;
+	}
+
+	// Walk back from the goal, the start or goal may be a node itself
+	for(int cell = m_iGoalParent; cell != -1; cell = m_vClusters[GetClusterIndex(cell)].m_vParent[m_vNodeSlot[cell]])
+	{
+		if(cell != goal)
+		{
+			waypoints->PushFront(base::Vector3(cell % m_iWidth, 0, cell / m_iWidth));
+		}
+	}
+
+	const base::Vector3 &first = waypoints->GetData()[0];
+	if(first.m_iX != startX || first.m_iZ != startZ)
+	{
+		waypoints->PushFront(base::Vector3(startX, 0, startZ));
+	}
+
+	return true;
+}
+
+bool HierarchicalSearch::RefineSegment(const base::CellGrid &grid, const base::Vector3 &from, const base::Vector3 &to, base::PathBuffer *segment)
+{
+	segment->Clear();
+
+	if(!grid.IsInside(from.m_iX, from.m_iZ) || !grid.IsInside(to.m_iX, to.m_iZ) ||
+		grid.IsBlocked(from.m_iX, from.m_iZ) || grid.IsBlocked(to.m_iX, to.m_iZ))
+	{
+		return false;
+	}
+
+	Prepare(grid);
+
+	int start = from.m_iZ * m_iWidth + from.m_iX;
+	int goal = to.m_iZ * m_iWidth + to.m_iX;
+
+	segment->PushFront(base::Vector3(to.m_iX, 0, to.m_iZ));
+	if(start == goal)
+	{
+		return true;
+	}
+
+	if(abs(to.m_iX - from.m_iX) + abs(to.m_iZ - from.m_iZ) == 1)
+	{
+		// Step across a border
+		segment->PushFront(base::Vector3(from.m_iX, 0, from.m_iZ));
+		return true;
+	}
+
+	const Cluster &cluster = m_vClusters[GetClusterIndex(start)];
+	if(GetClusterIndex(start) != GetClusterIndex(goal))
+	{
+		segment->Clear();
+		return false;
+	}
+
+	FillField(grid, cluster, start);
+	int distance = GetField(cluster, goal);
+	if(distance < 0)
+	{
+		segment->Clear();
+		return false;
+	}
+
+	// Walk down the distances from the goal, nodes are added in front so
+	// the segment ends up in order
+	int cell = goal;
+	while(distance > 0)
+	{
+		int x = cell % m_iWidth;
+		int z = cell / m_iWidth;
+		int neighbours[4] = { cell - 1, cell + 1, cell - m_iWidth, cell + m_iWidth };
+		bool inside[4] = { x > cluster.m_iMinX, x < cluster.m_iMaxX - 1, z > cluster.m_iMinZ, z < cluster.m_iMaxZ - 1 };
+
+		for(int i = 0; i < 4; i++)
+		{
+			if(inside[i] && GetField(cluster, neighbours[i]) == distance - 1)
+			{
+				cell = neighbours[i];
+				break;
+			}
+		}
+
+		distance--;
+		segment->PushFront(base::Vector3(cell % m_iWidth, 0, cell / m_iWidth));
+	}
+
+	return true;
+}
+
+void HierarchicalSearch::Prepare(const base::CellGrid &grid)
+{
+	if(m_iWidth != grid.GetWidth() || m_iHeight != grid.GetHeight())
+	{
+		m_iWidth = grid.GetWidth();
+		m_iHeight = grid.GetHeight();
+		m_iClustersX = (m_iWidth + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+		m_iClustersZ = (m_iHeight + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+
+		m_vClusters.assign((size_t)m_iClustersX * m_iClustersZ, Cluster());
+		for(int clusterZ = 0; clusterZ < m_iClustersZ; clusterZ++)
+		{
+			for(int clusterX = 0; clusterX < m_iClustersX; clusterX++)
+			{
+				Cluster &cluster = m_vClusters[clusterZ * m_iClustersX + clusterX];
+				cluster.m_iMinX = clusterX * CLUSTER_SIZE;
+				cluster.m_iMinZ = clusterZ * CLUSTER_SIZE;
+				cluster.m_iMaxX = std::min(cluster.m_iMinX + CLUSTER_SIZE, m_iWidth);
+				cluster.m_iMaxZ = std::min(cluster.m_iMinZ + CLUSTER_SIZE, m_iHeight);
+				cluster.m_bIsDirty = true;
+			}
+		}
+
+		m_vNodeSlot.assign((size_t)m_iWidth * m_iHeight, -1);
+		m_vField.resize(CLUSTER_SIZE * CLUSTER_SIZE);
+		m_uGeneration = 0;
+	}
+
+	for(size_t i = 0; i < m_vClusters.size(); i++)
+	{
+		if(m_vClusters[i].m_bIsDirty)
+		{
+			BuildCluster(grid, &m_vClusters[i]);
+		}
+	}
+
+	if(++m_uGeneration == 0)
+	{
+		// Generation wrapped, stamps from old searches could match again
+		for(size_t i = 0; i < m_vClusters.size(); i++)
+		{
+			m_vClusters[i].m_vReached.assign(m_vClusters[i].m_vNodes.size(), 0);
+			m_vClusters[i].m_vClosed.assign(m_vClusters[i].m_vNodes.size(), 0);
+		}
+		m_uGeneration = 1;
+	}
+}
+
+void HierarchicalSearch::BuildCluster(const base::CellGrid &grid, Cluster *cluster)
+{
+	for(size_t i = 0; i < cluster->m_vNodes.size(); i++)
+	{
+		m_vNodeSlot[cluster->m_vNodes[i].m_iCell] = -1;
+	}
+	cluster->m_vNodes.clear();
+
+	int width = cluster->m_iMaxX - cluster->m_iMinX;
+	int height = cluster->m_iMaxZ - cluster->m_iMinZ;
+
+	if(cluster->m_iMinZ > 0)
+	{
+		AddEntrances(grid, cluster, cluster->m_iMinX, cluster->m_iMinZ, 1, 0, width, 0, -1);
+	}
+	if(cluster->m_iMaxZ < m_iHeight)
+	{
+		AddEntrances(grid, cluster, cluster->m_iMinX, cluster->m_iMaxZ - 1, 1, 0, width, 0, 1);
+	}
+	if(cluster->m_iMinX > 0)
+	{
+		AddEntrances(grid, cluster, cluster->m_iMinX, cluster->m_iMinZ, 0, 1, height, -1, 0);
+	}
+	if(cluster->m_iMaxX < m_iWidth)
+	{
+		AddEntrances(grid, cluster, cluster->m_iMaxX - 1, cluster->m_iMinZ, 0, 1, height, 1, 0);
+	}
+
+	size_t count = cluster->m_vNodes.size();
+	cluster->m_vDistances.assign(count * count, -1);
+	for(size_t i = 0; i < count; i++)
+	{
+		FillField(grid, *cluster, cluster->m_vNodes[i].m_iCell);
+		for(size_t j = 0; j < count; j++)
+		{
+			cluster->m_vDistances[i * count + j] = GetField(*cluster, cluster->m_vNodes[j].m_iCell);
+		}
+	}
+
+	cluster->m_vReached.assign(count, 0);
+	cluster->m_vClosed.assign(count, 0);
+	cluster->m_vCost.resize(count);
+	cluster->m_vParent.resize(count);
+	cluster->m_bIsDirty = false;
+}
+
+void HierarchicalSearch::AddEntrances(const base::CellGrid &grid, Cluster *cluster, int x, int z, int stepX, int stepZ, int length, int acrossX, int acrossZ)
+{
+	// Both clusters of a border scan it in the same order and agree on
+	// where its entrances are
+	int runStart = -1;
+	for(int i = 0; i <= length; i++)
+	{
+		int cellX = x + i * stepX;
+		int cellZ = z + i * stepZ;
+		bool isOpen = i < length && !grid.IsBlocked(cellX, cellZ) && !grid.IsBlocked(cellX + acrossX, cellZ + acrossZ);
+
+		if(isOpen && runStart == -1)
+		{
+			runStart = i;
+		}
+		else if(!isOpen && runStart != -1)
+		{
+			// One entrance in the middle of the run
+			int middle = (runStart + i - 1) / 2;
+			int entranceX = x + middle * stepX;
+			int entranceZ = z + middle * stepZ;
+			int cell = entranceZ * m_iWidth + entranceX;
+			AddNode(cluster, cell, cell + acrossZ * m_iWidth + acrossX);
+			runStart = -1;
+		}
+	}
+}
+
+void HierarchicalSearch::AddNode(Cluster *cluster, int cell, int partner)
+{
+	int slot = m_vNodeSlot[cell];
+	if(slot == -1)
+	{
+		Node node = { cell, { partner, -1 }, 1 };
+		m_vNodeSlot[cell] = (int)cluster->m_vNodes.size();
+		cluster->m_vNodes.push_back(node);
+		return;
+	}
+
+	// Corner cell with an entrance on both of its borders
+	Node &node = cluster->m_vNodes[slot];
+	node.m_iPartners[node.m_iPartnerCount++] = partner;
+}
+
+void HierarchicalSearch::FillField(const base::CellGrid &grid, const Cluster &cluster, int cell)
+{
+	int width = cluster.m_iMaxX - cluster.m_iMinX;
+	int height = cluster.m_iMaxZ - cluster.m_iMinZ;
+	std::fill(m_vField.begin(), m_vField.begin() + width * height, -1);
+
+	m_vQueue.clear();
+	m_vQueue.push_back((cell / m_iWidth - cluster.m_iMinZ) * width + cell % m_iWidth - cluster.m_iMinX);
+	m_vField[m_vQueue[0]] = 0;
+
+	for(size_t head = 0; head < m_vQueue.size(); head++)
+	{
+		int local = m_vQueue[head];
+		int x = local % width;
+		int z = local / width;
+		int neighbours[4] = { local - 1, local + 1, local - width, local + width };
+		bool inside[4] = { x > 0, x < width - 1, z > 0, z < height - 1 };
+
+		for(int i = 0; i < 4; i++)
+		{
+			int next = neighbours[i];
+			if(!inside[i] || m_vField[next] != -1 ||
+				grid.IsBlocked(cluster.m_iMinX + next % width, cluster.m_iMinZ + next / width))
+			{
+				continue;
+			}
+
+			m_vField[next] = m_vField[local] + 1;
+			m_vQueue.push_back(next);
+		}
+	}
+}
+
+int HierarchicalSearch::GetField(const Cluster &cluster, int cell) const
+{
+	int width = cluster.m_iMaxX - cluster.m_iMinX;
+	return m_vField[(cell / m_iWidth - cluster.m_iMinZ) * width + cell % m_iWidth - cluster.m_iMinX];
+}
+
+int HierarchicalSearch::GetClusterIndex(int cell) const
+{
+	return (cell / m_iWidth / CLUSTER_SIZE) * m_iClustersX + (cell % m_iWidth) / CLUSTER_SIZE;
+}
+
+void HierarchicalSearch::Relax(int cell, int cost, int parent)
+{
+	Cluster &cluster = m_vClusters[GetClusterIndex(cell)];
+	int slot = m_vNodeSlot[cell];
+	if(cluster.m_vClosed[slot] == m_uGeneration ||
+		(cluster.m_vReached[slot] == m_uGeneration && cost >= cluster.m_vCost[slot]))
+	{
+		return;
+	}
+
+	cluster.m_vReached[slot] = m_uGeneration;
+	cluster.m_vCost[slot] = cost;
+	cluster.m_vParent[slot] = parent;
+
+	HeapNode open = { cost + GetHeuristic(cell), cost, cell };
+	m_vHeap.push_back(open);
+	std::push_heap(m_vHeap.begin(), m_vHeap.end(), HeapOrder());
+}
+
+int HierarchicalSearch::GetHeuristic(int cell) const
+{
+	return abs(cell % m_iWidth - m_iGoalCell % m_iWidth) + abs(cell / m_iWidth - m_iGoalCell / m_iWidth);
+}
+
+} // namespace ai
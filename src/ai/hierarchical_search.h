@@ -0,0 +1,150 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef AI_HIERARCHICAL_SEARCH_H_
+#define AI_HIERARCHICAL_SEARCH_H_
+
+#include <stdint.h> // uint32_t
+
+#include <vector> // vector<>()
+
+#include "base/cell_grid.h"
+#include "base/path_buffer.h"
+
+namespace ai{
+
+#define CLUSTER_SIZE 16 // Width and height of a cluster in cells
+
+// Hierarchical path search (HPA*) over the blocked cell grid.
+//
+// The grid is split into CLUSTER_SIZE x CLUSTER_SIZE clusters. Every run of
+// open cells along the border of two clusters has one entrance, a pair of
+// cells facing each other across the border. The entrance cells of a
+// cluster are the nodes of the abstract graph, connected to each other by
+// their distance inside the cluster and to the facing cell by a step.
+//
+// A search runs A* over the abstract graph and returns waypoints, each
+// consecutive pair is either inside one cluster or one step apart. The
+// caller refines the waypoints into cells one segment at a time with
+// RefineSegment() so an agent can start moving before the whole path is
+// known.
+//
+// A changed cell marks its cluster, and the cluster across the border when
+// the cell is on one, to be rebuilt by the next search.
+class HierarchicalSearch{
+public:
+	HierarchicalSearch();
+
+	// Marks the clusters that depend on the cell to be rebuilt
+	void OnCellChanged(int x, int z);
+
+	// Writes the waypoints from start to goal into waypoints and returns
+	// true, or returns false if there is no path
+	bool FindPath(const base::CellGrid &grid, int startX, int startZ, int goalX, int goalZ, base::PathBuffer *waypoints);
+
+	// Writes the cells from one waypoint to the next into segment, both
+	// included. Returns false if the cells between them have been blocked.
+	bool RefineSegment(const base::CellGrid &grid, const base::Vector3 &from, const base::Vector3 &to, base::PathBuffer *segment);
+
+	// Number of abstract nodes expanded by the last search
+	int GetExpandedCount() const { return m_iExpandedCount; }
+
+private:
+	// An entrance cell and the cells facing it in the neighbouring clusters.
+	// A corner cell is on two borders.
+	struct Node{
+		int m_iCell;
+		int m_iPartners[2];
+		int m_iPartnerCount;
+	};
+
+	struct Cluster{
+		int m_iMinX;
+		int m_iMinZ;
+		int m_iMaxX; // Exclusive
+		int m_iMaxZ; // Exclusive
+		bool m_bIsDirty;
+
+		std::vector<Node> m_vNodes;
+
+		// Distance between every pair of nodes inside the cluster, -1 if
+		// they are not connected, row major
+		std::vector<int> m_vDistances;
+
+		// Search state per node, valid where m_vReached equals the search
+		// generation
+		std::vector<uint32_t> m_vReached;
+		std::vector<uint32_t> m_vClosed;
+		std::vector<int> m_vCost;
+		std::vector<int> m_vParent; // Cell of the previous node or -1 for the start
+	};
+
+	struct HeapNode{
+		int m_iCost; // f = g + h
+		int m_iDepth; // g
+		int m_iCell; // -1 for the goal
+	};
+
+	struct HeapOrder{
+		bool operator()(const HeapNode &a, const HeapNode &b) const
+		{
+			return a.m_iCost > b.m_iCost || (a.m_iCost == b.m_iCost && a.m_iDepth < b.m_iDepth);
+		}
+	};
+
+	// Sizes the clusters to the grid and rebuilds the dirty ones
+	void Prepare(const base::CellGrid &grid);
+
+	void BuildCluster(const base::CellGrid &grid, Cluster *cluster);
+
+	// Adds an entrance for each run of open cells on both sides of a
+	// border. Cells from (x, z) stepping by (stepX, stepZ) face the cells
+	// offset by (acrossX, acrossZ).
+	void AddEntrances(const base::CellGrid &grid, Cluster *cluster, int x, int z, int stepX, int stepZ, int length, int acrossX, int acrossZ);
+
+	void AddNode(Cluster *cluster, int cell, int partner);
+
+	// Breadth first distances from the cell to every cell of its cluster
+	// into m_vField, -1 where unreachable
+	void FillField(const base::CellGrid &grid, const Cluster &cluster, int cell);
+
+	int GetField(const Cluster &cluster, int cell) const;
+
+	int GetClusterIndex(int cell) const;
+
+	// Lowers the cost of reaching a node and queues it
+	void Relax(int cell, int cost, int parent);
+
+	int GetHeuristic(int cell) const;
+
+	int m_iWidth;
+	int m_iHeight;
+	int m_iClustersX;
+	int m_iClustersZ;
+	int m_iGoalCell;
+	int m_iGoalCost;
+	int m_iGoalParent;
+	int m_iExpandedCount;
+
+	uint32_t m_uGeneration;
+
+	std::vector<Cluster> m_vClusters;
+
+	// Index of the node at each cell in its cluster or -1
+	std::vector<int> m_vNodeSlot;
+
+	// Distances from one cell of a cluster, CLUSTER_SIZE x CLUSTER_SIZE
+	std::vector<int> m_vField;
+	std::vector<int> m_vQueue;
+
+	// Distance from each node of the goal cluster to the goal
+	std::vector<int> m_vGoalDistances;
+
+	std::vector<HeapNode> m_vHeap;
+};
+
+} // namespace ai
+
+#endif
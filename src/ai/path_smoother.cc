@@ -0,0 +1,139 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "ai/path_smoother.h"
+
+#include <cstdlib> // abs()
+
+namespace ai{
+
+void PathSmoother::RemoveCollinear(const base::Vector3 *nodes, int size, base::PathBuffer *out)
+{
+	out->Clear();
+	if(size <= 2)
+	{
+		out->Append(nodes, size);
+		return;
+	}
+
+	out->Append(&nodes[0], 1);
+
+	int last = 0;
+	for(int i = 1; i < size - 1; i++)
+	{
+		if(!IsCollinear(nodes[last], nodes[i], nodes[i + 1]))
+		{
+			out->Append(&nodes[i], 1);
+			last = i;
+		}
+	}
+
+	out->Append(&nodes[size - 1], 1);
+}
+
+void PathSmoother::SmoothLineOfSight(const base::CellGrid &grid, const base::Vector3 *nodes, int size, base::PathBuffer *out)
+{
+	out->Clear();
+	if(size <= 2)
+	{
+		out->Append(nodes, size);
+		return;
+	}
+
+	out->Append(&nodes[0], 1);
+
+	// Last node written and the node reached after it, which is written
+	// once the next node is known not to be collinear with both
+	int last = 0;
+	int pending = -1;
+
+	int anchor = 0;
+	while(anchor < size - 1)
+	{
+		// The next node is always reachable, it is a neighbour on the path
+		int next = anchor + 1;
+		while(next + 1 < size && HasLineOfSight(grid, nodes[anchor].m_iX, nodes[anchor].m_iZ, nodes[next + 1].m_iX, nodes[next + 1].m_iZ))
+		{
+			next++;
+		}
+
+		if(pending != -1 && !IsCollinear(nodes[last], nodes[pending], nodes[next]))
+		{
+			out->Append(&nodes[pending], 1);
+			last = pending;
+		}
+		pending = next;
+		anchor = next;
+	}
+
+	out->Append(&nodes[pending], 1);
+}
+
+bool PathSmoother::HasLineOfSight(const base::CellGrid &grid, int x0, int z0, int x1, int z1)
+{
+	int dx = abs(x1 - x0);
+	int dz = abs(z1 - z0);
+	int stepX = x1 > x0 ? 1 : -1;
+	int stepZ = z1 > z0 ? 1 : -1;
+
+	int x = x0;
+	int z = z0;
+	if(grid.IsBlocked(x, z))
+	{
+		return false;
+	}
+
+	// Walk every cell the line touches. The line leaves the current cell
+	// through the vertical side when (0.5 + ix) / dx < (0.5 + iz) / dz, the
+	// comparison is done in integers.
+	for(int ix = 0, iz = 0; ix < dx || iz < dz; )
+	{
+		long long crossX = (long long)(1 + 2 * ix) * dz;
+		long long crossZ = (long long)(1 + 2 * iz) * dx;
+
+		if(crossX == crossZ)
+		{
+			// Through a corner, both cells beside it are touched
+			if(grid.IsBlocked(x + stepX, z) || grid.IsBlocked(x, z + stepZ))
+			{
+				return false;
+			}
+			x += stepX;
+			z += stepZ;
+			ix++;
+			iz++;
+		}
+		else if(crossX < crossZ)
+		{
+			x += stepX;
+			ix++;
+		}
+		else
+		{
+			z += stepZ;
+			iz++;
+		}
+
+		if(grid.IsBlocked(x, z))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool PathSmoother::IsCollinear(const base::Vector3 &a, const base::Vector3 &b, const base::Vector3 &c)
+{
+	long long abX = b.m_iX - a.m_iX;
+	long long abZ = b.m_iZ - a.m_iZ;
+	long long bcX = c.m_iX - b.m_iX;
+	long long bcZ = c.m_iZ - b.m_iZ;
+
+	// On the same line and not turning back
+	return abX * bcZ - abZ * bcX == 0 && abX * bcX + abZ * bcZ >= 0;
+}
+
+} // namespace ai
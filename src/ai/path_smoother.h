@@ -0,0 +1,58 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef AI_PATH_SMOOTHER_H_
+#define AI_PATH_SMOOTHER_H_
+
+#include "base/cell_grid.h"
+#include "base/path_buffer.h"
+#include "base/vector3.h"
+
+namespace ai{
+
+// Smoothed copy of a path, rebuilt once the path or the grid changes
+struct SmoothedPath{
+	SmoothedPath()
+		: m_uGridVersion(0), m_bIsValid(false)
+	{
+	}
+
+	base::PathBuffer m_Path;
+
+	// Version of the grid the path was smoothed over
+	unsigned int m_uGridVersion;
+	bool m_bIsValid;
+};
+
+// Post-processing of a completed path of grid cells. Searches return one
+// node per cell, agents only need the nodes where they turn.
+//
+// Cells are unit squares centred on their coordinates. A straight line
+// between two nodes is walkable when every cell it touches is open, a line
+// through the shared corner of two cells touches both so the smoothed path
+// never cuts the corner of a blocked cell.
+class PathSmoother{
+public:
+	// Writes the nodes where the direction of the path changes into out,
+	// the first and last node are always kept
+	static void RemoveCollinear(const base::Vector3 *nodes, int size, base::PathBuffer *out);
+
+	// String pulling. Writes a path into out that skips from each node to
+	// the furthest later node in line of sight of it, then drops the
+	// collinear nodes left.
+	static void SmoothLineOfSight(const base::CellGrid &grid, const base::Vector3 *nodes, int size, base::PathBuffer *out);
+
+	// Returns true if no cell touched by the line between the two cells is
+	// blocked
+	static bool HasLineOfSight(const base::CellGrid &grid, int x0, int z0, int x1, int z1);
+
+private:
+	// True if b lies on the line from a to c and between them
+	static bool IsCollinear(const base::Vector3 &a, const base::Vector3 &b, const base::Vector3 &c);
+};
+
+} // namespace ai
+
+#endif
@@ -0,0 +1,95 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "base/cell_batch.h"
+
+#include "base/cell_kernels.h"
+
+namespace base{
+
+CellBatch::CellBatch()
+{
+	Clear();
+}
+
+void CellBatch::Clear()
+{
+	// The set is only filled by large batches, its buckets are freed
+	// rather than walked by every later Clear()
+	if(!m_Set.empty())
+	{
+		std::unordered_set<CellKey>().swap(m_Set);
+	}
+	if(m_vCells.capacity() > CELL_BATCH_KEEP_CELLS)
+	{
+		std::vector<CellKey>().swap(m_vCells);
+	}
+	m_vCells.clear();
+
+	// An empty batch has an empty box
+	m_iMinX = m_iMinZ = 1;
+	m_iMaxX = m_iMaxZ = 0;
+}
+
+bool CellBatch::Add(int x, int z)
+{
+	if(!CellKey::Fits(x, z))
+	{
+		return false;
+	}
+
+	if(m_vCells.empty() || x < m_iMinX) m_iMinX = x;
+	if(m_vCells.empty() || x > m_iMaxX) m_iMaxX = x;
+	if(m_vCells.empty() || z < m_iMinZ) m_iMinZ = z;
+	if(m_vCells.empty() || z > m_iMaxZ) m_iMaxZ = z;
+
+	m_vCells.push_back(CellKey(x, z));
+	if(m_vCells.size() > CELL_BATCH_SCAN_CELLS)
+	{
+		if(m_Set.empty())
+		{
+			m_Set.insert(m_vCells.begin(), m_vCells.end());
+		}
+		else
+		{
+			m_Set.insert(m_vCells.back());
+		}
+	}
+
+	return true;
+}
+
+bool CellBatch::IsCrossedBy(const Vector3 *nodes, int size, int minX, int minZ, int maxX, int maxZ) const
+{
+	if(m_vCells.empty() || maxX < m_iMinX || minX > m_iMaxX || maxZ < m_iMinZ || minZ > m_iMaxZ)
+	{
+		return false;
+	}
+
+	if(m_Set.empty())
+	{
+		return CellKernels::FindAnyCell(nodes, size, &m_vCells[0], (int)m_vCells.size()) != -1;
+	}
+
+	for(int i = 0; i < size; i++)
+	{
+		int x = nodes[i].m_iX;
+		int z = nodes[i].m_iZ;
+
+		// Nodes outside the box are not packed, they may not fit a key
+		if(x < m_iMinX || x > m_iMaxX || z < m_iMinZ || z > m_iMaxZ)
+		{
+			continue;
+		}
+		if(m_Set.count(CellKey(x, z)) != 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+} // namespace base
@@ -0,0 +1,59 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef BASE_CELL_BATCH_H_
+#define BASE_CELL_BATCH_H_
+
+#include <unordered_set> // unordered_set<>()
+#include <vector> // vector<>()
+
+#include "base/cell_key.h"
+#include "base/vector3.h"
+
+namespace base{
+
+#define CELL_BATCH_SCAN_CELLS 16 // Largest batch compared with every node
+#define CELL_BATCH_KEEP_CELLS 4096 // Cell storage kept between batches
+
+// Cells changed together, such as a region blocked in one call, so each
+// path is checked once against all of them instead of once per cell.
+// Small batches are compared with four nodes at a time by CellKernels,
+// larger ones are looked up in a hash set node by node. Both are skipped
+// for paths whose bounding box misses the batch.
+class CellBatch{
+public:
+	CellBatch();
+
+	void Clear();
+
+	// Returns false if the cell does not fit a CellKey and was not added
+	bool Add(int x, int z);
+
+	bool IsEmpty() const { return m_vCells.empty(); }
+
+	int GetCount() const { return (int)m_vCells.size(); }
+
+	const CellKey *GetCells() const { return m_vCells.empty() ? NULL : &m_vCells[0]; }
+
+	// True if a node of the path is at one of the cells. minX to maxZ is
+	// the bounding box of the path.
+	bool IsCrossedBy(const Vector3 *nodes, int size, int minX, int minZ, int maxX, int maxZ) const;
+
+private:
+	std::vector<CellKey> m_vCells;
+
+	// The cells once there are more than CELL_BATCH_SCAN_CELLS
+	std::unordered_set<CellKey> m_Set;
+
+	// Bounding box of the cells
+	int m_iMinX;
+	int m_iMinZ;
+	int m_iMaxX;
+	int m_iMaxZ;
+};
+
+} // namespace base
+
+#endif
@@ -0,0 +1,193 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "base/cell_grid.h"
+
+#ifdef _MSC_VER
+#include <intrin.h> // _BitScanForward()
+#endif
+
+namespace base{
+
+CellGrid::CellGrid()
+{
+	m_iWidth = 0;
+	m_iHeight = 0;
+	m_iBlockedCount = 0;
+}
+
+void CellGrid::Resize(int width, int height)
+{
+	if(width < 0 || height < 0 || (width == m_iWidth && height == m_iHeight))
+	{
+		return;
+	}
+
+	// Collect the blocked cells and insert them again with the new bounds
+	std::vector<long long> blocked;
+	blocked.reserve(m_iBlockedCount);
+	ForEachBlocked([&blocked](int x, int z){ blocked.push_back(Pack(x, z)); });
+
+	m_iWidth = width;
+	m_iHeight = height;
+	m_iBlockedCount = 0;
+	m_vBits.assign(((size_t)width * height + 31) / 32, 0);
+	m_OutsideCells.clear();
+
+	for(size_t i = 0; i < blocked.size(); i++)
+	{
+		Block(UnpackX(blocked[i]), UnpackZ(blocked[i]));
+	}
+}
+
+bool CellGrid::Block(int x, int z)
+{
+	if(IsInside(x, z))
+	{
+		size_t index = (size_t)z * m_iWidth + x;
+		uint32_t mask = 1u << (index % 32);
+		if(m_vBits[index / 32] & mask)
+		{
+			return false;
+		}
+		m_vBits[index / 32] |= mask;
+	}
+	else if(!m_OutsideCells.insert(Pack(x, z)).second)
+	{
+		return false;
+	}
+
+	m_iBlockedCount++;
+	return true;
+}
+
+bool CellGrid::Open(int x, int z)
+{
+	if(IsInside(x, z))
+	{
+		size_t index = (size_t)z * m_iWidth + x;
+		uint32_t mask = 1u << (index % 32);
+		if(!(m_vBits[index / 32] & mask))
+		{
+			return false;
+		}
+		m_vBits[index / 32] &= ~mask;
+	}
+	else if(m_OutsideCells.erase(Pack(x, z)) == 0)
+	{
+		return false;
+	}
+
+	m_iBlockedCount--;
+	return true;
+}
+
+void CellGrid::BlockRun(long long index, long long count)
+{
+	long long end = (long long)m_iWidth * m_iHeight;
+	long long last = count > end - index ? end : index + count;
+	if(index < 0)
+	{
+		index = 0;
+	}
+
+	while(index < last)
+	{
+		size_t word = (size_t)(index / 32);
+		int bit = (int)(index % 32);
+		int bits = last - index < 32 - bit ? (int)(last - index) : 32 - bit;
+		uint32_t mask = (bits == 32 ? ~0u : (1u << bits) - 1) << bit;
+
+		m_iBlockedCount += CountBits(mask & ~m_vBits[word]);
+		m_vBits[word] |= mask;
+		index += bits;
+	}
+}
+
+bool CellGrid::IsBlocked(int x, int z) const
+{
+	if(IsInside(x, z))
+	{
+		size_t index = (size_t)z * m_iWidth + x;
+		return (m_vBits[index / 32] & (1u << (index % 32))) != 0;
+	}
+
+	return !m_OutsideCells.empty() && m_OutsideCells.count(Pack(x, z)) != 0;
+}
+
+void CellGrid::Clear()
+{
+	m_vBits.assign(m_vBits.size(), 0);
+	m_OutsideCells.clear();
+	m_iBlockedCount = 0;
+}
+
+void CellGrid::EncodeRuns(std::vector<int> *runs) const
+{
+	int end = m_iWidth * m_iHeight;
+	int index = 0;
+	bool blocked = false;
+
+	// A run ends at the first cell in the other state, whole words of one
+	// state are skipped
+	while(index < end)
+	{
+		int next = FindNext(index, !blocked, end);
+		runs->push_back(next - index);
+		index = next;
+		blocked = !blocked;
+	}
+}
+
+void CellGrid::EncodeBits(std::vector<int> *words) const
+{
+	for(size_t i = 0; i < m_vBits.size(); i++)
+	{
+		words->push_back((int)m_vBits[i]);
+	}
+}
+
+int CellGrid::FindNext(int index, bool blocked, int end) const
+{
+	size_t word = index / 32;
+	uint32_t bits = blocked ? m_vBits[word] : ~m_vBits[word];
+	bits &= ~0u << (index % 32);
+
+	while(bits == 0)
+	{
+		if(++word >= m_vBits.size())
+		{
+			return end;
+		}
+		bits = blocked ? m_vBits[word] : ~m_vBits[word];
+	}
+
+	int next = (int)(word * 32) + CountTrailingZeros(bits);
+	return next < end ? next : end;
+}
+
+int CellGrid::CountTrailingZeros(uint32_t bits)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, bits);
+	return (int)index;
+#else
+	return __builtin_ctz(bits);
+#endif
+}
+
+int CellGrid::CountBits(uint32_t bits)
+{
+#ifdef __GNUC__
+	return __builtin_popcount(bits);
+#else
+	bits = bits - ((bits >> 1) & 0x55555555);
+	bits = (bits & 0x33333333) + ((bits >> 2) & 0x33333333);
+	return (int)((((bits + (bits >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24);
+#endif
+}
+
+} // namespace base
@@ -0,0 +1,144 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef BASE_CELL_GRID_H_
+#define BASE_CELL_GRID_H_
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t
+#include <unordered_set> // unordered_set<>()
+#include <vector> // vector<>()
+
+namespace base{
+
+// Set of blocked cells in the game world, indexed by the x and z
+// coordinates of a cell. Cells inside the world are stored in a dense
+// bitset sized by Resize(), cells outside it in a hash set. Block, open
+// and lookup are O(1).
+class CellGrid{
+public:
+	CellGrid();
+
+	// Size the bitset for a width x height world. Blocked cells are kept.
+	void Resize(int width, int height);
+
+	// Returns true if the state of the cell changed
+	bool Block(int x, int z);
+
+	bool Open(int x, int z);
+
+	// Blocks count cells inside the world from the row major index on, a
+	// word of the bitset at a time
+	void BlockRun(long long index, long long count);
+
+	bool IsBlocked(int x, int z) const;
+
+	bool IsInside(int x, int z) const
+	{
+		return x >= 0 && z >= 0 && x < m_iWidth && z < m_iHeight;
+	}
+
+	int GetWidth() const { return m_iWidth; }
+
+	int GetHeight() const { return m_iHeight; }
+
+	int GetBlockedCount() const { return m_iBlockedCount; }
+
+	// Blocked cells outside the world bounds
+	int GetOutsideCount() const { return (int)m_OutsideCells.size(); }
+
+	void Clear();
+
+	// Lengths of alternating runs of open and blocked cells inside the
+	// world in row major order, starting with open. Appended to runs.
+	void EncodeRuns(std::vector<int> *runs) const;
+
+	// Appends the cells inside the world as a row major bitmap, cell i is
+	// bit i % 32 of word i / 32
+	void EncodeBits(std::vector<int> *words) const;
+
+	// Number of words EncodeBits() appends
+	size_t GetWordCount() const { return m_vBits.size(); }
+
+	// Replaces the cells inside the world with a bitmap laid out as by
+	// EncodeBits(). Calls func(x, z, blocked) for every cell that changed,
+	// words that did not change are skipped.
+	template<typename Func>
+	void AssignBits(const uint32_t *bits, Func func)
+	{
+		size_t size = (size_t)m_iWidth * m_iHeight;
+		for(size_t word = 0; word < m_vBits.size(); word++)
+		{
+			uint32_t value = bits[word];
+			if(word == size / 32)
+			{
+				// Bits past the last cell are not part of the world
+				value &= (1u << (size % 32)) - 1;
+			}
+
+			uint32_t changed = m_vBits[word] ^ value;
+			m_vBits[word] = value;
+			while(changed != 0)
+			{
+				int index = (int)(word * 32) + CountTrailingZeros(changed);
+				bool blocked = (value >> (index % 32)) & 1;
+				m_iBlockedCount += blocked ? 1 : -1;
+				func(index % m_iWidth, index / m_iWidth, blocked);
+				changed &= changed - 1;
+			}
+		}
+	}
+
+	// Calls func(x, z) for every blocked cell. Empty words of the bitset
+	// are skipped so the cost follows the number of blocked cells.
+	template<typename Func>
+	void ForEachBlocked(Func func) const
+	{
+		for(size_t word = 0; word < m_vBits.size(); word++)
+		{
+			uint32_t bits = m_vBits[word];
+			while(bits != 0)
+			{
+				int index = (int)(word * 32) + CountTrailingZeros(bits);
+				func(index % m_iWidth, index / m_iWidth);
+				bits &= bits - 1;
+			}
+		}
+
+		for(std::unordered_set<long long>::const_iterator it = m_OutsideCells.begin(); it != m_OutsideCells.end(); ++it)
+		{
+			func(UnpackX(*it), UnpackZ(*it));
+		}
+	}
+
+private:
+	static int CountTrailingZeros(uint32_t bits);
+
+	static int CountBits(uint32_t bits);
+
+	// Index of the first cell from index on that is blocked, or open, or
+	// end if there is none before it
+	int FindNext(int index, bool blocked, int end) const;
+
+	static long long Pack(int x, int z) { return ((long long)x << 32) | (uint32_t)z; }
+
+	static int UnpackX(long long key) { return (int)(key >> 32); }
+
+	static int UnpackZ(long long key) { return (int)(uint32_t)key; }
+
+	int m_iWidth;
+	int m_iHeight;
+	int m_iBlockedCount;
+
+	// One bit per cell, row major
+	std::vector<uint32_t> m_vBits;
+
+	// Blocked cells outside the world bounds
+	std::unordered_set<long long> m_OutsideCells;
+};
+
+} // namespace base
+
+#endif
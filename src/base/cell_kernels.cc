@@ -0,0 +1,155 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "base/cell_kernels.h"
+
+#include <stddef.h> // offsetof
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CELL_KERNELS_SSE2
+#include <emmintrin.h> // _mm_cmpeq_epi32()
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define CELL_KERNELS_NEON
+#include <arm_neon.h> // vld4q_s32()
+#endif
+
+namespace base{
+
+// The kernels load four nodes as sixteen ints
+static_assert(sizeof(Vector3) == 4 * sizeof(int), "Vector3 must be four packed ints");
+static_assert(offsetof(Vector3, m_iX) == 0 && offsetof(Vector3, m_iZ) == 2 * sizeof(int), "Vector3 must start with x, y, z");
+
+#if defined(CELL_KERNELS_SSE2)
+
+// x and z of four nodes, one node per lane
+static inline void LoadNodes(const Vector3 *nodes, __m128i *x, __m128i *z)
+{
+	__m128i node0 = _mm_loadu_si128((const __m128i*)&nodes[0]);
+	__m128i node1 = _mm_loadu_si128((const __m128i*)&nodes[1]);
+	__m128i node2 = _mm_loadu_si128((const __m128i*)&nodes[2]);
+	__m128i node3 = _mm_loadu_si128((const __m128i*)&nodes[3]);
+
+	// x0 x1 y0 y1, x2 x3 y2 y3, z0 z1 id0 id1, z2 z3 id2 id3
+	__m128i low01 = _mm_unpacklo_epi32(node0, node1);
+	__m128i low23 = _mm_unpacklo_epi32(node2, node3);
+	__m128i high01 = _mm_unpackhi_epi32(node0, node1);
+	__m128i high23 = _mm_unpackhi_epi32(node2, node3);
+
+	*x = _mm_unpacklo_epi64(low01, low23);
+	*z = _mm_unpacklo_epi64(high01, high23);
+}
+
+static inline __m128i Equals(__m128i nodeX, __m128i nodeZ, int x, int z)
+{
+	return _mm_and_si128(_mm_cmpeq_epi32(nodeX, _mm_set1_epi32(x)), _mm_cmpeq_epi32(nodeZ, _mm_set1_epi32(z)));
+}
+
+static inline bool IsAnySet(__m128i lanes)
+{
+	return _mm_movemask_epi8(lanes) != 0;
+}
+
+#elif defined(CELL_KERNELS_NEON)
+
+static inline uint32x4_t Equals(const int32x4x4_t &nodes, int x, int z)
+{
+	// vld4q_s32() splits the nodes into x, y, z and id lanes
+	return vandq_u32(vceqq_s32(nodes.val[0], vdupq_n_s32(x)), vceqq_s32(nodes.val[2], vdupq_n_s32(z)));
+}
+
+static inline bool IsAnySet(uint32x4_t lanes)
+{
+	return vmaxvq_u32(lanes) != 0;
+}
+
+#endif
+
+int CellKernels::FindCell(const Vector3 *nodes, int size, int x, int z)
+{
+	// The vector loop stops at the group holding the first match, the
+	// scalar loop finds the node in it
+	int i = 0;
+#if defined(CELL_KERNELS_SSE2)
+	for(; i + 4 <= size; i += 4)
+	{
+		__m128i nodeX, nodeZ;
+		LoadNodes(&nodes[i], &nodeX, &nodeZ);
+		if(IsAnySet(Equals(nodeX, nodeZ, x, z)))
+		{
+			break;
+		}
+	}
+#elif defined(CELL_KERNELS_NEON)
+	for(; i + 4 <= size; i += 4)
+	{
+		if(IsAnySet(Equals(vld4q_s32(&nodes[i].m_iX), x, z)))
+		{
+			break;
+		}
+	}
+#endif
+
+	for(; i < size; i++)
+	{
+		if(nodes[i].m_iX == x && nodes[i].m_iZ == z)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+int CellKernels::FindAnyCell(const Vector3 *nodes, int size, const CellKey *cells, int count)
+{
+	int i = 0;
+#if defined(CELL_KERNELS_SSE2)
+	for(; i + 4 <= size; i += 4)
+	{
+		__m128i nodeX, nodeZ;
+		LoadNodes(&nodes[i], &nodeX, &nodeZ);
+
+		__m128i found = _mm_setzero_si128();
+		for(int j = 0; j < count; j++)
+		{
+			found = _mm_or_si128(found, Equals(nodeX, nodeZ, cells[j].GetX(), cells[j].GetZ()));
+		}
+		if(IsAnySet(found))
+		{
+			break;
+		}
+	}
+#elif defined(CELL_KERNELS_NEON)
+	for(; i + 4 <= size; i += 4)
+	{
+		int32x4x4_t group = vld4q_s32(&nodes[i].m_iX);
+
+		uint32x4_t found = vdupq_n_u32(0);
+		for(int j = 0; j < count; j++)
+		{
+			found = vorrq_u32(found, Equals(group, cells[j].GetX(), cells[j].GetZ()));
+		}
+		if(IsAnySet(found))
+		{
+			break;
+		}
+	}
+#endif
+
+	for(; i < size; i++)
+	{
+		for(int j = 0; j < count; j++)
+		{
+			if(nodes[i].m_iX == cells[j].GetX() && nodes[i].m_iZ == cells[j].GetZ())
+			{
+				return i;
+			}
+		}
+	}
+
+	return -1;
+}
+
+} // namespace base
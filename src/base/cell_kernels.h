@@ -0,0 +1,29 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef BASE_CELL_KERNELS_H_
+#define BASE_CELL_KERNELS_H_
+
+#include "base/cell_key.h"
+#include "base/vector3.h"
+
+namespace base{
+
+// Scans of the nodes of a path for grid cells, four nodes at a time with
+// SSE2 on x86 and NEON on AArch64, one at a time elsewhere. Nodes match a
+// cell on x and z, y and the id are ignored.
+class CellKernels{
+public:
+	// Index of the first node at x, z or -1
+	static int FindCell(const Vector3 *nodes, int size, int x, int z);
+
+	// Index of the first node at any of the count cells or -1. Each group
+	// of four nodes is compared with every cell, meant for a few cells.
+	static int FindAnyCell(const Vector3 *nodes, int size, const CellKey *cells, int count);
+};
+
+} // namespace base
+
+#endif
@@ -1,4 +1,148 @@
 // Copyright (c) 2016 David Morton
 // Use of this source code is governed by a license that can be
 // found in the LICENSE file.
-// https://github.com/damorton/libraig.git
\ No newline at end of file
+// https://github.com/damorton/libraig.git
+
+#include "base/io_buffer.h"
+
+#include <cstring> // memcpy()
+
+namespace base{
+
+IOBuffer::IOBuffer()
+{
+	m_uHead = 0;
+	m_uSize = 0;
+}
+
+char *IOBuffer::GetWriteSpace(size_t minSize, size_t *size)
+{
+	if(m_vData.size() - m_uSize < minSize)
+	{
+		size_t capacity = m_vData.size() < IO_BUFFER_MIN_CAPACITY ? IO_BUFFER_MIN_CAPACITY : m_vData.size() * 2;
+		while(capacity - m_uSize < minSize)
+		{
+			capacity *= 2;
+		}
+		Grow(capacity);
+	}
+
+	if(m_uSize == 0)
+	{
+		// Empty, start at the front for the most contiguous space
+		m_uHead = 0;
+	}
+
+	size_t tail = m_uHead + m_uSize;
+	if(tail < m_vData.size())
+	{
+		*size = m_vData.size() - tail;
+		return &m_vData[tail];
+	}
+
+	tail -= m_vData.size();
+	*size = m_uHead - tail;
+	return &m_vData[tail];
+}
+
+void IOBuffer::CommitWrite(size_t size)
+{
+	m_uSize += size;
+}
+
+void IOBuffer::Write(const char *data, size_t size)
+{
+	while(size > 0)
+	{
+		size_t space = 0;
+		char *out = GetWriteSpace(size, &space);
+		size_t count = space < size ? space : size;
+
+		memcpy(out, data, count);
+		CommitWrite(count);
+		data += count;
+		size -= count;
+	}
+}
+
+void IOBuffer::Peek(size_t offset, char *out, size_t size) const
+{
+	size_t start = m_uHead + offset;
+	if(start >= m_vData.size())
+	{
+		start -= m_vData.size();
+	}
+
+	size_t first = m_vData.size() - start < size ? m_vData.size() - start : size;
+	memcpy(out, &m_vData[start], first);
+	if(size > first)
+	{
+		memcpy(out + first, &m_vData[0], size - first);
+	}
+}
+
+const char *IOBuffer::GetData(size_t size)
+{
+	if(m_uHead + size <= m_vData.size())
+	{
+		return &m_vData[m_uHead];
+	}
+
+	// Rare, only a packet across the end of the ring is copied
+	if(m_vScratch.size() < size)
+	{
+		m_vScratch.resize(size);
+	}
+	Peek(0, &m_vScratch[0], size);
+	return &m_vScratch[0];
+}
+
+int IOBuffer::GetReadSegments(const char **data, size_t *sizes) const
+{
+	if(m_uSize == 0)
+	{
+		return 0;
+	}
+
+	data[0] = &m_vData[m_uHead];
+	if(m_uHead + m_uSize <= m_vData.size())
+	{
+		sizes[0] = m_uSize;
+		return 1;
+	}
+
+	sizes[0] = m_vData.size() - m_uHead;
+	data[1] = &m_vData[0];
+	sizes[1] = m_uSize - sizes[0];
+	return 2;
+}
+
+void IOBuffer::Consume(size_t size)
+{
+	m_uHead += size;
+	if(m_uHead >= m_vData.size())
+	{
+		m_uHead -= m_vData.size();
+	}
+	m_uSize -= size;
+}
+
+void IOBuffer::Clear()
+{
+	m_uHead = 0;
+	m_uSize = 0;
+}
+
+void IOBuffer::Grow(size_t capacity)
+{
+	std::vector<char> data(capacity);
+	if(m_uSize > 0)
+	{
+		Peek(0, &data[0], m_uSize);
+	}
+
+	m_vData.swap(data);
+	m_uHead = 0;
+}
+
+} // namespace base
@@ -1,4 +1,67 @@
 // Copyright (c) 2016 David Morton
 // Use of this source code is governed by a license that can be
 // found in the LICENSE file.
-// https://github.com/damorton/libraig.git
\ No newline at end of file
+// https://github.com/damorton/libraig.git
+
+#ifndef BASE_IO_BUFFER_H_
+#define BASE_IO_BUFFER_H_
+
+#include <stddef.h> // size_t
+
+#include <vector> // vector<>()
+
+namespace base{
+
+#define IO_BUFFER_MIN_CAPACITY (64 * 1024)
+
+// Growable ring buffer of bytes received from a socket. The socket writes
+// straight into the free space at the back and the reader takes bytes
+// from the front, so many packets can be read with one recv call and
+// nothing is moved while the buffer wraps.
+class IOBuffer{
+public:
+	IOBuffer();
+
+	// Contiguous free space at the back, at least minSize bytes of space are
+	// made free first. Write into it and call CommitWrite().
+	char *GetWriteSpace(size_t minSize, size_t *size);
+
+	void CommitWrite(size_t size);
+
+	// Copies size bytes to the back
+	void Write(const char *data, size_t size);
+
+	// Number of bytes that can be read
+	size_t GetSize() const { return m_uSize; }
+
+	// Copies size bytes starting offset bytes from the front into out
+	void Peek(size_t offset, char *out, size_t size) const;
+
+	// Pointer to the first size bytes, contiguous even if they wrap around
+	// the end of the ring. Valid until the buffer is changed.
+	const char *GetData(size_t size);
+
+	// Up to two contiguous runs holding the readable bytes in order, for a
+	// vectored write. Returns the number of runs.
+	int GetReadSegments(const char **data, size_t *sizes) const;
+
+	// Removes size bytes from the front
+	void Consume(size_t size);
+
+	void Clear();
+
+private:
+	// Moves the bytes to the front of a buffer of at least capacity bytes
+	void Grow(size_t capacity);
+
+	std::vector<char> m_vData;
+	size_t m_uHead;
+	size_t m_uSize;
+
+	// Copy of bytes that wrap, returned by GetData()
+	std::vector<char> m_vScratch;
+};
+
+} // namespace base
+
+#endif
@@ -0,0 +1,490 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "base/log.h"
+
+#include <chrono> // steady_clock
+#include <condition_variable> // condition_variable
+#include <cstdio> // snprintf()
+#include <cstring> // memcpy()
+#include <memory> // unique_ptr<>()
+#include <mutex> // mutex
+#include <thread> // thread
+
+namespace base{
+
+std::atomic<int> Log::s_iLevel(LOG_LEVEL_INFO);
+
+/*
+ * LogSite
+ */
+bool LogSite::Allow(uint64_t timeMs)
+{
+	uint64_t window = timeMs / LOG_RATE_WINDOW_MS;
+	if(m_uWindow.load(std::memory_order_relaxed) != window)
+	{
+		m_uWindow.store(window, std::memory_order_relaxed);
+		m_uCount.store(0, std::memory_order_relaxed);
+	}
+
+	if(m_uCount.fetch_add(1, std::memory_order_relaxed) < LOG_RATE_LIMIT)
+	{
+		return true;
+	}
+
+	m_uSuppressed.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+/*
+ * LogRecord
+ */
+void LogRecord::Put(Type type, long long value)
+{
+	if(m_uSize + 1 + sizeof(value) > LOG_RECORD_SIZE)
+	{
+		return;
+	}
+	m_Data[m_uSize++] = (char)type;
+	memcpy(&m_Data[m_uSize], &value, sizeof(value));
+	m_uSize += sizeof(value);
+}
+
+void LogRecord::Add(double value)
+{
+	long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+	Put(TYPE_DOUBLE, bits);
+}
+
+void LogRecord::Add(const void *value)
+{
+	Put(TYPE_POINTER, (long long)(uintptr_t)value);
+}
+
+void LogRecord::Add(const char *value)
+{
+	if(value == NULL)
+	{
+		value = "(null)";
+	}
+	if(m_uSize + 2 > LOG_RECORD_SIZE)
+	{
+		return;
+	}
+
+	size_t size = strlen(value);
+	size_t space = LOG_RECORD_SIZE - m_uSize - 2;
+	if(size > space) size = space;
+	if(size > 255) size = 255;
+
+	m_Data[m_uSize++] = (char)TYPE_STRING;
+	m_Data[m_uSize++] = (char)(unsigned char)size;
+	memcpy(&m_Data[m_uSize], value, size);
+	m_uSize += size;
+}
+
+bool LogRecord::Read(size_t *position, Type *type, long long *integer, double *real, const char **string, int *stringSize) const
+{
+	if(*position >= m_uSize)
+	{
+		return false;
+	}
+
+	*type = (Type)m_Data[(*position)++];
+	if(*type == TYPE_STRING)
+	{
+		*stringSize = (unsigned char)m_Data[(*position)++];
+		*string = &m_Data[*position];
+		*position += *stringSize;
+		return true;
+	}
+
+	memcpy(integer, &m_Data[*position], sizeof(*integer));
+	*position += sizeof(*integer);
+	if(*type == TYPE_DOUBLE)
+	{
+		memcpy(real, integer, sizeof(*real));
+	}
+	return true;
+}
+
+void LogRecord::Format(const char *format, char *message, size_t size) const
+{
+	size_t length = 0;
+	size_t position = 0;
+	const char *p = format;
+	while(*p != '\0' && length + 1 < size)
+	{
+		if(*p != '%')
+		{
+			message[length++] = *p++;
+			continue;
+		}
+		if(p[1] == '%')
+		{
+			message[length++] = '%';
+			p += 2;
+			continue;
+		}
+
+		// Flags, width and precision are kept, the length modifier comes
+		// from the type the argument was recorded with
+		char spec[32];
+		size_t specSize = 0;
+		spec[specSize++] = *p++;
+		while(*p != '\0' && strchr("-+ #0123456789.", *p) != NULL)
+		{
+			if(specSize < 16) spec[specSize++] = *p;
+			p++;
+		}
+		while(*p != '\0' && strchr("hlLqjzt", *p) != NULL)
+		{
+			p++;
+		}
+		char conversion = *p;
+		if(conversion == '\0')
+		{
+			break;
+		}
+		p++;
+
+		bool isInteger = strchr("diouxXc", conversion) != NULL;
+		bool isReal = strchr("fFeEgGaA", conversion) != NULL;
+
+		Type type;
+		long long integer = 0;
+		double real = 0;
+		const char *string = NULL;
+		int stringSize = 0;
+		int written;
+		if(!Read(&position, &type, &integer, &real, &string, &stringSize))
+		{
+			written = snprintf(&message[length], size - length, "?");
+		}
+		else if(type == TYPE_STRING)
+		{
+			// Recorded without the terminator
+			char text[256];
+			memcpy(text, string, stringSize);
+			text[stringSize] = '\0';
+			spec[specSize++] = 's';
+			spec[specSize] = '\0';
+			written = snprintf(&message[length], size - length, spec, text);
+		}
+		else if(type == TYPE_DOUBLE)
+		{
+			spec[specSize++] = isReal ? conversion : 'g';
+			spec[specSize] = '\0';
+			written = snprintf(&message[length], size - length, spec, real);
+		}
+		else if(type == TYPE_POINTER)
+		{
+			written = snprintf(&message[length], size - length, "%p", (void*)(uintptr_t)integer);
+		}
+		else
+		{
+			if(type == TYPE_LONG) spec[specSize++] = 'l';
+			if(type == TYPE_LONG_LONG) { spec[specSize++] = 'l'; spec[specSize++] = 'l'; }
+			// A char argument is recorded as an int, %lc would want a wint_t
+			spec[specSize++] = isInteger && (conversion != 'c' || type == TYPE_INT) ? conversion : 'd';
+			spec[specSize] = '\0';
+			if(type == TYPE_INT)
+			{
+				written = snprintf(&message[length], size - length, spec, (int)integer);
+			}
+			else if(type == TYPE_LONG)
+			{
+				written = snprintf(&message[length], size - length, spec, (long)integer);
+			}
+			else
+			{
+				written = snprintf(&message[length], size - length, spec, integer);
+			}
+		}
+
+		if(written < 0)
+		{
+			break;
+		}
+		length += (size_t)written < size - length ? (size_t)written : size - length - 1;
+	}
+
+	message[length] = '\0';
+}
+
+/*
+ * Log queue and thread
+ */
+
+// Bounded multi-producer queue of records. The sequence of each record
+// tells the producers and the log thread whose turn it is: a producer
+// claims the record at position p when it holds p and hands it over by
+// storing p + 1, the log thread frees it for the next lap with
+// p + LOG_QUEUE_RECORDS.
+class LogQueue{
+public:
+	LogQueue();
+
+	// Formats what is left and stops the log thread
+	~LogQueue();
+
+	LogRecord *Begin();
+
+	void End(LogRecord *record);
+
+	void SetCallback(LogCallback callback, void *userData);
+
+	uint64_t GetDropped() const { return m_uDropped.load(std::memory_order_relaxed); }
+
+private:
+	void RunThread();
+
+	// Formats and writes the queued records, returns how many
+	int Drain();
+
+	// Whether the next record is not written yet, log thread only
+	bool IsEmpty() const;
+
+	void Output(int level, uint64_t timeUs, const char *file, int line, const char *message);
+
+	std::unique_ptr<LogRecord[]> m_Records;
+	std::atomic<size_t> m_uEnqueue;
+	char m_Padding[64];
+	size_t m_uDequeue; // Log thread only
+
+	std::atomic<uint64_t> m_uDropped;
+	uint64_t m_uReportedDropped;
+
+	std::chrono::steady_clock::time_point m_StartTime;
+
+	std::mutex m_CallbackMutex;
+	LogCallback m_Callback;
+	void *m_pCallbackUserData;
+
+	std::atomic<bool> m_bIsStopping;
+	std::thread m_Thread;
+
+	// Set by the log thread before it sleeps on the condition, the first
+	// End() that finds it set clears it and wakes the thread
+	std::atomic<bool> m_bIsWaiting;
+	std::mutex m_WaitMutex;
+	std::condition_variable m_Condition;
+};
+
+// Created with the first message, so a client that never logs never
+// starts the thread
+static LogQueue &GetQueue()
+{
+	static LogQueue queue;
+	return queue;
+}
+
+LogQueue::LogQueue()
+	: m_Records(new LogRecord[LOG_QUEUE_RECORDS])
+{
+	for(size_t i = 0; i < LOG_QUEUE_RECORDS; i++)
+	{
+		m_Records[i].m_uSequence.store(i, std::memory_order_relaxed);
+	}
+	m_uEnqueue = 0;
+	m_uDequeue = 0;
+	m_uDropped = 0;
+	m_uReportedDropped = 0;
+	m_StartTime = std::chrono::steady_clock::now();
+	m_Callback = NULL;
+	m_pCallbackUserData = NULL;
+	m_bIsStopping = false;
+	m_bIsWaiting = false;
+	m_Thread = std::thread(&LogQueue::RunThread, this);
+}
+
+LogQueue::~LogQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_WaitMutex);
+		m_bIsStopping.store(true, std::memory_order_release);
+	}
+	m_Condition.notify_one();
+	m_Thread.join();
+}
+
+LogRecord *LogQueue::Begin()
+{
+	size_t position = m_uEnqueue.load(std::memory_order_relaxed);
+	for(;;)
+	{
+		LogRecord *record = &m_Records[position % LOG_QUEUE_RECORDS];
+		size_t sequence = record->m_uSequence.load(std::memory_order_acquire);
+		if(sequence == position)
+		{
+			if(m_uEnqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				record->Clear();
+				record->m_uTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_StartTime).count();
+				return record;
+			}
+		}
+		else if(sequence < position)
+		{
+			// The log thread has not freed the record from the last lap
+			m_uDropped.fetch_add(1, std::memory_order_relaxed);
+			return NULL;
+		}
+		else
+		{
+			position = m_uEnqueue.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void LogQueue::End(LogRecord *record)
+{
+	// Only the producer that claimed the record writes it until the log
+	// thread frees it
+	size_t position = record->m_uSequence.load(std::memory_order_relaxed);
+	record->m_uSequence.store(position + 1, std::memory_order_seq_cst);
+
+	// Only a record written to an empty queue wakes the log thread, it
+	// drains the rest before it waits again
+	if(m_bIsWaiting.load(std::memory_order_seq_cst) && m_bIsWaiting.exchange(false))
+	{
+		std::lock_guard<std::mutex> lock(m_WaitMutex);
+		m_Condition.notify_one();
+	}
+}
+
+void LogQueue::SetCallback(LogCallback callback, void *userData)
+{
+	std::lock_guard<std::mutex> lock(m_CallbackMutex);
+	m_Callback = callback;
+	m_pCallbackUserData = userData;
+}
+
+void LogQueue::RunThread()
+{
+	for(;;)
+	{
+		bool isStopping = m_bIsStopping.load(std::memory_order_acquire);
+		if(Drain() > 0)
+		{
+			continue;
+		}
+		if(isStopping)
+		{
+			break;
+		}
+
+		// Checked again once the flag is set, a record written before it
+		// would not wake the thread
+		std::unique_lock<std::mutex> lock(m_WaitMutex);
+		m_bIsWaiting.store(true, std::memory_order_seq_cst);
+		if(IsEmpty())
+		{
+			m_Condition.wait(lock, [this]{ return !m_bIsWaiting.load(std::memory_order_relaxed) || m_bIsStopping.load(std::memory_order_relaxed); });
+		}
+		m_bIsWaiting.store(false, std::memory_order_relaxed);
+	}
+}
+
+bool LogQueue::IsEmpty() const
+{
+	const LogRecord &record = m_Records[m_uDequeue % LOG_QUEUE_RECORDS];
+	return record.m_uSequence.load(std::memory_order_seq_cst) != m_uDequeue + 1;
+}
+
+int LogQueue::Drain()
+{
+	std::lock_guard<std::mutex> lock(m_CallbackMutex);
+
+	int count = 0;
+	char message[512];
+	for(;;)
+	{
+		LogRecord &record = m_Records[m_uDequeue % LOG_QUEUE_RECORDS];
+		if(record.m_uSequence.load(std::memory_order_acquire) != m_uDequeue + 1)
+		{
+			break;
+		}
+
+		record.Format(record.m_pFormat, message, sizeof(message));
+		if(record.m_uSuppressed > 0)
+		{
+			size_t length = strlen(message);
+			snprintf(&message[length], sizeof(message) - length, " (%llu similar messages suppressed)", (unsigned long long)record.m_uSuppressed);
+		}
+
+		Output(record.m_iLevel, record.m_uTimeUs, record.m_pSite->GetFile(), record.m_pSite->GetLine(), message);
+
+		record.m_uSequence.store(m_uDequeue + LOG_QUEUE_RECORDS, std::memory_order_release);
+		m_uDequeue++;
+		count++;
+	}
+
+	uint64_t dropped = m_uDropped.load(std::memory_order_relaxed);
+	if(dropped != m_uReportedDropped)
+	{
+		snprintf(message, sizeof(message), "%llu log messages dropped, the log queue was full", (unsigned long long)(dropped - m_uReportedDropped));
+		Output(LOG_LEVEL_WARNING, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_StartTime).count(), __FILE__, __LINE__, message);
+		m_uReportedDropped = dropped;
+		count++;
+	}
+
+	if(count > 0 && m_Callback == NULL)
+	{
+		fflush(stdout);
+	}
+
+	return count;
+}
+
+void LogQueue::Output(int level, uint64_t timeUs, const char *file, int line, const char *message)
+{
+	if(m_Callback != NULL)
+	{
+		m_Callback(level, file, line, message, m_pCallbackUserData);
+		return;
+	}
+
+	// Base name of the source file
+	const char *name = file;
+	for(const char *p = file; *p != '\0'; p++)
+	{
+		if(*p == '/' || *p == '\\') name = p + 1;
+	}
+
+	static const char levels[] = { 'D', 'I', 'W', 'E' };
+	printf("raig %c %.6f %s:%d %s\n", level >= 0 && level < 4 ? levels[level] : '?', timeUs / 1e6, name, line, message);
+}
+
+/*
+ * Log
+ */
+void Log::SetCallback(LogCallback callback, void *userData)
+{
+	GetQueue().SetCallback(callback, userData);
+}
+
+uint64_t Log::GetDropped()
+{
+	return GetQueue().GetDropped();
+}
+
+uint64_t Log::GetTimeMs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LogRecord *Log::Begin()
+{
+	return GetQueue().Begin();
+}
+
+void Log::End(LogRecord *record)
+{
+	GetQueue().End(record);
+}
+
+} // namespace base
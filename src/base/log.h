@@ -0,0 +1,231 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef BASE_LOG_H_
+#define BASE_LOG_H_
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+
+#include <atomic> // atomic<>()
+
+namespace base{
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE 4
+
+// Messages below this level are compiled out, build with
+// -DRAIG_LOG_LEVEL=LOG_LEVEL_NONE to remove every message
+#ifndef RAIG_LOG_LEVEL
+#define RAIG_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RECORD_SIZE 240 // Bytes of arguments in a message, longer strings are cut
+#define LOG_QUEUE_RECORDS 1024 // Messages waiting for the log thread, more are dropped
+#define LOG_RATE_WINDOW_MS 1000
+#define LOG_RATE_LIMIT 10 // Messages from one call site in a window, the rest are counted
+
+// Called on the log thread with each formatted message
+typedef void (*LogCallback)(int level, const char *file, int line, const char *message, void *userData);
+
+// Call site of a message, a static in each RAIG_LOG() expansion. Limits
+// the site to LOG_RATE_LIMIT messages per window so a message repeated
+// every frame costs a few atomics, the count of the messages it held back
+// goes out with its next message.
+class LogSite{
+public:
+	constexpr LogSite(const char *file, int line)
+		: m_pFile(file), m_iLine(line), m_uWindow(0), m_uCount(0), m_uSuppressed(0)
+	{
+	}
+
+	// Any thread. False if the message is over the limit and not logged.
+	bool Allow(uint64_t timeMs);
+
+	// Messages held back since the last one that was logged
+	uint64_t TakeSuppressed(){ return m_uSuppressed.exchange(0, std::memory_order_relaxed); }
+
+	const char *GetFile() const { return m_pFile; }
+
+	int GetLine() const { return m_iLine; }
+
+private:
+	const char *m_pFile;
+	int m_iLine;
+
+	// Window number and messages in it, updated without a lock so a window
+	// may let a message or two more through when threads race
+	std::atomic<uint64_t> m_uWindow;
+	std::atomic<uint64_t> m_uCount;
+	std::atomic<uint64_t> m_uSuppressed;
+};
+
+// Arguments of a message, each a type tag and its value. Strings are
+// copied, the format is not, it must be a literal.
+class LogRecord{
+public:
+	enum Type{
+		TYPE_INT,
+		TYPE_LONG,
+		TYPE_LONG_LONG,
+		TYPE_DOUBLE,
+		TYPE_STRING, // Length byte and the characters
+		TYPE_POINTER
+	};
+
+	void Clear(){ m_uSize = 0; }
+
+	void Add(int value){ Put(TYPE_INT, (long long)value); }
+	void Add(unsigned int value){ Put(TYPE_LONG_LONG, (long long)value); }
+	void Add(long value){ Put(TYPE_LONG, (long long)value); }
+	void Add(unsigned long value){ Put(TYPE_LONG_LONG, (long long)value); }
+	void Add(long long value){ Put(TYPE_LONG_LONG, value); }
+	void Add(unsigned long long value){ Put(TYPE_LONG_LONG, (long long)value); }
+	void Add(double value);
+	void Add(const char *value);
+	void Add(char *value){ Add((const char*)value); }
+	void Add(const void *value);
+
+	// Formats format with the arguments into message, snprintf() style
+	void Format(const char *format, char *message, size_t size) const;
+
+	const char *m_pFormat;
+	const LogSite *m_pSite;
+	int m_iLevel;
+	uint64_t m_uTimeUs;
+	uint64_t m_uSuppressed;
+
+private:
+	// Skipped once the record is full, Format() prints ? for the missing
+	// arguments
+	void Put(Type type, long long value);
+
+	// Next argument at position, returns false past the last one
+	bool Read(size_t *position, Type *type, long long *integer, double *real, const char **string, int *stringSize) const;
+
+	// Queue position the record holds, see LogQueue
+	friend class LogQueue;
+	std::atomic<size_t> m_uSequence;
+
+	size_t m_uSize;
+	char m_Data[LOG_RECORD_SIZE];
+};
+
+// Process-wide logger. RAIG_LOG_*() copy the raw arguments into a bounded
+// lock-free queue, a background thread formats and writes them, so the
+// caller never formats, locks or waits on stdout. Messages are dropped and
+// counted when the queue is full. Messages below RAIG_LOG_LEVEL are not
+// compiled, the arguments of disabled levels are never evaluated.
+class Log{
+public:
+	// Messages below level are skipped at run time, LOG_LEVEL_INFO by default
+	static void SetLevel(int level){ s_iLevel.store(level, std::memory_order_relaxed); }
+
+	static int GetLevel(){ return s_iLevel.load(std::memory_order_relaxed); }
+
+	static bool IsEnabled(int level){ return level >= s_iLevel.load(std::memory_order_relaxed); }
+
+	// Messages go to callback instead of stdout, NULL restores stdout
+	static void SetCallback(LogCallback callback, void *userData);
+
+	template<typename... Args>
+	static void Write(LogSite *site, int level, const char *format, const Args&... args)
+	{
+		LogRecord *record = Begin();
+		if(record == NULL)
+		{
+			return;
+		}
+		record->m_pFormat = format;
+		record->m_pSite = site;
+		record->m_iLevel = level;
+		record->m_uSuppressed = site->TakeSuppressed();
+		AddArgs(record, args...);
+		End(record);
+	}
+
+	// Never called, lets the compiler check the format of RAIG_LOG_*()
+#if defined(__GNUC__)
+	__attribute__((format(printf, 1, 2)))
+#endif
+	static void CheckFormat(const char *format, ...){ (void)format; }
+
+	// Messages the queue had no room for
+	static uint64_t GetDropped();
+
+	// Steady clock, for the rate limit of LogSite
+	static uint64_t GetTimeMs();
+
+private:
+	static void AddArgs(LogRecord*){}
+
+	template<typename T, typename... Args>
+	static void AddArgs(LogRecord *record, const T &value, const Args&... args)
+	{
+		record->Add(value);
+		AddArgs(record, args...);
+	}
+
+	// Claims a record in the queue, NULL if it is full
+	static LogRecord *Begin();
+
+	// Passes the record to the log thread
+	static void End(LogRecord *record);
+
+	static std::atomic<int> s_iLevel;
+};
+
+} // namespace base
+
+#define RAIG_LOG(level, ...) \
+	do{ \
+		static base::LogSite logSite(__FILE__, __LINE__); \
+		if(base::Log::IsEnabled(level) && logSite.Allow(base::Log::GetTimeMs())) \
+		{ \
+			base::Log::Write(&logSite, level, __VA_ARGS__); \
+		} \
+		if(false) \
+		{ \
+			base::Log::CheckFormat(__VA_ARGS__); \
+		} \
+	}while(0)
+
+// Checks the format of a compiled out message without evaluating it
+#define RAIG_LOG_DISABLED(...) \
+	do{ \
+		if(false) \
+		{ \
+			base::Log::CheckFormat(__VA_ARGS__); \
+		} \
+	}while(0)
+
+#if RAIG_LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define RAIG_LOG_DEBUG(...) RAIG_LOG(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define RAIG_LOG_DEBUG(...) RAIG_LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if RAIG_LOG_LEVEL <= LOG_LEVEL_INFO
+#define RAIG_LOG_INFO(...) RAIG_LOG(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define RAIG_LOG_INFO(...) RAIG_LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if RAIG_LOG_LEVEL <= LOG_LEVEL_WARNING
+#define RAIG_LOG_WARNING(...) RAIG_LOG(LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define RAIG_LOG_WARNING(...) RAIG_LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if RAIG_LOG_LEVEL <= LOG_LEVEL_ERROR
+#define RAIG_LOG_ERROR(...) RAIG_LOG(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define RAIG_LOG_ERROR(...) RAIG_LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#endif
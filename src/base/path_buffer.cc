@@ -0,0 +1,82 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "base/path_buffer.h"
+
+#include <algorithm> // std::copy()
+
+#include "base/cell_kernels.h"
+
+namespace base{
+
+#define PATH_BUFFER_MIN_CAPACITY 64
+
+PathBuffer::PathBuffer()
+{
+	m_uHead = 0;
+}
+
+void PathBuffer::PushFront(const Vector3 &node)
+{
+	if(m_uHead == 0)
+	{
+		// Grow and move the nodes to the back of the larger buffer
+		size_t size = m_vNodes.size();
+		size_t capacity = size < PATH_BUFFER_MIN_CAPACITY ? PATH_BUFFER_MIN_CAPACITY : size * 2;
+
+		std::vector<Vector3> nodes(capacity);
+		std::copy(m_vNodes.begin(), m_vNodes.end(), nodes.begin() + (capacity - size));
+		m_vNodes.swap(nodes);
+		m_uHead = capacity - size;
+	}
+
+	m_vNodes[--m_uHead] = node;
+}
+
+void PathBuffer::Assign(const Vector3 *nodes, int size)
+{
+	if(m_vNodes.size() < (size_t)size)
+	{
+		m_vNodes.resize(size);
+	}
+
+	m_uHead = m_vNodes.size() - size;
+	std::copy(nodes, nodes + size, m_vNodes.begin() + m_uHead);
+}
+
+void PathBuffer::Append(const Vector3 *nodes, int size)
+{
+	m_vNodes.insert(m_vNodes.end(), nodes, nodes + size);
+}
+
+void PathBuffer::Replace(int first, int last, const Vector3 *nodes, int size)
+{
+	// Rebuild the path in a new buffer, repairs are rare
+	std::vector<Vector3> path;
+	path.reserve(GetSize() - (last - first + 1) + size);
+	path.insert(path.end(), m_vNodes.begin() + m_uHead, m_vNodes.begin() + m_uHead + first);
+	path.insert(path.end(), nodes, nodes + size);
+	path.insert(path.end(), m_vNodes.begin() + m_uHead + last + 1, m_vNodes.end());
+
+	m_vNodes.swap(path);
+	m_uHead = 0;
+}
+
+int PathBuffer::Find(int x, int z) const
+{
+	return CellKernels::FindCell(GetData(), GetSize(), x, z);
+}
+
+int PathBuffer::Copy(Vector3 *out, int capacity) const
+{
+	int count = GetSize() < capacity ? GetSize() : capacity;
+	if(count > 0)
+	{
+		std::copy(m_vNodes.begin() + m_uHead, m_vNodes.begin() + m_uHead + count, out);
+	}
+	return count;
+}
+
+} // namespace base
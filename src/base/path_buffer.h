@@ -0,0 +1,60 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef BASE_PATH_BUFFER_H_
+#define BASE_PATH_BUFFER_H_
+
+#include <stddef.h> // size_t
+
+#include <vector> // vector<>()
+
+#include "base/vector3.h"
+
+namespace base{
+
+// Contiguous storage for the nodes of a path. The server sends the goal
+// first so nodes are written from the back of the buffer towards the front
+// and the path is in order without reversing it. Capacity is kept when the
+// buffer is cleared so a reused buffer does not allocate.
+class PathBuffer{
+public:
+	PathBuffer();
+
+	void Clear(){ m_uHead = m_vNodes.size(); }
+
+	// Insert a node before the first node of the path
+	void PushFront(const Vector3 &node);
+
+	// Replace the path with a copy of size nodes
+	void Assign(const Vector3 *nodes, int size);
+
+	// Insert size nodes after the last node of the path
+	void Append(const Vector3 *nodes, int size);
+
+	// Replace the nodes from index first to last inclusive with size nodes
+	void Replace(int first, int last, const Vector3 *nodes, int size);
+
+	// Index of the first node at x, z or -1
+	int Find(int x, int z) const;
+
+	const Vector3 *GetData() const { return GetSize() > 0 ? &m_vNodes[m_uHead] : NULL; }
+
+	int GetSize() const { return (int)(m_vNodes.size() - m_uHead); }
+
+	bool IsEmpty() const { return m_uHead == m_vNodes.size(); }
+
+	// Copies up to capacity nodes into out, returns the number copied
+	int Copy(Vector3 *out, int capacity) const;
+
+private:
+	std::vector<Vector3> m_vNodes;
+
+	// Index of the first node, nodes occupy [m_uHead, m_vNodes.size())
+	size_t m_uHead;
+};
+
+} // namespace base
+
+#endif
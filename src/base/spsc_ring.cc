@@ -0,0 +1,113 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "base/spsc_ring.h"
+
+#include <cstring> // memcpy()
+
+namespace base{
+
+#define SPSC_RECORD_HEADER_SIZE 8 // tag u32, size u32
+
+SpscRing::SpscRing(size_t capacity)
+	: m_uWritten(0), m_uRead(0)
+{
+	size_t size = SPSC_RECORD_HEADER_SIZE;
+	while(size < capacity)
+	{
+		size <<= 1;
+	}
+
+	m_vRing.resize(size);
+	m_uMask = size - 1;
+}
+
+bool SpscRing::Push(uint32_t tag, const char *data, size_t size)
+{
+	size_t written = m_uWritten.load(std::memory_order_relaxed);
+	size_t read = m_uRead.load(std::memory_order_acquire);
+
+	if(m_vRing.size() - (written - read) < SPSC_RECORD_HEADER_SIZE + size)
+	{
+		return false;
+	}
+
+	uint32_t header[2] = { tag, (uint32_t)size };
+	Write(written, (const char*)header, SPSC_RECORD_HEADER_SIZE);
+	Write(written + SPSC_RECORD_HEADER_SIZE, data, size);
+
+	// Publish the record to the consumer
+	m_uWritten.store(written + SPSC_RECORD_HEADER_SIZE + size, std::memory_order_release);
+	return true;
+}
+
+bool SpscRing::Pop(uint32_t *tag, std::vector<char> *data)
+{
+	size_t read = m_uRead.load(std::memory_order_relaxed);
+	size_t written = m_uWritten.load(std::memory_order_acquire);
+
+	if(read == written)
+	{
+		return false;
+	}
+
+	uint32_t header[2];
+	Read(read, (char*)header, SPSC_RECORD_HEADER_SIZE);
+
+	*tag = header[0];
+	data->resize(header[1]);
+	if(header[1] > 0)
+	{
+		Read(read + SPSC_RECORD_HEADER_SIZE, &(*data)[0], header[1]);
+	}
+
+	// Hand the space back to the producer
+	m_uRead.store(read + SPSC_RECORD_HEADER_SIZE + header[1], std::memory_order_release);
+	return true;
+}
+
+bool SpscRing::IsEmpty() const
+{
+	return m_uRead.load(std::memory_order_acquire) == m_uWritten.load(std::memory_order_acquire);
+}
+
+size_t SpscRing::GetSize() const
+{
+	size_t read = m_uRead.load(std::memory_order_acquire);
+	return m_uWritten.load(std::memory_order_acquire) - read;
+}
+
+void SpscRing::Clear()
+{
+	// Only safe while neither thread is using the ring
+	m_uWritten.store(0);
+	m_uRead.store(0);
+}
+
+void SpscRing::Write(size_t position, const char *data, size_t size)
+{
+	if(size == 0)
+	{
+		return;
+	}
+
+	// A record may wrap around the end of the ring
+	size_t offset = position & m_uMask;
+	size_t first = m_vRing.size() - offset < size ? m_vRing.size() - offset : size;
+
+	memcpy(&m_vRing[offset], data, first);
+	memcpy(&m_vRing[0], data + first, size - first);
+}
+
+void SpscRing::Read(size_t position, char *data, size_t size) const
+{
+	size_t offset = position & m_uMask;
+	size_t first = m_vRing.size() - offset < size ? m_vRing.size() - offset : size;
+
+	memcpy(data, &m_vRing[offset], first);
+	memcpy(data + first, &m_vRing[0], size - first);
+}
+
+} // namespace base
@@ -0,0 +1,58 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef BASE_SPSC_RING_H_
+#define BASE_SPSC_RING_H_
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t
+
+#include <atomic> // atomic<>()
+#include <vector> // vector<>()
+
+namespace base{
+
+// Bounded lock-free queue of variable size records between one producer
+// thread and one consumer thread. A record is a tag and size bytes of data
+// copied into a ring of fixed capacity, neither side blocks or allocates
+// once the ring is created.
+class SpscRing{
+public:
+	// Capacity is rounded up to a power of two
+	explicit SpscRing(size_t capacity);
+
+	// Producer side. Returns false if there is no room for the record.
+	bool Push(uint32_t tag, const char *data, size_t size);
+
+	// Consumer side. Copies the oldest record into data, which keeps its
+	// capacity between calls. Returns false if the ring is empty.
+	bool Pop(uint32_t *tag, std::vector<char> *data);
+
+	// Either side, records may be added or removed concurrently
+	bool IsEmpty() const;
+
+	// Bytes used by the records in the ring, either side
+	size_t GetSize() const;
+
+	void Clear();
+
+private:
+	void Write(size_t position, const char *data, size_t size);
+
+	void Read(size_t position, char *data, size_t size) const;
+
+	std::vector<char> m_vRing;
+	size_t m_uMask;
+
+	// Total bytes written and read, the indices wrap through m_uMask. Padded
+	// apart so the two threads do not write to the same cache line.
+	std::atomic<size_t> m_uWritten;
+	char m_Padding[64];
+	std::atomic<size_t> m_uRead;
+};
+
+} // namespace base
+
+#endif
@@ -0,0 +1,38 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "base/stats.h"
+
+namespace base{
+
+Histogram::Histogram()
+	: m_uCount(0), m_uSum(0), m_uMax(0)
+{
+	for(int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+	{
+		m_uBuckets[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+void Histogram::Record(uint64_t value)
+{
+	int bucket = 0;
+	while(bucket < STATS_HISTOGRAM_BUCKETS - 1 && (value >> (bucket + 1)) != 0)
+	{
+		bucket++;
+	}
+
+	m_uBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	m_uCount.fetch_add(1, std::memory_order_relaxed);
+	m_uSum.fetch_add(value, std::memory_order_relaxed);
+
+	// Raise the maximum unless another record raised it past value first
+	uint64_t max = m_uMax.load(std::memory_order_relaxed);
+	while(value > max && !m_uMax.compare_exchange_weak(max, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+} // namespace base
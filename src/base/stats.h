@@ -0,0 +1,59 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef BASE_STATS_H_
+#define BASE_STATS_H_
+
+#include <stdint.h> // uint64_t
+
+#include <atomic> // atomic<>()
+
+namespace base{
+
+#define STATS_HISTOGRAM_BUCKETS 24 // Values from 0 to 2^24 - 1, larger values go in the last bucket
+
+// Counter written by one thread and read by any other. Relaxed atomics, a
+// reader sees every count eventually but not in order with other counters.
+class Counter{
+public:
+	Counter()
+		: m_uValue(0)
+	{
+	}
+
+	void Add(uint64_t value = 1){ m_uValue.fetch_add(value, std::memory_order_relaxed); }
+
+	uint64_t Get() const { return m_uValue.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint64_t> m_uValue;
+};
+
+// Lock-free histogram with power of two buckets, bucket i counts the values
+// from 2^i to 2^(i + 1) - 1 and bucket 0 also counts 0
+class Histogram{
+public:
+	Histogram();
+
+	void Record(uint64_t value);
+
+	uint64_t GetBucket(int index) const { return m_uBuckets[index].load(std::memory_order_relaxed); }
+
+	uint64_t GetCount() const { return m_uCount.load(std::memory_order_relaxed); }
+
+	uint64_t GetSum() const { return m_uSum.load(std::memory_order_relaxed); }
+
+	uint64_t GetMax() const { return m_uMax.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint64_t> m_uBuckets[STATS_HISTOGRAM_BUCKETS];
+	std::atomic<uint64_t> m_uCount;
+	std::atomic<uint64_t> m_uSum;
+	std::atomic<uint64_t> m_uMax;
+};
+
+} // namespace base
+
+#endif
@@ -0,0 +1,236 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "client/path_cache.h"
+
+namespace raig{
+
+PathCache::PathCache()
+{
+	m_iHead = -1;
+	m_iTail = -1;
+	m_iFree = -1;
+	m_uWorldVersion = 0;
+	m_uOpenVersion = 0;
+	m_Stats.m_iHits = 0;
+	m_Stats.m_iMisses = 0;
+	m_Stats.m_iEvictions = 0;
+	m_Stats.m_iInvalidations = 0;
+}
+
+void PathCache::SetCapacity(int capacity)
+{
+	m_vEntries.clear();
+	m_vEntries.resize(capacity < 0 ? 0 : capacity);
+	Clear();
+}
+
+void PathCache::Clear()
+{
+	m_Index.clear();
+	m_iHead = -1;
+	m_iTail = -1;
+	m_iFree = -1;
+
+	for(int i = (int)m_vEntries.size() - 1; i >= 0; i--)
+	{
+		m_vEntries[i].m_iNext = m_iFree;
+		m_iFree = i;
+	}
+}
+
+const base::PathBuffer *PathCache::Find(int startX, int startZ, int goalX, int goalZ)
+{
+	if(!IsEnabled())
+	{
+		return NULL;
+	}
+
+	Key key = { startX, startZ, goalX, goalZ };
+	std::unordered_map<Key, int, KeyHash>::iterator it = m_Index.find(key);
+	if(it == m_Index.end())
+	{
+		m_Stats.m_iMisses++;
+		return NULL;
+	}
+
+	int index = it->second;
+	Entry &entry = m_vEntries[index];
+	if(entry.m_uVersion < m_uOpenVersion)
+	{
+		// A cell was opened since the path was found
+		Remove(index);
+		m_Stats.m_iInvalidations++;
+		m_Stats.m_iMisses++;
+		return NULL;
+	}
+
+	Unlink(index);
+	PushFront(index);
+	m_Stats.m_iHits++;
+	return &entry.m_Path;
+}
+
+void PathCache::Insert(int startX, int startZ, int goalX, int goalZ, const base::Vector3 *nodes, int size, unsigned int worldVersion, const base::CellGrid &blockedCells)
+{
+	if(!IsEnabled() || size < 2 || worldVersion < m_uOpenVersion)
+	{
+		return;
+	}
+
+	if(worldVersion != m_uWorldVersion)
+	{
+		// Cells were blocked while the request was in flight
+		for(int i = 0; i < size; i++)
+		{
+			if(blockedCells.IsBlocked(nodes[i].m_iX, nodes[i].m_iZ))
+			{
+				return;
+			}
+		}
+	}
+
+	Key key = { startX, startZ, goalX, goalZ };
+	std::unordered_map<Key, int, KeyHash>::iterator it = m_Index.find(key);
+	if(it != m_Index.end())
+	{
+		Remove(it->second);
+	}
+
+	if(m_iFree == -1)
+	{
+		Remove(m_iTail);
+		m_Stats.m_iEvictions++;
+	}
+
+	int index = m_iFree;
+	m_iFree = m_vEntries[index].m_iNext;
+
+	Entry &entry = m_vEntries[index];
+	entry.m_Key = key;
+	entry.m_uVersion = m_uWorldVersion;
+	entry.m_Path.Assign(nodes, size);
+	entry.m_iMinX = entry.m_iMaxX = nodes[0].m_iX;
+	entry.m_iMinZ = entry.m_iMaxZ = nodes[0].m_iZ;
+	for(int i = 1; i < size; i++)
+	{
+		if(nodes[i].m_iX < entry.m_iMinX) entry.m_iMinX = nodes[i].m_iX;
+		if(nodes[i].m_iX > entry.m_iMaxX) entry.m_iMaxX = nodes[i].m_iX;
+		if(nodes[i].m_iZ < entry.m_iMinZ) entry.m_iMinZ = nodes[i].m_iZ;
+		if(nodes[i].m_iZ > entry.m_iMaxZ) entry.m_iMaxZ = nodes[i].m_iZ;
+	}
+
+	PushFront(index);
+	m_Index[key] = index;
+}
+
+void PathCache::OnCellBlocked(int x, int z)
+{
+	m_uWorldVersion++;
+
+	// Blocked cells only invalidate the paths crossing them
+	int index = m_iHead;
+	while(index != -1)
+	{
+		int next = m_vEntries[index].m_iNext;
+		if(Crosses(m_vEntries[index], x, z))
+		{
+			Remove(index);
+			m_Stats.m_iInvalidations++;
+		}
+		index = next;
+	}
+}
+
+void PathCache::OnCellsBlocked(const base::CellBatch &cells)
+{
+	m_uWorldVersion += cells.GetCount();
+
+	int index = m_iHead;
+	while(index != -1)
+	{
+		Entry &entry = m_vEntries[index];
+		int next = entry.m_iNext;
+		if(cells.IsCrossedBy(entry.m_Path.GetData(), entry.m_Path.GetSize(), entry.m_iMinX, entry.m_iMinZ, entry.m_iMaxX, entry.m_iMaxZ))
+		{
+			Remove(index);
+			m_Stats.m_iInvalidations++;
+		}
+		index = next;
+	}
+}
+
+void PathCache::OnCellOpened(int x, int z)
+{
+	// Any opened cell may give a shorter path, wherever it is
+	(void)x;
+	(void)z;
+
+	m_uWorldVersion++;
+	m_uOpenVersion = m_uWorldVersion;
+}
+
+bool PathCache::Crosses(const Entry &entry, int x, int z)
+{
+	if(x < entry.m_iMinX || x > entry.m_iMaxX || z < entry.m_iMinZ || z > entry.m_iMaxZ)
+	{
+		return false;
+	}
+
+	return entry.m_Path.Find(x, z) != -1;
+}
+
+void PathCache::Remove(int index)
+{
+	Entry &entry = m_vEntries[index];
+	m_Index.erase(entry.m_Key);
+	Unlink(index);
+
+	entry.m_iNext = m_iFree;
+	m_iFree = index;
+}
+
+void PathCache::Unlink(int index)
+{
+	Entry &entry = m_vEntries[index];
+
+	if(entry.m_iPrev != -1)
+	{
+		m_vEntries[entry.m_iPrev].m_iNext = entry.m_iNext;
+	}
+	else
+	{
+		m_iHead = entry.m_iNext;
+	}
+
+	if(entry.m_iNext != -1)
+	{
+		m_vEntries[entry.m_iNext].m_iPrev = entry.m_iPrev;
+	}
+	else
+	{
+		m_iTail = entry.m_iPrev;
+	}
+}
+
+void PathCache::PushFront(int index)
+{
+	Entry &entry = m_vEntries[index];
+	entry.m_iPrev = -1;
+	entry.m_iNext = m_iHead;
+
+	if(m_iHead != -1)
+	{
+		m_vEntries[m_iHead].m_iPrev = index;
+	}
+	m_iHead = index;
+
+	if(m_iTail == -1)
+	{
+		m_iTail = index;
+	}
+}
+
+} // namespace raig
@@ -0,0 +1,135 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef CLIENT_PATH_CACHE_H_
+#define CLIENT_PATH_CACHE_H_
+
+#include <stddef.h> // size_t
+
+#include <unordered_map> // unordered_map<>()
+#include <vector> // vector<>()
+
+#include "base/cell_batch.h"
+#include "base/cell_grid.h"
+#include "base/path_buffer.h"
+#include "raig/raig_client.h"
+
+namespace raig{
+
+// Bounded least recently used cache of completed paths keyed by start and
+// goal cell.
+//
+// Every cell change bumps the world version. A blocked cell removes the
+// cached paths that cross it straight away. An opened cell can make a
+// shorter path available anywhere, so it invalidates every path cached
+// before it; those entries are dropped when they are next looked up.
+class PathCache{
+public:
+	PathCache();
+
+	// Number of paths kept, 0 disables the cache. Clears the cache.
+	void SetCapacity(int capacity);
+
+	int GetCapacity() const { return (int)m_vEntries.size(); }
+
+	bool IsEnabled() const { return !m_vEntries.empty(); }
+
+	// Paths held
+	int GetCount() const { return (int)m_Index.size(); }
+
+	// Returns the cached path from start to goal or NULL
+	const base::PathBuffer *Find(int startX, int startZ, int goalX, int goalZ);
+
+	// Cache a path requested at worldVersion. The path is not cached if the
+	// world changed under it while the request was in flight, or if it has
+	// fewer than 2 nodes and so cannot be a path from start to goal.
+	void Insert(int startX, int startZ, int goalX, int goalZ, const base::Vector3 *nodes, int size, unsigned int worldVersion, const base::CellGrid &blockedCells);
+
+	void OnCellBlocked(int x, int z);
+
+	// Same as OnCellBlocked() for each cell of the batch, with one pass
+	// over the cached paths
+	void OnCellsBlocked(const base::CellBatch &cells);
+
+	void OnCellOpened(int x, int z);
+
+	unsigned int GetWorldVersion() const { return m_uWorldVersion; }
+
+	void Clear();
+
+	const RaigClient::PathCacheStats &GetStats() const { return m_Stats; }
+
+private:
+	struct Key{
+		int m_iStartX;
+		int m_iStartZ;
+		int m_iGoalX;
+		int m_iGoalZ;
+
+		bool operator==(const Key &other) const
+		{
+			return m_iStartX == other.m_iStartX && m_iStartZ == other.m_iStartZ && m_iGoalX == other.m_iGoalX && m_iGoalZ == other.m_iGoalZ;
+		}
+	};
+
+	struct KeyHash{
+		size_t operator()(const Key &key) const
+		{
+			size_t hash = (size_t)key.m_iStartX * 73856093u;
+			hash ^= (size_t)key.m_iStartZ * 19349663u;
+			hash ^= (size_t)key.m_iGoalX * 83492791u;
+			hash ^= (size_t)key.m_iGoalZ * 2654435761u;
+			return hash;
+		}
+	};
+
+	struct Entry{
+		Key m_Key;
+		unsigned int m_uVersion;
+
+		// Bounding box of the path, checked before the nodes
+		int m_iMinX;
+		int m_iMinZ;
+		int m_iMaxX;
+		int m_iMaxZ;
+
+		base::PathBuffer m_Path;
+
+		// Least recently used list
+		int m_iPrev;
+		int m_iNext;
+	};
+
+	// Returns true if the path crosses the cell
+	static bool Crosses(const Entry &entry, int x, int z);
+
+	void Remove(int index);
+
+	void Unlink(int index);
+
+	void PushFront(int index);
+
+	std::vector<Entry> m_vEntries;
+
+	std::unordered_map<Key, int, KeyHash> m_Index;
+
+	// Most and least recently used entries, -1 when empty
+	int m_iHead;
+	int m_iTail;
+
+	// Unused entries linked through m_iNext
+	int m_iFree;
+
+	unsigned int m_uWorldVersion;
+
+	// World version of the last opened cell
+	unsigned int m_uOpenVersion;
+
+	RaigClient::PathCacheStats m_Stats;
+};
+
+} // namespace raig
+
+#endif
@@ -0,0 +1,34 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef CLIENT_PATH_NODE_H_
+#define CLIENT_PATH_NODE_H_
+
+#include "base/node.h"
+#include "base/vector3.h"
+
+namespace raig{
+
+// Passed to base::Observer::onNotify() by RaigClient. The client reuses one
+// instance for every notification, observers copy what they keep.
+class PathNode : public Node{
+public:
+	PathNode()
+		: m_iRequestId(-1), m_bIsComplete(false)
+	{
+	}
+
+	int m_iRequestId;
+
+	// Node received from the server, NODE events only
+	base::Vector3 m_Location;
+
+	// FINISH events only, false if the request failed
+	bool m_bIsComplete;
+};
+
+} // namespace raig
+
+#endif
@@ -0,0 +1,139 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "client/path_tracker.h"
+
+#include <algorithm> // std::swap()
+
+namespace raig{
+
+PathTracker::TrackedPath *PathTracker::Track(int id, const base::Vector3 *nodes, int size)
+{
+	TrackedPath *path = Find(id);
+	if(path == NULL)
+	{
+		m_Index[id] = m_vPaths.size();
+		m_vPaths.push_back(TrackedPath());
+		path = &m_vPaths.back();
+	}
+
+	path->m_iId = id;
+	path->m_Path.Assign(nodes, size);
+	path->m_Smoothed.m_bIsValid = false;
+	path->m_bIsBlocked = false;
+	path->m_bIsChanged = false;
+	path->m_iRepairRequestId = -1;
+	path->m_iRepairFirst = 0;
+	path->m_iRepairLast = 0;
+	UpdateBounds(path);
+
+	return path;
+}
+
+void PathTracker::Untrack(int id)
+{
+	std::unordered_map<int, size_t>::iterator it = m_Index.find(id);
+	if(it == m_Index.end())
+	{
+		return;
+	}
+
+	// Move the last path into the hole
+	size_t index = it->second;
+	m_Index.erase(it);
+	if(index != m_vPaths.size() - 1)
+	{
+		std::swap(m_vPaths[index], m_vPaths.back());
+		m_Index[m_vPaths[index].m_iId] = index;
+	}
+	m_vPaths.pop_back();
+}
+
+PathTracker::TrackedPath *PathTracker::Find(int id)
+{
+	std::unordered_map<int, size_t>::iterator it = m_Index.find(id);
+	return it != m_Index.end() ? &m_vPaths[it->second] : NULL;
+}
+
+void PathTracker::OnCellBlocked(int x, int z)
+{
+	for(size_t i = 0; i < m_vPaths.size(); i++)
+	{
+		TrackedPath &path = m_vPaths[i];
+		if(path.m_bIsBlocked || x < path.m_iMinX || x > path.m_iMaxX || z < path.m_iMinZ || z > path.m_iMaxZ)
+		{
+			continue;
+		}
+
+		if(path.m_Path.Find(x, z) != -1)
+		{
+			path.m_bIsBlocked = true;
+		}
+	}
+}
+
+void PathTracker::OnCellsBlocked(const base::CellBatch &cells)
+{
+	for(size_t i = 0; i < m_vPaths.size(); i++)
+	{
+		TrackedPath &path = m_vPaths[i];
+		if(!path.m_bIsBlocked && cells.IsCrossedBy(path.m_Path.GetData(), path.m_Path.GetSize(),
+			path.m_iMinX, path.m_iMinZ, path.m_iMaxX, path.m_iMaxZ))
+		{
+			path.m_bIsBlocked = true;
+		}
+	}
+}
+
+void PathTracker::OnPathChanged(TrackedPath *path)
+{
+	UpdateBounds(path);
+	path->m_Smoothed.m_bIsValid = false;
+
+	if(!path->m_bIsChanged)
+	{
+		path->m_bIsChanged = true;
+		m_vChanged.push_back(path->m_iId);
+	}
+}
+
+int PathTracker::GetChangedPaths(int *ids, int capacity)
+{
+	int count = 0;
+	while(count < capacity && count < (int)m_vChanged.size())
+	{
+		ids[count] = m_vChanged[count];
+
+		TrackedPath *path = Find(ids[count]);
+		if(path != NULL)
+		{
+			path->m_bIsChanged = false;
+		}
+		count++;
+	}
+
+	m_vChanged.erase(m_vChanged.begin(), m_vChanged.begin() + count);
+	return count;
+}
+
+void PathTracker::UpdateBounds(TrackedPath *path)
+{
+	const base::Vector3 *nodes = path->m_Path.GetData();
+	int size = path->m_Path.GetSize();
+
+	// An empty path has an empty box
+	path->m_iMinX = path->m_iMinZ = 1;
+	path->m_iMaxX = path->m_iMaxZ = 0;
+
+	for(int i = 0; i < size; i++)
+	{
+		if(i == 0 || nodes[i].m_iX < path->m_iMinX) path->m_iMinX = nodes[i].m_iX;
+		if(i == 0 || nodes[i].m_iX > path->m_iMaxX) path->m_iMaxX = nodes[i].m_iX;
+		if(i == 0 || nodes[i].m_iZ < path->m_iMinZ) path->m_iMinZ = nodes[i].m_iZ;
+		if(i == 0 || nodes[i].m_iZ > path->m_iMaxZ) path->m_iMaxZ = nodes[i].m_iZ;
+	}
+}
+
+} // namespace raig
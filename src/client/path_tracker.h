@@ -0,0 +1,88 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef CLIENT_PATH_TRACKER_H_
+#define CLIENT_PATH_TRACKER_H_
+
+#include <stddef.h> // size_t
+
+#include <unordered_map> // unordered_map<>()
+#include <vector> // vector<>()
+
+#include "ai/path_smoother.h"
+#include "base/cell_batch.h"
+#include "base/path_buffer.h"
+
+namespace raig{
+
+// Paths the game is following. A tracked path keeps its own copy of the
+// nodes so it outlives the request slot it came from. Paths crossing a newly
+// blocked cell are flagged and repaired by RaigClientImpl.
+class PathTracker{
+public:
+	struct TrackedPath{
+		int m_iId;
+		base::PathBuffer m_Path;
+
+		// m_Path after the client's path smoothing
+		ai::SmoothedPath m_Smoothed;
+
+		// Bounding box of the path, checked before the nodes
+		int m_iMinX;
+		int m_iMinZ;
+		int m_iMaxX;
+		int m_iMaxZ;
+
+		// The path crosses a blocked cell and needs a repair
+		bool m_bIsBlocked;
+
+		// Reported by GetChangedPaths() since it changed
+		bool m_bIsChanged;
+
+		// Server request replacing the nodes from m_iRepairFirst to
+		// m_iRepairLast, -1 if no remote repair is in flight
+		int m_iRepairRequestId;
+		int m_iRepairFirst;
+		int m_iRepairLast;
+	};
+
+	// Start tracking a copy of the path, returns the tracked path
+	TrackedPath *Track(int id, const base::Vector3 *nodes, int size);
+
+	void Untrack(int id);
+
+	// Returns the tracked path or NULL
+	TrackedPath *Find(int id);
+
+	int GetCount() const { return (int)m_vPaths.size(); }
+
+	TrackedPath *Get(int index){ return &m_vPaths[index]; }
+
+	// Flags the paths crossing the cell
+	void OnCellBlocked(int x, int z);
+
+	// Flags the paths crossing any cell of the batch
+	void OnCellsBlocked(const base::CellBatch &cells);
+
+	// Call after the nodes of the path changed
+	void OnPathChanged(TrackedPath *path);
+
+	// Writes up to capacity ids of changed paths, returns the number written
+	int GetChangedPaths(int *ids, int capacity);
+
+private:
+	void UpdateBounds(TrackedPath *path);
+
+	std::vector<TrackedPath> m_vPaths;
+
+	// Index of each path in m_vPaths by id
+	std::unordered_map<int, size_t> m_Index;
+
+	std::vector<int> m_vChanged;
+};
+
+} // namespace raig
+
+#endif
@@ -5,18 +5,40 @@
 
 #include "raig/raig_client.h" // API
 
-#include <algorithm> // std::reverse()
-#include <cstring> // strlen(), strcat(), strtok(), strcpy()
+#include <algorithm> // std::find()
+#include <chrono> // steady_clock
+#include <cstdlib> // abs()
+#include <cstdio> // snprintf()
+#include <deque> // deque<>()
 #include <memory> // unique_ptr<>()
-#include <fstream>
-#include <iostream>
 
-#include "libsocket/include/socket.h" // libsocket
+#include "ai/grid_search.h"
+#include "ai/hierarchical_search.h"
+#include "ai/path_smoother.h"
+#include "base/cell_batch.h"
+#include "base/cell_grid.h"
+#include "base/event.h"
+#include "base/log.h"
+#include "base/observer.h"
+#include "base/path_buffer.h"
+#include "base/stats.h"
+#include "client/path_cache.h"
+#include "client/path_node.h"
+#include "client/path_tracker.h"
+#include "http/http_client.h"
 #include "net/net_manager.h"
+#include "net/packet.h"
+#include "net/poller.h"
 
 namespace raig {
 
-#define MAX_BUFFER_SIZE 13
+#define MAX_PENDING_REQUESTS 64 // Path requests that can be in flight at once
+#define MAX_REQUEST_ID 10000 // Request ids are sent as 4 digits
+#define PATH_REPAIR_SEARCH_LIMIT 4096 // Cells a local repair may expand
+#define PATH_REFINE_SEGMENTS 4 // Waypoint segments refined per request per update
+#define SERVER_HELLO_TIMEOUT_MS 500 // Servers that do not answer HELLO by then are resynced in ASCII
+
+static_assert(RAIG_STATS_BUCKETS == STATS_HISTOGRAM_BUCKETS, "RaigClient::StatsHistogram does not match base::Histogram");
 
 class RaigClient::RaigClientImpl
 {
@@ -26,69 +48,444 @@ public:
 
 	~RaigClientImpl();
 
+	void SetThreadedNetwork(bool isThreaded);
+
 	int InitConnection(std::shared_ptr<std::string> hostname, std::shared_ptr<std::string> service);
 
+	int AddServer(std::shared_ptr<std::string> hostname, std::shared_ptr<std::string> service);
+
+	void SetShardPolicy(ShardPolicy policy);
+
 	void CreateGameWorld(int width, int height, AiService serviceType);
 
+	void CreateGameWorld(int width, int height, AiService serviceType, const unsigned char *cells);
+
+	void CreateGameWorld(int width, int height, AiService serviceType, const uint32_t *bitmap);
+
 	void SetCellOpen(base::Vector3 cell);
 
 	void SetCellBlocked(base::Vector3 cell);
 
-	void ReSendBlockedList();
+	void SetCellsOpen(const base::Vector3 *cells, int count);
+
+	void SetCellsBlocked(const base::Vector3 *cells, int count);
+
+	void SetRegionOpen(int x, int z, int width, int height);
 
-	// Find a path using A* from source to destination
-	void FindPath(base::Vector3 *start, base::Vector3 *goal);
+	void SetRegionBlocked(int x, int z, int width, int height);
+
+	// Find a path using A* from source to destination. Returns the request id
+	// or -1 if the request could not be sent
+	int FindPath(base::Vector3 *start, base::Vector3 *goal);
+
+	int FindPath(base::Vector3 *start, base::Vector3 *goal, PathMode mode);
+
+	int FindPath(base::Vector3 *start, base::Vector3 *goal, PathCallback callback, void *userData);
+
+	int FindPaths(const std::pair<base::Vector3, base::Vector3> *paths, int count, int *requestIds);
+
+	void SetPathMode(PathMode mode, int localDistance);
+
+	void SetPathSmoothing(PathSmoothing smoothing);
+
+	void SetPathStreaming(bool isStreaming);
 
 	// Read the path data received by the server
 	std::vector<std::unique_ptr<base::Vector3> > &GetPath();
 
+	bool IsPathComplete(int requestId);
+
+	const base::Vector3 *GetPathData(int requestId, int *size);
+
+	int CopyPath(int requestId, base::Vector3 *out, int capacity);
+
+	void SetPathCacheCapacity(int capacity);
+
+	PathCacheStats GetPathCacheStats();
+
+	bool TrackPath(int requestId);
+
+	void UntrackPath(int requestId);
+
+	int GetChangedPaths(int *ids, int capacity);
+
+	void AddObserver(base::Observer *observer);
+
+	void RemoveObserver(base::Observer *observer);
+
+	void SetSendHighWaterMark(size_t bytes);
+
+	int Flush();
+
 	// Update the raig engine
 	void Update();
 
+	Stats GetStats();
+
+	void SetStatsDump(int intervalMs, StatsCallback callback, void *userData);
+
+	bool SetTelemetry(const std::string &url, int intervalMs, int batchEvents);
+
 private:
 	enum State{
 		CONNECTED,
 		CONNECTION_FAILED,
 	};
 
-	enum PacketCode{
-		GAMEWORLD,
-		PATH,
-		NODE,
-		END,
-		EMPTY,
-		CELL_BLOCKED,
-		CELL_OPEN
+	enum RequestState{
+		REQUEST_FREE,
+		REQUEST_PENDING,
+		REQUEST_REFINING,
+		REQUEST_COMPLETE,
+		REQUEST_FAILED
+	};
+
+	// A path request and the nodes received for it so far
+	struct PathRequest{
+		int m_iId;
+		RequestState m_eState;
+		int m_iRecvSequence;
+		base::PathBuffer m_Path;
+
+		// Used to cache the completed path
+		base::Vector3 m_Start;
+		base::Vector3 m_Goal;
+		unsigned int m_uWorldVersion;
+
+		// Id of the tracked path this request repairs or -1
+		int m_iRepairPathId;
+
+		// Waypoints of a hierarchical search and the next one to refine to
+		base::PathBuffer m_Waypoints;
+		int m_iNextWaypoint;
+
+		PathCallback m_Callback;
+		void *m_pUserData;
+
+		// Index of the server the request was sent to or -1
+		int m_iServer;
+
+		// For the round trip latency
+		std::chrono::steady_clock::time_point m_RequestTime;
+
+		// The server sends the nodes from the start to the goal, the path
+		// received so far can be read while the request is pending
+		bool m_bIsForward;
+
+		// m_Path after the path smoothing, once complete
+		ai::SmoothedPath m_Smoothed;
 	};
 
-	void ClearBuffer();
+	// A server of the pool. Every server holds a replica of the world and
+	// the blocked cells, path requests are spread across them.
+	struct Server{
+		std::unique_ptr<net::NetManager> m_NetManager;
+
+		// Writes outgoing packets in the framing negotiated with the server
+		net::PacketWriter m_PacketWriter;
+
+		// Ids of the pending requests in the order they were sent
+		std::deque<int> m_PendingRequests;
+
+		// Used for re-connection attempts
+		std::shared_ptr<std::string> m_strHostname;
+		std::shared_ptr<std::string> m_strService;
+
+		// A new connection is resynced once the server answers HELLO with
+		// the world version it holds, or once the answer times out. Path
+		// requests and cell updates go to synced servers only.
+		bool m_bIsSynced;
+		std::chrono::steady_clock::time_point m_HelloTime;
+	};
+
+	// Adds a server to the pool without connecting it
+	Server *CreateServer();
+
+	// Connect the server and watch its socket
+	int ConnectServer(int index);
+
+	// Connected and synced
+	bool IsServerReady(Server *server);
+
+	bool IsConnected();
+
+	// Picks the server for a path request by the shard policy. Returns -1 if
+	// no server is connected with room in its send queue.
+	int SelectServer(base::Vector3 *start);
+
+	// FindPath() without the counting of requests
+	int RequestPath(base::Vector3 *start, base::Vector3 *goal, PathMode mode);
+
+	// Returns the slot of the next request id that has a free slot, or NULL
+	// if every slot is waiting on the server
+	PathRequest *AllocateRequest(base::Vector3 *start, base::Vector3 *goal);
+
+	// A pending or refining request holds its slot until it finishes
+	static bool IsSlotInUse(const PathRequest *request)
+	{
+		return request->m_eState == REQUEST_PENDING || request->m_eState == REQUEST_REFINING;
+	}
+
+	bool IsLocalSearch(base::Vector3 *start, base::Vector3 *goal, PathMode mode);
+
+	int FindLocalPath(base::Vector3 *start, base::Vector3 *goal);
+
+	int FindHierarchicalPath(base::Vector3 *start, base::Vector3 *goal);
+
+	// Refine up to count waypoint segments of the request's path
+	void RefinePath(PathRequest *request, int count);
+
+	void RefinePaths();
+
+	ai::GridSearch::Algorithm GetSearchAlgorithm();
+
+	// Sends the path request to the server, or adds it to the batch
+	void SendPathRequest(PathRequest *request);
+
+	// Sends the batched path requests in one message
+	void SendPathBatch();
+
+	// Header flags of a path request. Smoothed paths keep only corners so
+	// the server need not send the nodes in between.
+	uint8_t GetPathFlags() const
+	{
+		return (m_ePathSmoothing != NO_SMOOTHING ? PACKET_FLAG_CORNERS : 0) | (m_bIsStreaming ? PACKET_FLAG_FORWARD : 0);
+	}
+
+	// Repair the tracked paths crossing cells blocked since the last update
+	void RepairTrackedPaths();
+
+	void RepairPath(PathTracker::TrackedPath *path);
+
+	// Splice the result of a remote repair into its tracked path
+	void CompleteRepair(PathRequest *request);
+
+	// Clear the tracked path of a remote repair the server found no path for
+	void FailRepair(PathRequest *request);
+
+	// Returns the request if it is complete
+	PathRequest *GetCompletedRequest(int requestId);
+
+	// The path or its copy after the path smoothing, the copy is rebuilt if
+	// the blocked cells changed since it was smoothed
+	const base::PathBuffer *GetSmoothedPath(const base::PathBuffer *path, ai::SmoothedPath *smoothed);
+
+	// Returns the request if its path can be read, complete or refining
+	PathRequest *GetReadableRequest(int requestId);
+
+	// Nodes read by GetPathData(), of the tracked path or the request. NULL
+	// if the path cannot be read.
+	const base::PathBuffer *GetReadablePath(int requestId);
+
+	PathRequest *GetRequest(int requestId);
+
+	// Finds the request a NODE or END packet belongs to. Untagged packets
+	// belong to the oldest request pending on the server, a server answers
+	// in order.
+	PathRequest *GetReplyRequest(Server *server, int requestId);
+
+	void CompleteRequest(PathRequest *request, RequestState state);
+
+	// Frees the slot of a request whose id was never returned to the game,
+	// it is not counted or reported
+	void ReleaseRequest(PathRequest *request);
+
+	void AbandonPendingRequests(Server *server);
+
+	// Call the callbacks and observers of the requests finished since the
+	// last dispatch
+	void DispatchFinishedRequests();
+
+	void Notify(base::Event::Type type);
+
+	// Notify the observers of a node added to the request's path
+	void NotifyNode(PathRequest *request, const base::Vector3 &node);
+
+	// Add a node received from the server to the request's path, at the
+	// back if the request is streamed and in front otherwise. The cells a
+	// corners only reply leaves out between the node and the path are added
+	// first.
+	void AddNode(PathRequest *request, const base::Vector3 &node);
+
+	void AddPathNode(PathRequest *request, const base::Vector3 &node);
+
+	// Read and process the packets from the servers with data, reconnect
+	// the connections that have failed
+	void ReceivePackets();
+
+	void ReceiveServerPackets(int index);
+
+	// Process the packets and connection changes queued by the network
+	// thread
+	void ReceiveQueuedPackets(Server *server);
+
+	// Offer the binary framing to a new connection and wait for the answer
+	// before resyncing
+	void BeginResync(Server *server);
+
+	// Bring a new connection up to date with the game. A binary server that
+	// holds heldVersion of the world is sent nothing, the cell updates that
+	// follow bring it up to date.
+	void ResyncConnection(Server *server, int heldVersion);
+
+	// Resync in ASCII the servers that have not answered HELLO
+	void CheckResyncTimeouts();
+
+	void SendGameWorld(Server *server);
+
+	void SendBlockedList(Server *server);
+
+	// The whole grid in one packet, binary framing only
+	void SendSnapshot(Server *server);
+
+	// Tell a binary server the world version it holds once the packets
+	// written before are applied
+	void WriteWorldVersion(Server *server);
+
+	// Keep the world size for resyncs and start a new world version
+	void SetGameWorld(int width, int height, AiService serviceType);
+
+	// Send the world and its blocked cells to the synced servers
+	void SendGameWorld();
+
+	void SetCellState(int x, int z, bool blocked);
+
+	// Update the searches, the cache and the tracked paths for a changed
+	// cell
+	void OnCellChanged(int x, int z, bool blocked);
+
+	// Cells blocked between the two calls are collected into
+	// m_BlockedBatch, so the cache and the tracked paths are checked once
+	// against all of them instead of once per cell. Without cached or
+	// tracked paths there is nothing to check and cells are not collected.
+	void BeginCellBatch();
+
+	void EndCellBatch();
+
+	// Send the cells changed since the last flush in one message
+	void FlushCellUpdates();
+
+	// Send the packets written to the server's writer with one call to
+	// SendData()
+	void FlushBatch(Server *server);
+
+	// Ask the server to switch to the binary framing
+	void OfferBinaryFraming(Server *server);
+
+	void ProcessPacket(Server *server, const char *packet, int size);
+
+	// Time complexity O(N) on the number of observers
+	std::vector<base::Observer*> m_vObservers;
+
+	// Reused for every notification so notifying does not allocate
+	PathNode m_PathNode;
+
+	// Ids of the requests finished since the last dispatch
+	std::vector<int> m_vFinishedRequests;
+
+	// Counters read by GetStats(), repairs are internal and not counted
+	base::Counter m_RequestCount;
+	base::Counter m_CompletedCount;
+	base::Counter m_FailedCount;
+	base::Counter m_DroppedCount;
+	base::Counter m_AbandonedCount;
+	base::Histogram m_RequestLatency;
+	base::Histogram m_PathNodes;
+	base::Histogram m_UpdateTime;
+
+	// Periodic dump of the stats from Update()
+	int m_iStatsDumpMs;
+	StatsCallback m_StatsCallback;
+	void *m_pStatsUserData;
+	std::chrono::steady_clock::time_point m_NextStatsDump;
+
+	void PrintStats(const Stats &stats);
+
+	// Posts an event for each finished server request, see SetTelemetry()
+	http::HttpDao m_Telemetry;
+
+	void RecordTelemetry(const PathRequest *request, RequestState state, int64_t latencyUs);
 
 	// Private members and functions
 	void CleanUp();
 
-	std::unique_ptr<net::NetManager> m_NetManager;
+	// Server 0 is the one given to InitConnection()
+	std::vector<std::unique_ptr<Server> > m_vServers;
 
-	// Connection socket descriptor
-	int m_iSocketFileDescriptor;
+	ShardPolicy m_eShardPolicy;
+	size_t m_uNextServer;
 
-	// Network buffer
-	char m_cSendBuffer[MAX_BUFFER_SIZE];
+	// Readiness of the server sockets, unthreaded mode only
+	net::Poller m_Poller;
+	std::vector<int> m_vReadyServers;
 
-	char m_cRecvBuffer[MAX_BUFFER_SIZE];
+	// Applied to every server added
+	bool m_bIsThreaded;
+	size_t m_uSendHighWaterMark;
 
-	// vector of locations
-	std::vector<std::unique_ptr<base::Vector3> > m_vPath;
-	std::vector<std::unique_ptr<base::Vector3> > m_vCompletedPath;
+	net::PacketReader m_PacketReader;
 
-	int m_iRecvSequence;
+	// Path requests indexed by request id modulo MAX_PENDING_REQUESTS. A slot
+	// keeps its completed path until the slot is reused by a new request.
+	PathRequest m_Requests[MAX_PENDING_REQUESTS];
 
-	bool m_bIsReqestComplete;
+	// Requests made by FindPaths() wait here to be sent in one message
+	bool m_bIsBatching;
+	std::vector<int> m_vBatch;
+	std::vector<int> m_vBatchFields;
 
-	std::vector<std::unique_ptr<base::Vector3> > m_vBlockedCells;
+	int m_iNextRequestId;
+
+	int m_iLastCompletedId;
+
+	PathCache m_PathCache;
+
+	// Local path search over m_BlockedCells
+	ai::GridSearch m_GridSearch;
+
+	ai::HierarchicalSearch m_HierarchicalSearch;
+
+	PathTracker m_PathTracker;
+
+	// Segment found by a local repair or refinement
+	base::PathBuffer m_Segment;
+
+	PathMode m_ePathMode;
+	int m_iLocalDistance;
+
+	PathSmoothing m_ePathSmoothing;
+
+	// Paths are requested from the start to the goal, see SetPathStreaming()
+	bool m_bIsStreaming;
+
+	// Copy of the last completed path returned by GetPath(), made again
+	// once another path completes. Tracked paths change in place and are
+	// always copied.
+	std::vector<std::unique_ptr<base::Vector3> > m_vLegacyPath;
+	bool m_bIsLegacyPathValid;
+
+	// Blocked cells mirrored from the game, re-sent after a reconnect
+	base::CellGrid m_BlockedCells;
+
+	// Cells changed since the last flush. A cell changed twice is back in the
+	// state the server knows about and is removed from the set, the list
+	// keeps the order and may hold cells that are no longer in the set.
+	base::CellGrid m_ChangedCells;
+	std::vector<std::pair<int, int> > m_vChangedCells;
+
+	// Cells blocked since BeginCellBatch()
+	base::CellBatch m_BlockedBatch;
+	bool m_bIsBatchingCells;
+
+	// Changes with every flush of cell updates. Starts from a random value
+	// for each world so a server can tell whether it holds this world.
+	int m_iWorldVersion;
+	std::vector<int> m_vSnapshotFields;
+
+	// Cells given to CreateGameWorld() one byte each, packed into a bitmap
+	std::vector<uint32_t> m_vWorldBits;
 
 	// Game data used for re-connection attempts;
-	std::shared_ptr<std::string> m_strHostname;
-	std::shared_ptr<std::string> m_strService;
 	int m_iGameWorldWidth;
 	int m_iGameWorldHeight;
 	AiService m_ServiceType;
@@ -102,6 +499,25 @@ raig_EXPORT RaigClient::RaigClient()
 {
 }
 
+raig_EXPORT RaigClient::~RaigClient()
+{
+}
+
+void raig_EXPORT RaigClient::SetThreadedNetwork(bool isThreaded)
+{
+	m_Impl->SetThreadedNetwork(isThreaded);
+}
+
+int raig_EXPORT RaigClient::AddServer(std::shared_ptr<std::string> hostname, std::shared_ptr<std::string> service)
+{
+	return m_Impl->AddServer(hostname, service);
+}
+
+void raig_EXPORT RaigClient::SetShardPolicy(ShardPolicy policy)
+{
+	m_Impl->SetShardPolicy(policy);
+}
+
 int raig_EXPORT RaigClient::InitConnection(std::shared_ptr<std::string> hostname, std::shared_ptr<std::string> service)
 {
 	return m_Impl->InitConnection(hostname, service);
@@ -112,6 +528,16 @@ void raig_EXPORT RaigClient::CreateGameWorld(int width, int height, AiService se
 	m_Impl->CreateGameWorld(width, height, serviceType);
 }
 
+void raig_EXPORT RaigClient::CreateGameWorld(int width, int height, AiService serviceType, const unsigned char *cells)
+{
+	m_Impl->CreateGameWorld(width, height, serviceType, cells);
+}
+
+void raig_EXPORT RaigClient::CreateGameWorld(int width, int height, AiService serviceType, const uint32_t *bitmap)
+{
+	m_Impl->CreateGameWorld(width, height, serviceType, bitmap);
+}
+
 void raig_EXPORT RaigClient::SetCellOpen(base::Vector3 cell)
 {
 	m_Impl->SetCellOpen(cell);
@@ -122,254 +548,2047 @@ void raig_EXPORT RaigClient::SetCellBlocked(base::Vector3 cell)
 	m_Impl->SetCellBlocked(cell);
 }
 
-void raig_EXPORT RaigClient::FindPath(base::Vector3 *start, base::Vector3 *goal)
+void raig_EXPORT RaigClient::SetCellsOpen(const base::Vector3 *cells, int count)
 {
-	m_Impl->FindPath(start, goal);
+	m_Impl->SetCellsOpen(cells, count);
 }
 
-std::vector<std::unique_ptr<base::Vector3> > raig_EXPORT &RaigClient::GetPath()
+void raig_EXPORT RaigClient::SetCellsBlocked(const base::Vector3 *cells, int count)
 {
-	return m_Impl->GetPath();
+	m_Impl->SetCellsBlocked(cells, count);
 }
 
-void raig_EXPORT RaigClient::Update()
+void raig_EXPORT RaigClient::SetRegionOpen(int x, int z, int width, int height)
 {
-	m_Impl->Update();
+	m_Impl->SetRegionOpen(x, z, width, height);
 }
 
-/*
- * RaigImpl implementation
- */
-RaigClient::RaigClientImpl::RaigClientImpl()
+void raig_EXPORT RaigClient::SetRegionBlocked(int x, int z, int width, int height)
 {
-	m_NetManager = std::unique_ptr<net::NetManager>(new net::NetManager());
-	m_ServiceType = AiService::ASTAR; // default AStar
-	m_iGameWorldWidth = 0;
-	m_iGameWorldHeight = 0;
-	m_iSocketFileDescriptor = -1;
-	m_iRecvSequence = -1; // Start counting from -1
-	m_bIsReqestComplete = true; // Server is ready for first request	
+	m_Impl->SetRegionBlocked(x, z, width, height);
 }
 
-RaigClient::RaigClientImpl::~RaigClientImpl()
+int raig_EXPORT RaigClient::FindPath(base::Vector3 *start, base::Vector3 *goal)
 {
-	CleanUp();
+	return m_Impl->FindPath(start, goal);
 }
 
-int RaigClient::RaigClientImpl::InitConnection(std::shared_ptr<std::string> hostname, std::shared_ptr<std::string> service)
+int raig_EXPORT RaigClient::FindPath(base::Vector3 *start, base::Vector3 *goal, PathMode mode)
 {
-	// Store hostname and service for reconnection attempts
-	m_strHostname = hostname;
-	m_strService = service;
-	
-	return m_NetManager->Init(m_strHostname, m_strService);
+	return m_Impl->FindPath(start, goal, mode);
 }
 
-void RaigClient::RaigClientImpl::CreateGameWorld(int width, int height, AiService serviceType)
+int raig_EXPORT RaigClient::FindPath(base::Vector3 *start, base::Vector3 *goal, PathCallback callback, void *userData)
 {
-	std::cout << "CreateGameWorld()" << std::endl;
-	// Store initial game world size and service type for re-connection attempts
-	m_iGameWorldWidth = width;
-	m_iGameWorldHeight = height;
-	m_ServiceType = serviceType;
+	return m_Impl->FindPath(start, goal, callback, userData);
+}
 
-	sprintf_s(m_cSendBuffer, "%02d_%03d_%02d_%02d_000000", RaigClientImpl::GAMEWORLD, m_iGameWorldWidth, m_iGameWorldHeight, serviceType);
-	m_NetManager->SendData(m_cSendBuffer);
+int raig_EXPORT RaigClient::FindPaths(const std::pair<base::Vector3, base::Vector3> *paths, int count, int *requestIds)
+{
+	return m_Impl->FindPaths(paths, count, requestIds);
 }
 
-void RaigClient::RaigClientImpl::SetCellOpen(base::Vector3 openCell)
+void raig_EXPORT RaigClient::SetPathMode(PathMode mode, int localDistance)
 {
-	// Search blocked cells vector and remove the openCell if it was found
-	// Time complexity O(N)
-	for(int i = 0; i <= (int)m_vBlockedCells.size(); i++)
-	{
-		if(!m_vBlockedCells.empty())
-		{
-			if(m_vBlockedCells[i]->Compare(&openCell))
-			{
-				//printf("Cell X:%d Z:%d == Cell X:%d Z:%d\n", m_vBlockedCells[i]->m_iX, m_vBlockedCells[i]->m_iZ, openCell.m_iX, openCell.m_iZ);
-				m_vBlockedCells.erase(m_vBlockedCells.begin() + i);
-				if(m_vBlockedCells.empty())
-				{
-					//printf("Blocked cells list empty\n");
-				}
-			}
-		}
-		else
-		{
-			//printf("Blocked cells list empty\n");
-		}
-	}
+	m_Impl->SetPathMode(mode, localDistance);
+}
 
-	sprintf_s(m_cSendBuffer, "%02d_%02d_%02d_%02d_0000000", RaigClientImpl::CELL_OPEN, openCell.m_iX, openCell.m_iY, openCell.m_iZ);
-	m_NetManager->SendData(m_cSendBuffer);
+void raig_EXPORT RaigClient::SetPathSmoothing(PathSmoothing smoothing)
+{
+	m_Impl->SetPathSmoothing(smoothing);
 }
 
-void RaigClient::RaigClientImpl::SetCellBlocked(base::Vector3 cell)
+void raig_EXPORT RaigClient::SetPathStreaming(bool isStreaming)
 {
-	// Add blocked cell to vector
-	m_vBlockedCells.push_back(std::unique_ptr<base::Vector3>(new base::Vector3(cell)));
+	m_Impl->SetPathStreaming(isStreaming);
+}
 
-	sprintf_s(m_cSendBuffer, "%02d_%02d_%02d_%02d_0000000", RaigClientImpl::CELL_BLOCKED, cell.m_iX, cell.m_iY, cell.m_iZ);
-	m_NetManager->SendData(m_cSendBuffer);
+std::vector<std::unique_ptr<base::Vector3> > raig_EXPORT &RaigClient::GetPath()
+{
+	return m_Impl->GetPath();
 }
 
-void RaigClient::RaigClientImpl::ReSendBlockedList()
+bool raig_EXPORT RaigClient::IsPathComplete(int requestId)
 {
-	if(m_NetManager->GetState() == net::NetManager::CONNECTED)
-	{
-		// Time complexity O(N) to send all cells in vector to RAIG server
-		for(int i = 0; i < (int)m_vBlockedCells.size(); i++)
-		{
-			if(!m_vBlockedCells.empty())
-			{
-				sprintf_s(m_cSendBuffer, "%02d_%02d_%02d_%02d_0000000", RaigClientImpl::CELL_BLOCKED, m_vBlockedCells[i]->m_iX, m_vBlockedCells[i]->m_iY, m_vBlockedCells[i]->m_iZ);
-				m_NetManager->SendData(m_cSendBuffer);
-			}
-		}
-	}
+	return m_Impl->IsPathComplete(requestId);
 }
 
-void RaigClient::RaigClientImpl::FindPath(base::Vector3 *start, base::Vector3 *goal)
+const base::Vector3 raig_EXPORT *RaigClient::GetPathData(int requestId, int *size)
 {
-	if(m_NetManager->GetState() == net::NetManager::CONNECTED)
-	{
-		if(m_bIsReqestComplete == false)
-		{
-			// Connected but the server is busy processing a request
-			// client must wait before sending another request
-			return;
-		}
+	return m_Impl->GetPathData(requestId, size);
+}
 
-		// Check if the start of goal cell is a blocked cell
-		// Time complexity O(N)
-		if(!m_vBlockedCells.empty())
-		{
-			for(int i = 0; i < (int)m_vBlockedCells.size(); i++)
-			{
-				if(m_vBlockedCells[i]->Compare(start) || m_vBlockedCells[i]->Compare(goal))
-				{
-					//printf("Invalid path, start or end goal is blocked\n");
-					return;
-				}
-			}
-		}
+int raig_EXPORT RaigClient::CopyPath(int requestId, base::Vector3 *out, int capacity)
+{
+	return m_Impl->CopyPath(requestId, out, capacity);
+}
 
-		sprintf_s(m_cSendBuffer, "%02d_%02d_%02d_%02d_%02d_0000", RaigClientImpl::PATH, start->m_iX, start->m_iZ, goal->m_iX, goal->m_iZ);
-		m_NetManager->SendData(m_cSendBuffer);
-		m_vPath.clear(); // Clear path storage
+void raig_EXPORT RaigClient::SetPathCacheCapacity(int capacity)
+{
+	m_Impl->SetPathCacheCapacity(capacity);
+}
 
-		// Send message to web application
-		//m_NetManager->GetDao()->Create("raig_client", "true");
+RaigClient::PathCacheStats raig_EXPORT RaigClient::GetPathCacheStats()
+{
+	return m_Impl->GetPathCacheStats();
+}
 
-		// Path request sent. Set the request complete flag to prevent more requests until this one is complete
-		m_bIsReqestComplete = false;
-	}
+bool raig_EXPORT RaigClient::TrackPath(int requestId)
+{
+	return m_Impl->TrackPath(requestId);
 }
 
-std::vector<std::unique_ptr<base::Vector3> > &RaigClient::RaigClientImpl::GetPath()
+void raig_EXPORT RaigClient::UntrackPath(int requestId)
 {
-	return m_vCompletedPath;
+	m_Impl->UntrackPath(requestId);
 }
 
-void RaigClient::RaigClientImpl::ClearBuffer()
+int raig_EXPORT RaigClient::GetChangedPaths(int *ids, int capacity)
 {
-	sprintf_s(m_cSendBuffer, "%d", RaigClientImpl::EMPTY);
-	sprintf_s(m_cRecvBuffer, "%d", RaigClientImpl::EMPTY);
+	return m_Impl->GetChangedPaths(ids, capacity);
 }
 
-void RaigClient::RaigClientImpl::Update()
+void raig_EXPORT RaigClient::AddObserver(base::Observer *observer)
 {
-	int result = m_NetManager->ReadData(m_cRecvBuffer, MAX_BUFFER_SIZE);
-	//std::cout << "Read bytes: " << result << " Buffer: " << m_cRecvBuffer << std::endl;
+	m_Impl->AddObserver(observer);
+}
 
-	// Re-connect to server
-	if(m_NetManager->GetState() == net::NetManager::CONNECTION_FAILED)
-	{
-		std::cout << "Reconnecting to server" << std::endl;
+void raig_EXPORT RaigClient::RemoveObserver(base::Observer *observer)
+{
+	m_Impl->RemoveObserver(observer);
+}
 
-		//printf("Trying to reconnect to server\n");
-		InitConnection(m_strHostname, m_strService);
+void raig_EXPORT RaigClient::SetSendHighWaterMark(size_t bytes)
+{
+	m_Impl->SetSendHighWaterMark(bytes);
+}
 
-		if(m_NetManager->GetState() == net::NetManager::CONNECTED)
-		{
-			// Re-connection successful, send RAIG game world size and service
-			// type used initially
-			printf("Re-connection successful\n");
-			CreateGameWorld(m_iGameWorldWidth, m_iGameWorldHeight, m_ServiceType);
-			ReSendBlockedList();
-			m_bIsReqestComplete = true; // Game client has reconnected to the server, allow first request to be sent
-			return;
-		}
+int raig_EXPORT RaigClient::Flush()
+{
+	return m_Impl->Flush();
+}
 
-		std::cout << "Raig Update()" << std::endl;
+void raig_EXPORT RaigClient::Update()
+{
+	m_Impl->Update();
+}
 
-		return;
-	}
+RaigClient::Stats raig_EXPORT RaigClient::GetStats()
+{
+	return m_Impl->GetStats();
+}
+
+void raig_EXPORT RaigClient::SetStatsDump(int intervalMs, StatsCallback callback, void *userData)
+{
+	m_Impl->SetStatsDump(intervalMs, callback, userData);
+}
+
+bool raig_EXPORT RaigClient::SetTelemetry(const std::string &url, int intervalMs, int batchEvents)
+{
+	return m_Impl->SetTelemetry(url, intervalMs, batchEvents);
+}
+
+static_assert(RaigClient::LOG_DEBUG == LOG_LEVEL_DEBUG && RaigClient::LOG_NONE == LOG_LEVEL_NONE, "LogLevel must match the base levels");
+
+void raig_EXPORT RaigClient::SetLogLevel(LogLevel level)
+{
+	base::Log::SetLevel(level);
+}
+
+void raig_EXPORT RaigClient::SetLogCallback(LogCallback callback, void *userData)
+{
+	base::Log::SetCallback(callback, userData);
+}
 
-	if(result < 0)
+/*
+ * Stats helpers
+ */
+static void CopyHistogram(const base::Histogram &histogram, RaigClient::StatsHistogram *out)
+{
+	for(int i = 0; i < RAIG_STATS_BUCKETS; i++)
 	{
-		//std::cout << "Read " << result << " skip processing" << std::endl;
-		return;
+		out->m_uBuckets[i] = histogram.GetBucket(i);
 	}
+	out->m_uCount = histogram.GetCount();
+	out->m_uSum = histogram.GetSum();
+	out->m_uMax = histogram.GetMax();
+}
 
-	// If the clients request is not yet complete continue to
-	// process packets until an END packet is received signifying the
-	// final Vector3 in the path
-	if(m_bIsReqestComplete == false)
+// Upper bound of the bucket holding the fraction of the values
+static uint64_t GetPercentile(const RaigClient::StatsHistogram &histogram, double fraction)
+{
+	uint64_t rank = (uint64_t)(histogram.m_uCount * fraction);
+	uint64_t count = 0;
+	for(int i = 0; i < RAIG_STATS_BUCKETS; i++)
 	{
-		char *statusFlag = strtok((char*)m_cRecvBuffer, "_");
-		int statusCode = atoi(statusFlag);
-
-		if(statusCode == RaigClientImpl::NODE)
+		count += histogram.m_uBuckets[i];
+		if(count > rank)
 		{
-			// Parse the buffer and construct the path vector
-			char *nodeId = strtok((char*)NULL, "_");
-			char *nodeX = strtok((char*)NULL, "_");
-			char *nodeZ = strtok((char*)NULL, "_");
+			uint64_t bound = ((uint64_t)2 << i) - 1;
+			return bound < histogram.m_uMax ? bound : histogram.m_uMax;
+		}
+	}
 
-			int locationId = std::atoi(nodeId);
-			int locationX = std::atoi(nodeX);
-			int locationZ = std::atoi(nodeZ);
+	return histogram.m_uMax;
+}
 
-			if(locationId == m_iRecvSequence)
-			{
+/*
+ * RaigImpl implementation
+ */
+RaigClient::RaigClientImpl::RaigClientImpl()
+{
+	m_eShardPolicy = LEAST_OUTSTANDING;
+	m_uNextServer = 0;
+	m_bIsThreaded = false;
+	m_uSendHighWaterMark = NET_SEND_HIGH_WATER_MARK;
+	m_ServiceType = AiService::ASTAR; // default AStar
+	m_iGameWorldWidth = 0;
+	m_iGameWorldHeight = 0;
+	m_iWorldVersion = 0;
+	m_iNextRequestId = 0;
+	m_iLastCompletedId = -1;
+	m_bIsLegacyPathValid = false;
+	m_ePathMode = REMOTE;
+	m_iLocalDistance = 0;
+	m_ePathSmoothing = NO_SMOOTHING;
+	m_bIsStreaming = false;
+	m_bIsBatching = false;
+	m_bIsBatchingCells = false;
+	m_iStatsDumpMs = 0;
+	m_StatsCallback = NULL;
+	m_pStatsUserData = NULL;
+
+	for(int i = 0; i < MAX_PENDING_REQUESTS; i++)
+	{
+		m_Requests[i].m_iId = -1;
+		m_Requests[i].m_eState = REQUEST_FREE;
+		m_Requests[i].m_iRecvSequence = -1;
+		m_Requests[i].m_iServer = -1;
+	}
+}
+
+RaigClient::RaigClientImpl::~RaigClientImpl()
+{
+	CleanUp();
+}
+
+void RaigClient::RaigClientImpl::SetThreadedNetwork(bool isThreaded)
+{
+	m_bIsThreaded = isThreaded;
+	for(size_t i = 0; i < m_vServers.size(); i++)
+	{
+		m_vServers[i]->m_NetManager->SetThreaded(isThreaded);
+	}
+}
+
+int RaigClient::RaigClientImpl::InitConnection(std::shared_ptr<std::string> hostname, std::shared_ptr<std::string> service)
+{
+	if(m_vServers.empty())
+	{
+		CreateServer();
+	}
+
+	// Store hostname and service for reconnection attempts
+	m_vServers[0]->m_strHostname = hostname;
+	m_vServers[0]->m_strService = service;
+
+	return ConnectServer(0);
+}
+
+int RaigClient::RaigClientImpl::AddServer(std::shared_ptr<std::string> hostname, std::shared_ptr<std::string> service)
+{
+	Server *server = CreateServer();
+	server->m_strHostname = hostname;
+	server->m_strService = service;
+
+	int index = (int)m_vServers.size() - 1;
+	// Joined after the world was created, its replica is brought up to date
+	// by the resync
+	ConnectServer(index);
+
+	return index;
+}
+
+RaigClient::RaigClientImpl::Server *RaigClient::RaigClientImpl::CreateServer()
+{
+	Server *server = new Server();
+	server->m_NetManager = std::unique_ptr<net::NetManager>(new net::NetManager());
+	server->m_NetManager->SetThreaded(m_bIsThreaded);
+	server->m_NetManager->SetHighWaterMark(m_uSendHighWaterMark);
+	server->m_bIsSynced = false;
+
+	m_vServers.push_back(std::unique_ptr<Server>(server));
+	return server;
+}
+
+int RaigClient::RaigClientImpl::ConnectServer(int index)
+{
+	Server *server = m_vServers[index].get();
+
+	int result = server->m_NetManager->Init(server->m_strHostname, server->m_strService);
+	if(server->m_NetManager->GetState() == net::NetManager::CONNECTED)
+	{
+		m_Poller.Watch(index, server->m_NetManager->GetSocket());
+		BeginResync(server);
+	}
+
+	return result;
+}
+
+void RaigClient::RaigClientImpl::SetShardPolicy(ShardPolicy policy)
+{
+	m_eShardPolicy = policy;
+}
+
+bool RaigClient::RaigClientImpl::IsServerReady(Server *server)
+{
+	return server->m_bIsSynced && server->m_NetManager->GetState() == net::NetManager::CONNECTED;
+}
+
+bool RaigClient::RaigClientImpl::IsConnected()
+{
+	for(size_t i = 0; i < m_vServers.size(); i++)
+	{
+		if(IsServerReady(m_vServers[i].get()))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int RaigClient::RaigClientImpl::SelectServer(base::Vector3 *start)
+{
+	int count = (int)m_vServers.size();
+	int selected = -1;
+
+	if(m_eShardPolicy == REGION && m_iGameWorldWidth > 0 && count > 0)
+	{
+		// Vertical strips of the world, nearby requests go to the same
+		// server and share its cache
+		int x = start->m_iX < 0 ? 0 : start->m_iX;
+		selected = x * count / m_iGameWorldWidth;
+		if(selected >= count)
+		{
+			selected = count - 1;
+		}
+	}
+	else if(m_eShardPolicy == ROUND_ROBIN && count > 0)
+	{
+		selected = (int)(m_uNextServer++ % count);
+	}
+
+	if(selected != -1)
+	{
+		Server *server = m_vServers[selected].get();
+		if(IsServerReady(server) && !server->m_NetManager->IsSendQueueFull())
+		{
+			return selected;
+		}
+	}
+
+	// Least outstanding requests, also used while the chosen server is down
+	// or backed up
+	selected = -1;
+	for(int i = 0; i < count; i++)
+	{
+		Server *server = m_vServers[i].get();
+		if(!IsServerReady(server) || server->m_NetManager->IsSendQueueFull())
+		{
+			continue;
+		}
+
+		if(selected == -1 || server->m_PendingRequests.size() < m_vServers[selected]->m_PendingRequests.size())
+		{
+			selected = i;
+		}
+	}
+
+	return selected;
+}
+
+void RaigClient::RaigClientImpl::OfferBinaryFraming(Server *server)
+{
+	// A new connection starts in ASCII. Servers that do not know the HELLO
+	// packet ignore it and the client keeps sending ASCII packets.
+	server->m_PacketWriter.SetFraming(net::Packet::ASCII);
+	server->m_PacketWriter.Clear();
+
+	int fields[] = { PACKET_VERSION, m_iWorldVersion };
+	server->m_PacketWriter.Write(net::Packet::HELLO, fields, 2);
+	FlushBatch(server);
+}
+
+void RaigClient::RaigClientImpl::CreateGameWorld(int width, int height, AiService serviceType)
+{
+	RAIG_LOG_INFO("CreateGameWorld() %dx%d", width, height);
+	SetGameWorld(width, height, serviceType);
+	SendGameWorld();
+}
+
+void RaigClient::RaigClientImpl::CreateGameWorld(int width, int height, AiService serviceType, const unsigned char *cells)
+{
+	// Pack into the layout of the bitmap overload, one pass over the cells
+	size_t size = (size_t)width * height;
+	m_vWorldBits.assign((size + 31) / 32, 0);
+	for(size_t i = 0; i < size; i++)
+	{
+		if(cells[i] != 0)
+		{
+			m_vWorldBits[i / 32] |= 1u << (i % 32);
+		}
+	}
+
+	CreateGameWorld(width, height, serviceType, m_vWorldBits.empty() ? NULL : &m_vWorldBits[0]);
+}
+
+void RaigClient::RaigClientImpl::CreateGameWorld(int width, int height, AiService serviceType, const uint32_t *bitmap)
+{
+	RAIG_LOG_INFO("CreateGameWorld() %dx%d", width, height);
+	SetGameWorld(width, height, serviceType);
+
+	if(bitmap != NULL)
+	{
+		// Only the cells that differ from the current grid are passed on
+		BeginCellBatch();
+		m_BlockedCells.AssignBits(bitmap, [this](int x, int z, bool blocked){
+			OnCellChanged(x, z, blocked);
+		});
+		EndCellBatch();
+	}
+
+	// The whole grid goes out with the world, changes made before are
+	// included
+	m_ChangedCells.Clear();
+	m_vChangedCells.clear();
+
+	SendGameWorld();
+}
+
+void RaigClient::RaigClientImpl::SetGameWorld(int width, int height, AiService serviceType)
+{
+	// Store initial game world size and service type for re-connection attempts
+	m_iGameWorldWidth = width;
+	m_iGameWorldHeight = height;
+	m_ServiceType = serviceType;
+	m_BlockedCells.Resize(width, height);
+	m_ChangedCells.Resize(width, height);
+
+	// 30 bits of the clock, the version is sent as a positive int
+	long long ticks = std::chrono::steady_clock::now().time_since_epoch().count();
+	m_iWorldVersion = (int)((ticks ^ (ticks >> 30)) & 0x3fffffff) + 1;
+}
+
+void RaigClient::RaigClientImpl::SendGameWorld()
+{
+	// Every server holds a replica of the world, servers still syncing
+	// get it with the resync
+	for(size_t i = 0; i < m_vServers.size(); i++)
+	{
+		Server *server = m_vServers[i].get();
+		if(!IsServerReady(server))
+		{
+			continue;
+		}
+
+		if(server->m_PacketWriter.GetFraming() == net::Packet::BINARY)
+		{
+			// Also carries the version and the cells blocked so far
+			SendSnapshot(server);
+		}
+		else
+		{
+			SendGameWorld(server);
+			SendBlockedList(server);
+		}
+	}
+}
+
+void RaigClient::RaigClientImpl::SendGameWorld(Server *server)
+{
+	int fields[] = { m_iGameWorldWidth, m_iGameWorldHeight, m_ServiceType };
+	server->m_PacketWriter.Write(net::Packet::GAMEWORLD, fields, 3);
+	FlushBatch(server);
+}
+
+void RaigClient::RaigClientImpl::SendSnapshot(Server *server)
+{
+	m_vSnapshotFields.clear();
+	m_vSnapshotFields.push_back(m_iWorldVersion);
+	m_vSnapshotFields.push_back(m_iGameWorldWidth);
+	m_vSnapshotFields.push_back(m_iGameWorldHeight);
+	m_vSnapshotFields.push_back(m_ServiceType);
+	m_vSnapshotFields.push_back(net::Packet::RUN_LENGTH);
+	m_vSnapshotFields.push_back(0);
+
+	// Time complexity O(N) on the number of runs, empty words of the grid
+	// are skipped. A noisy grid has more runs than words and is sent as a
+	// bitmap instead.
+	m_BlockedCells.EncodeRuns(&m_vSnapshotFields);
+	if(m_vSnapshotFields.size() - 6 > m_BlockedCells.GetWordCount())
+	{
+		m_vSnapshotFields.resize(6);
+		m_vSnapshotFields[4] = net::Packet::BITMAP;
+		m_BlockedCells.EncodeBits(&m_vSnapshotFields);
+	}
+	m_vSnapshotFields[5] = (int)m_vSnapshotFields.size() - 6;
+
+	server->m_PacketWriter.Write(net::Packet::SNAPSHOT, &m_vSnapshotFields[0], (int)m_vSnapshotFields.size());
+
+	// Cells blocked outside the world are not in the grid
+	if(m_BlockedCells.GetOutsideCount() > 0)
+	{
+		net::PacketWriter *writer = &server->m_PacketWriter;
+		const base::CellGrid *cells = &m_BlockedCells;
+		m_BlockedCells.ForEachBlocked([writer, cells](int x, int z){
+			if(!cells->IsInside(x, z))
+			{
+				int fields[] = { x, 0, z };
+				writer->Write(net::Packet::CELL_BLOCKED, fields, 3);
+			}
+		});
+	}
+	FlushBatch(server);
+}
+
+void RaigClient::RaigClientImpl::WriteWorldVersion(Server *server)
+{
+	if(server->m_PacketWriter.GetFraming() == net::Packet::BINARY)
+	{
+		int fields[] = { m_iWorldVersion };
+		server->m_PacketWriter.Write(net::Packet::VERSION, fields, 1);
+	}
+}
+
+void RaigClient::RaigClientImpl::SetCellOpen(base::Vector3 openCell)
+{
+	SetCellState(openCell.m_iX, openCell.m_iZ, false);
+}
+
+void RaigClient::RaigClientImpl::SetCellBlocked(base::Vector3 cell)
+{
+	SetCellState(cell.m_iX, cell.m_iZ, true);
+}
+
+void RaigClient::RaigClientImpl::SetCellsOpen(const base::Vector3 *cells, int count)
+{
+	for(int i = 0; i < count; i++)
+	{
+		SetCellState(cells[i].m_iX, cells[i].m_iZ, false);
+	}
+}
+
+void RaigClient::RaigClientImpl::SetCellsBlocked(const base::Vector3 *cells, int count)
+{
+	BeginCellBatch();
+	for(int i = 0; i < count; i++)
+	{
+		SetCellState(cells[i].m_iX, cells[i].m_iZ, true);
+	}
+	EndCellBatch();
+}
+
+void RaigClient::RaigClientImpl::SetRegionOpen(int x, int z, int width, int height)
+{
+	for(int row = z; row < z + height; row++)
+	{
+		for(int column = x; column < x + width; column++)
+		{
+			SetCellState(column, row, false);
+		}
+	}
+}
+
+void RaigClient::RaigClientImpl::SetRegionBlocked(int x, int z, int width, int height)
+{
+	BeginCellBatch();
+	for(int row = z; row < z + height; row++)
+	{
+		for(int column = x; column < x + width; column++)
+		{
+			SetCellState(column, row, true);
+		}
+	}
+	EndCellBatch();
+}
+
+void RaigClient::RaigClientImpl::SetCellState(int x, int z, bool blocked)
+{
+	// Time complexity O(1)
+	bool changed = blocked ? m_BlockedCells.Block(x, z) : m_BlockedCells.Open(x, z);
+	if(!changed)
+	{
+		return;
+	}
+
+	OnCellChanged(x, z, blocked);
+
+	if(m_ChangedCells.IsBlocked(x, z))
+	{
+		// Changed back before the flush, nothing to send
+		m_ChangedCells.Open(x, z);
+		return;
+	}
+
+	m_ChangedCells.Block(x, z);
+	m_vChangedCells.push_back(std::make_pair(x, z));
+}
+
+void RaigClient::RaigClientImpl::OnCellChanged(int x, int z, bool blocked)
+{
+	m_HierarchicalSearch.OnCellChanged(x, z);
+
+	if(blocked)
+	{
+		if(m_bIsBatchingCells && m_BlockedBatch.Add(x, z))
+		{
+			// Checked against the paths by EndCellBatch()
+			return;
+		}
+
+		m_PathCache.OnCellBlocked(x, z);
+		m_PathTracker.OnCellBlocked(x, z);
+	}
+	else
+	{
+		m_PathCache.OnCellOpened(x, z);
+	}
+}
+
+void RaigClient::RaigClientImpl::BeginCellBatch()
+{
+	m_BlockedBatch.Clear();
+	m_bIsBatchingCells = m_PathCache.GetCount() > 0 || m_PathTracker.GetCount() > 0;
+}
+
+void RaigClient::RaigClientImpl::EndCellBatch()
+{
+	m_bIsBatchingCells = false;
+	if(m_BlockedBatch.IsEmpty())
+	{
+		return;
+	}
+
+	m_PathCache.OnCellsBlocked(m_BlockedBatch);
+	m_PathTracker.OnCellsBlocked(m_BlockedBatch);
+	m_BlockedBatch.Clear();
+}
+
+void RaigClient::RaigClientImpl::FlushCellUpdates()
+{
+	if(m_vChangedCells.empty())
+	{
+		return;
+	}
+
+	for(size_t i = 0; i < m_vServers.size(); i++)
+	{
+		if(IsServerReady(m_vServers[i].get()) && m_vServers[i]->m_NetManager->IsSendQueueFull())
+		{
+			// Backpressure, the changes stay pending until the queue drains
+			// so every replica gets them in the same order
+			return;
+		}
+	}
+
+	// A server that is disconnected or syncing gets the whole grid with its
+	// resync
+	bool isChanged = false;
+	for(size_t i = 0; i < m_vChangedCells.size(); i++)
+	{
+		int x = m_vChangedCells[i].first;
+		int z = m_vChangedCells[i].second;
+
+		// Open() also skips a cell listed twice
+		if(m_ChangedCells.Open(x, z))
+		{
+			isChanged = true;
+			net::Packet::PacketCode code = m_BlockedCells.IsBlocked(x, z) ? net::Packet::CELL_BLOCKED : net::Packet::CELL_OPEN;
+			int fields[] = { x, 0, z };
+			for(size_t j = 0; j < m_vServers.size(); j++)
+			{
+				if(IsServerReady(m_vServers[j].get()))
+				{
+					m_vServers[j]->m_PacketWriter.Write(code, fields, 3);
+				}
+			}
+		}
+	}
+
+	if(isChanged && m_iWorldVersion > 0)
+	{
+		m_iWorldVersion++;
+	}
+
+	for(size_t i = 0; i < m_vServers.size(); i++)
+	{
+		Server *server = m_vServers[i].get();
+		if(IsServerReady(server))
+		{
+			if(isChanged && m_iWorldVersion > 0)
+			{
+				// Sent in the same message as the changes
+				WriteWorldVersion(server);
+			}
+			FlushBatch(server);
+		}
+	}
+
+	m_ChangedCells.Clear();
+	m_vChangedCells.clear();
+}
+
+void RaigClient::RaigClientImpl::FlushBatch(Server *server)
+{
+	if(!server->m_PacketWriter.IsEmpty())
+	{
+		server->m_NetManager->SendData(server->m_PacketWriter.GetData(), server->m_PacketWriter.GetSize());
+		server->m_PacketWriter.Clear();
+	}
+}
+
+void RaigClient::RaigClientImpl::SendBlockedList(Server *server)
+{
+	if(server->m_NetManager->GetState() == net::NetManager::CONNECTED)
+	{
+		// Time complexity O(N) to send all blocked cells to RAIG server. Cell
+		// updates still pending are sent again later, they only repeat the
+		// current state.
+		net::PacketWriter *writer = &server->m_PacketWriter;
+		m_BlockedCells.ForEachBlocked([writer](int x, int z){
+			int fields[] = { x, 0, z };
+			writer->Write(net::Packet::CELL_BLOCKED, fields, 3);
+		});
+		FlushBatch(server);
+	}
+}
+
+int RaigClient::RaigClientImpl::FindPath(base::Vector3 *start, base::Vector3 *goal)
+{
+	return FindPath(start, goal, m_ePathMode);
+}
+
+void RaigClient::RaigClientImpl::SetPathMode(PathMode mode, int localDistance)
+{
+	m_ePathMode = mode;
+	m_iLocalDistance = localDistance;
+}
+
+void RaigClient::RaigClientImpl::SetPathSmoothing(PathSmoothing smoothing)
+{
+	m_ePathSmoothing = smoothing;
+
+	// Paths smoothed before are rebuilt when next read
+	m_bIsLegacyPathValid = false;
+	for(int i = 0; i < MAX_PENDING_REQUESTS; i++)
+	{
+		m_Requests[i].m_Smoothed.m_bIsValid = false;
+	}
+	for(int i = 0; i < m_PathTracker.GetCount(); i++)
+	{
+		m_PathTracker.Get(i)->m_Smoothed.m_bIsValid = false;
+	}
+}
+
+void RaigClient::RaigClientImpl::SetPathStreaming(bool isStreaming)
+{
+	m_bIsStreaming = isStreaming;
+}
+
+int RaigClient::RaigClientImpl::FindPath(base::Vector3 *start, base::Vector3 *goal, PathMode mode)
+{
+	m_RequestCount.Add();
+
+	int requestId = RequestPath(start, goal, mode);
+	if(requestId == -1)
+	{
+		m_DroppedCount.Add();
+	}
+
+	return requestId;
+}
+
+int RaigClient::RaigClientImpl::RequestPath(base::Vector3 *start, base::Vector3 *goal, PathMode mode)
+{
+	// Check if the start of goal cell is a blocked cell
+	// Time complexity O(1)
+	if(m_BlockedCells.IsBlocked(start->m_iX, start->m_iZ) || m_BlockedCells.IsBlocked(goal->m_iX, goal->m_iZ))
+	{
+		RAIG_LOG_DEBUG("Invalid path, start or end goal is blocked");
+		return -1;
+	}
+
+	// Cached paths complete straight away, even while disconnected
+	const base::PathBuffer *cachedPath = m_PathCache.Find(start->m_iX, start->m_iZ, goal->m_iX, goal->m_iZ);
+	if(cachedPath != NULL)
+	{
+		PathRequest *request = AllocateRequest(start, goal);
+		if(request == NULL)
+		{
+			return -1;
+		}
+
+		request->m_Path.Assign(cachedPath->GetData(), cachedPath->GetSize());
+		CompleteRequest(request, REQUEST_COMPLETE);
+		return request->m_iId;
+	}
+
+	if(mode == HIERARCHICAL)
+	{
+		return FindHierarchicalPath(start, goal);
+	}
+
+	if(IsLocalSearch(start, goal, mode))
+	{
+		return FindLocalPath(start, goal);
+	}
+
+	int server = SelectServer(start);
+	if(server == -1)
+	{
+		return -1;
+	}
+
+	PathRequest *request = AllocateRequest(start, goal);
+	if(request == NULL)
+	{
+		// Every slot is waiting on the server, the client must wait for
+		// a request to complete before sending another
+		return -1;
+	}
+
+	request->m_iServer = server;
+	SendPathRequest(request);
+
+	return request->m_iId;
+}
+
+int RaigClient::RaigClientImpl::FindPath(base::Vector3 *start, base::Vector3 *goal, PathCallback callback, void *userData)
+{
+	int requestId = FindPath(start, goal, m_ePathMode);
+	if(requestId != -1)
+	{
+		// Requests that completed straight away are dispatched in Update()
+		// like the others
+		PathRequest *request = GetRequest(requestId);
+		request->m_Callback = callback;
+		request->m_pUserData = userData;
+	}
+
+	return requestId;
+}
+
+int RaigClient::RaigClientImpl::FindPaths(const std::pair<base::Vector3, base::Vector3> *paths, int count, int *requestIds)
+{
+	m_bIsBatching = true;
+
+	int requested = 0;
+	for(int i = 0; i < count; i++)
+	{
+		base::Vector3 start = paths[i].first;
+		base::Vector3 goal = paths[i].second;
+
+		requestIds[i] = FindPath(&start, &goal, m_ePathMode);
+		if(requestIds[i] != -1)
+		{
+			requested++;
+		}
+	}
+
+	m_bIsBatching = false;
+	SendPathBatch();
+
+	return requested;
+}
+
+void RaigClient::RaigClientImpl::SendPathRequest(PathRequest *request)
+{
+	Server *server = m_vServers[request->m_iServer].get();
+
+	if(m_bIsBatching)
+	{
+		// Pending straight away so the slot is not handed out again
+		request->m_eState = REQUEST_PENDING;
+		server->m_PendingRequests.push_back(request->m_iId);
+		m_vBatch.push_back(request->m_iId);
+		return;
+	}
+
+	// The server must see this frame's cell updates before the request
+	FlushCellUpdates();
+
+	// ASCII servers always send the goal first
+	request->m_bIsForward = m_bIsStreaming && server->m_PacketWriter.GetFraming() == net::Packet::BINARY;
+
+	int fields[] = { request->m_Start.m_iX, request->m_Start.m_iZ, request->m_Goal.m_iX, request->m_Goal.m_iZ, request->m_iId };
+	bool isWritten = server->m_PacketWriter.Write(net::Packet::PATH, fields, 5, GetPathFlags());
+	FlushBatch(server);
+
+	request->m_eState = REQUEST_PENDING;
+	server->m_PendingRequests.push_back(request->m_iId);
+	if(!isWritten)
+	{
+		// The cells do not fit the ASCII framing, the server never sees it
+		CompleteRequest(request, REQUEST_FAILED);
+	}
+}
+
+void RaigClient::RaigClientImpl::SendPathBatch()
+{
+	if(m_vBatch.empty())
+	{
+		return;
+	}
+
+	// The server must see this frame's cell updates before the requests
+	FlushCellUpdates();
+
+	// One message to each server holding its share of the batch
+	for(size_t i = 0; i < m_vServers.size(); i++)
+	{
+		Server *server = m_vServers[i].get();
+
+		m_vBatchFields.clear();
+		m_vBatchFields.push_back(0);
+		for(size_t j = 0; j < m_vBatch.size(); j++)
+		{
+			PathRequest *request = GetRequest(m_vBatch[j]);
+			if(request->m_iServer != (int)i)
+			{
+				continue;
+			}
+
+			request->m_bIsForward = m_bIsStreaming && server->m_PacketWriter.GetFraming() == net::Packet::BINARY;
+
+			m_vBatchFields[0]++;
+			m_vBatchFields.push_back(request->m_iId);
+			m_vBatchFields.push_back(request->m_Start.m_iX);
+			m_vBatchFields.push_back(request->m_Start.m_iZ);
+			m_vBatchFields.push_back(request->m_Goal.m_iX);
+			m_vBatchFields.push_back(request->m_Goal.m_iZ);
+		}
+
+		if(m_vBatchFields[0] == 0)
+		{
+			continue;
+		}
+
+		if(server->m_PacketWriter.GetFraming() == net::Packet::BINARY)
+		{
+			server->m_PacketWriter.Write(net::Packet::PATH_BATCH, &m_vBatchFields[0], (int)m_vBatchFields.size(), GetPathFlags());
+		}
+		else
+		{
+			// No batch packet in the ASCII layouts, the requests still go in
+			// one call to SendData()
+			for(size_t j = 1; j < m_vBatchFields.size(); j += 5)
+			{
+				int fields[] = { m_vBatchFields[j + 1], m_vBatchFields[j + 2], m_vBatchFields[j + 3], m_vBatchFields[j + 4], m_vBatchFields[j] };
+				if(!server->m_PacketWriter.Write(net::Packet::PATH, fields, 5))
+				{
+					CompleteRequest(GetRequest(m_vBatchFields[j]), REQUEST_FAILED);
+				}
+			}
+		}
+
+		FlushBatch(server);
+	}
+
+	m_vBatch.clear();
+}
+
+bool RaigClient::RaigClientImpl::IsLocalSearch(base::Vector3 *start, base::Vector3 *goal, PathMode mode)
+{
+	switch(mode)
+	{
+	case LOCAL:
+		return true;
+	case AUTO:
+		// Keep paths flowing while the server is unreachable
+		return !IsConnected() ||
+			abs(goal->m_iX - start->m_iX) + abs(goal->m_iZ - start->m_iZ) <= m_iLocalDistance;
+	default:
+		return false;
+	}
+}
+
+int RaigClient::RaigClientImpl::FindLocalPath(base::Vector3 *start, base::Vector3 *goal)
+{
+	PathRequest *request = AllocateRequest(start, goal);
+	if(request == NULL)
+	{
+		return -1;
+	}
+
+	if(!m_GridSearch.FindPath(m_BlockedCells, start->m_iX, start->m_iZ, goal->m_iX, goal->m_iZ, GetSearchAlgorithm(), &request->m_Path))
+	{
+		ReleaseRequest(request);
+		return -1;
+	}
+
+	CompleteRequest(request, REQUEST_COMPLETE);
+	return request->m_iId;
+}
+
+int RaigClient::RaigClientImpl::FindHierarchicalPath(base::Vector3 *start, base::Vector3 *goal)
+{
+	PathRequest *request = AllocateRequest(start, goal);
+	if(request == NULL)
+	{
+		return -1;
+	}
+
+	if(!m_HierarchicalSearch.FindPath(m_BlockedCells, start->m_iX, start->m_iZ, goal->m_iX, goal->m_iZ, &request->m_Waypoints))
+	{
+		ReleaseRequest(request);
+		return -1;
+	}
+
+	// The first segments are refined straight away so the agent can start
+	// moving, the rest in Update()
+	request->m_Path.Assign(request->m_Waypoints.GetData(), 1);
+	request->m_iNextWaypoint = 1;
+	request->m_eState = REQUEST_REFINING;
+	RefinePath(request, PATH_REFINE_SEGMENTS);
+
+	return request->m_iId;
+}
+
+void RaigClient::RaigClientImpl::RefinePath(PathRequest *request, int count)
+{
+	const base::Vector3 *waypoints = request->m_Waypoints.GetData();
+	int size = request->m_Waypoints.GetSize();
+
+	for(int i = 0; i < count && request->m_iNextWaypoint < size; i++)
+	{
+		base::Vector3 from = request->m_Path.GetData()[request->m_Path.GetSize() - 1];
+		if(m_HierarchicalSearch.RefineSegment(m_BlockedCells, from, waypoints[request->m_iNextWaypoint], &m_Segment))
+		{
+			request->m_iNextWaypoint++;
+		}
+		else
+		{
+			// A cell between the waypoints was blocked since the search,
+			// search the rest of the path on the grid
+			const base::Vector3 &goal = waypoints[size - 1];
+			if(!m_GridSearch.FindPath(m_BlockedCells, from.m_iX, from.m_iZ, goal.m_iX, goal.m_iZ, GetSearchAlgorithm(), &m_Segment))
+			{
+				request->m_Path.Clear();
+				CompleteRequest(request, REQUEST_FAILED);
+				return;
+			}
+			request->m_iNextWaypoint = size;
+		}
+
+		// The segment starts at the last node of the path
+		request->m_Path.Append(m_Segment.GetData() + 1, m_Segment.GetSize() - 1);
+	}
+
+	if(request->m_iNextWaypoint == size)
+	{
+		CompleteRequest(request, REQUEST_COMPLETE);
+	}
+}
+
+void RaigClient::RaigClientImpl::RefinePaths()
+{
+	for(int i = 0; i < MAX_PENDING_REQUESTS; i++)
+	{
+		if(m_Requests[i].m_eState == REQUEST_REFINING)
+		{
+			RefinePath(&m_Requests[i], PATH_REFINE_SEGMENTS);
+		}
+	}
+}
+
+ai::GridSearch::Algorithm RaigClient::RaigClientImpl::GetSearchAlgorithm()
+{
+	switch(m_ServiceType)
+	{
+	case BFS:
+		return ai::GridSearch::BFS;
+	case DFS:
+		return ai::GridSearch::DFS;
+	default:
+		return ai::GridSearch::ASTAR;
+	}
+}
+
+RaigClient::RaigClientImpl::PathRequest *RaigClient::RaigClientImpl::AllocateRequest(base::Vector3 *start, base::Vector3 *goal)
+{
+	bool isSlotFree = false;
+	for(int i = 0; i < MAX_PENDING_REQUESTS && !isSlotFree; i++)
+	{
+		isSlotFree = !IsSlotInUse(&m_Requests[i]);
+	}
+	if(!isSlotFree)
+	{
+		// Every slot holds a request in flight
+		return NULL;
+	}
+
+	// Skip ahead to the next id whose slot is free, a slow request only
+	// holds its own slot. Ids of tracked paths are not reused until the
+	// path is untracked, the id reads the tracked path before any request.
+	int requestId = m_iNextRequestId;
+	PathRequest *request = &m_Requests[requestId % MAX_PENDING_REQUESTS];
+	for(int attempt = 0; IsSlotInUse(request) || (m_PathTracker.GetCount() > 0 && m_PathTracker.Find(requestId) != NULL); attempt++)
+	{
+		if(attempt == MAX_REQUEST_ID)
+		{
+			return NULL;
+		}
+		requestId = (requestId + 1) % MAX_REQUEST_ID;
+		request = &m_Requests[requestId % MAX_PENDING_REQUESTS];
+	}
+
+	request->m_iId = requestId;
+	request->m_eState = REQUEST_FREE;
+	request->m_iRecvSequence = -1; // Start counting from -1
+	request->m_Path.Clear(); // Clear path storage, capacity is reused
+	request->m_Start = *start;
+	request->m_Goal = *goal;
+	request->m_uWorldVersion = m_PathCache.GetWorldVersion();
+	request->m_iRepairPathId = -1;
+	request->m_Callback = NULL;
+	request->m_pUserData = NULL;
+	request->m_iServer = -1;
+	request->m_RequestTime = std::chrono::steady_clock::now();
+	request->m_bIsForward = false;
+	request->m_Smoothed.m_bIsValid = false;
+
+	m_iNextRequestId = (requestId + 1) % MAX_REQUEST_ID;
+
+	return request;
+}
+
+std::vector<std::unique_ptr<base::Vector3> > &RaigClient::RaigClientImpl::GetPath()
+{
+	if(m_bIsLegacyPathValid && (m_PathTracker.GetCount() == 0 || m_PathTracker.Find(m_iLastCompletedId) == NULL))
+	{
+		return m_vLegacyPath;
+	}
+	m_bIsLegacyPathValid = true;
+	m_vLegacyPath.clear();
+
+	int size = 0;
+	const base::Vector3 *nodes = GetPathData(m_iLastCompletedId, &size);
+	for(int i = 0; i < size; i++)
+	{
+		m_vLegacyPath.push_back(std::unique_ptr<base::Vector3>(new base::Vector3(nodes[i])));
+	}
+
+	return m_vLegacyPath;
+}
+
+bool RaigClient::RaigClientImpl::IsPathComplete(int requestId)
+{
+	PathTracker::TrackedPath *path = m_PathTracker.Find(requestId);
+	if(path != NULL)
+	{
+		return !path->m_Path.IsEmpty();
+	}
+
+	return GetCompletedRequest(requestId) != NULL;
+}
+
+const base::Vector3 *RaigClient::RaigClientImpl::GetPathData(int requestId, int *size)
+{
+	const base::PathBuffer *nodes = GetReadablePath(requestId);
+	if(nodes == NULL)
+	{
+		*size = 0;
+		return NULL;
+	}
+
+	*size = nodes->GetSize();
+	return nodes->GetData();
+}
+
+int RaigClient::RaigClientImpl::CopyPath(int requestId, base::Vector3 *out, int capacity)
+{
+	const base::PathBuffer *nodes = GetReadablePath(requestId);
+	if(nodes == NULL)
+	{
+		return 0;
+	}
+
+	return nodes->Copy(out, capacity);
+}
+
+void RaigClient::RaigClientImpl::SetPathCacheCapacity(int capacity)
+{
+	m_PathCache.SetCapacity(capacity);
+}
+
+RaigClient::PathCacheStats RaigClient::RaigClientImpl::GetPathCacheStats()
+{
+	return m_PathCache.GetStats();
+}
+
+bool RaigClient::RaigClientImpl::TrackPath(int requestId)
+{
+	PathRequest *request = GetCompletedRequest(requestId);
+	if(request == NULL)
+	{
+		return false;
+	}
+
+	m_PathTracker.Track(requestId, request->m_Path.GetData(), request->m_Path.GetSize());
+	return true;
+}
+
+void RaigClient::RaigClientImpl::UntrackPath(int requestId)
+{
+	m_PathTracker.Untrack(requestId);
+}
+
+int RaigClient::RaigClientImpl::GetChangedPaths(int *ids, int capacity)
+{
+	return m_PathTracker.GetChangedPaths(ids, capacity);
+}
+
+void RaigClient::RaigClientImpl::RepairTrackedPaths()
+{
+	for(int i = 0; i < m_PathTracker.GetCount(); i++)
+	{
+		PathTracker::TrackedPath *path = m_PathTracker.Get(i);
+
+		if(path->m_iRepairRequestId != -1)
+		{
+			PathRequest *request = GetRequest(path->m_iRepairRequestId);
+			if(request != NULL && request->m_eState == REQUEST_PENDING)
+			{
+				// Wait for the server
+				continue;
+			}
+
+			// Repair request was lost, search again
+			path->m_iRepairRequestId = -1;
+			path->m_bIsBlocked = true;
+		}
+
+		if(path->m_bIsBlocked)
+		{
+			RepairPath(path);
+		}
+	}
+}
+
+void RaigClient::RaigClientImpl::RepairPath(PathTracker::TrackedPath *path)
+{
+	while(true)
+	{
+		const base::Vector3 *nodes = path->m_Path.GetData();
+		int size = path->m_Path.GetSize();
+
+		// Find the first run of blocked nodes
+		int first = 0;
+		while(first < size && !m_BlockedCells.IsBlocked(nodes[first].m_iX, nodes[first].m_iZ))
+		{
+			first++;
+		}
+
+		if(first == size)
+		{
+			path->m_bIsBlocked = false;
+			return;
+		}
+
+		int last = first;
+		while(last + 1 < size && m_BlockedCells.IsBlocked(nodes[last + 1].m_iX, nodes[last + 1].m_iZ))
+		{
+			last++;
+		}
+
+		// The segment is replaced from the node before the run to the node
+		// after it
+		first--;
+		last++;
+		if(first < 0 || last >= size)
+		{
+			// Start or goal is blocked, the path can not be repaired
+			break;
+		}
+
+		base::Vector3 from = nodes[first];
+		base::Vector3 to = nodes[last];
+
+		if(m_GridSearch.FindPath(m_BlockedCells, from.m_iX, from.m_iZ, to.m_iX, to.m_iZ, GetSearchAlgorithm(), &m_Segment, PATH_REPAIR_SEARCH_LIMIT))
+		{
+			path->m_Path.Replace(first, last, m_Segment.GetData(), m_Segment.GetSize());
+			m_PathTracker.OnPathChanged(path);
+			continue;
+		}
+
+		// No short detour around the obstacle, ask the server for the segment
+		int server = SelectServer(&from);
+		if(server == -1)
+		{
+			break;
+		}
+
+		PathRequest *request = AllocateRequest(&from, &to);
+		if(request == NULL)
+		{
+			// Every slot is in use, try again next update
+			return;
+		}
+
+		request->m_iServer = server;
+		request->m_iRepairPathId = path->m_iId;
+		path->m_iRepairRequestId = request->m_iId;
+		path->m_iRepairFirst = first;
+		path->m_iRepairLast = last;
+		path->m_bIsBlocked = false;
+		SendPathRequest(request);
+		return;
+	}
+
+	path->m_Path.Clear();
+	path->m_bIsBlocked = false;
+	m_PathTracker.OnPathChanged(path);
+}
+
+void RaigClient::RaigClientImpl::CompleteRepair(PathRequest *request)
+{
+	PathTracker::TrackedPath *path = m_PathTracker.Find(request->m_iRepairPathId);
+	if(path == NULL || path->m_iRepairRequestId != request->m_iId)
+	{
+		// Untracked while the repair was in flight
+		return;
+	}
+
+	path->m_Path.Replace(path->m_iRepairFirst, path->m_iRepairLast, request->m_Path.GetData(), request->m_Path.GetSize());
+	path->m_iRepairRequestId = -1;
+
+	// Check the spliced path against cells blocked in the meantime
+	path->m_bIsBlocked = true;
+	m_PathTracker.OnPathChanged(path);
+}
+
+void RaigClient::RaigClientImpl::FailRepair(PathRequest *request)
+{
+	PathTracker::TrackedPath *path = m_PathTracker.Find(request->m_iRepairPathId);
+	if(path == NULL || path->m_iRepairRequestId != request->m_iId)
+	{
+		return;
+	}
+
+	// No way around the obstacle, as when the repair fails locally
+	path->m_Path.Clear();
+	path->m_iRepairRequestId = -1;
+	path->m_bIsBlocked = false;
+	m_PathTracker.OnPathChanged(path);
+}
+
+RaigClient::RaigClientImpl::PathRequest *RaigClient::RaigClientImpl::GetCompletedRequest(int requestId)
+{
+	PathRequest *request = GetRequest(requestId);
+	if(request == NULL || request->m_eState != REQUEST_COMPLETE)
+	{
+		return NULL;
+	}
+
+	return request;
+}
+
+RaigClient::RaigClientImpl::PathRequest *RaigClient::RaigClientImpl::GetReadableRequest(int requestId)
+{
+	PathRequest *request = GetRequest(requestId);
+	if(request == NULL || (request->m_eState != REQUEST_COMPLETE && request->m_eState != REQUEST_REFINING))
+	{
+		return NULL;
+	}
+
+	return request;
+}
+
+const base::PathBuffer *RaigClient::RaigClientImpl::GetReadablePath(int requestId)
+{
+	PathTracker::TrackedPath *path = m_PathTracker.Find(requestId);
+	if(path != NULL)
+	{
+		return GetSmoothedPath(&path->m_Path, &path->m_Smoothed);
+	}
+
+	PathRequest *request = GetRequest(requestId);
+	if(request != NULL && request->m_eState == REQUEST_PENDING && request->m_bIsForward)
+	{
+		// The part of a streamed path received so far
+		return &request->m_Path;
+	}
+
+	request = GetReadableRequest(requestId);
+	if(request == NULL)
+	{
+		return NULL;
+	}
+
+	if(request->m_eState == REQUEST_REFINING)
+	{
+		// Smoothed once the whole path is refined
+		return &request->m_Path;
+	}
+
+	return GetSmoothedPath(&request->m_Path, &request->m_Smoothed);
+}
+
+const base::PathBuffer *RaigClient::RaigClientImpl::GetSmoothedPath(const base::PathBuffer *path, ai::SmoothedPath *smoothed)
+{
+	if(m_ePathSmoothing == NO_SMOOTHING)
+	{
+		return path;
+	}
+
+	// Any change of the blocked cells changes the version of the cache
+	unsigned int gridVersion = m_PathCache.GetWorldVersion();
+	if(smoothed->m_bIsValid && (m_ePathSmoothing == CORNERS || smoothed->m_uGridVersion == gridVersion))
+	{
+		return &smoothed->m_Path;
+	}
+
+	if(m_ePathSmoothing == LINE_OF_SIGHT)
+	{
+		ai::PathSmoother::SmoothLineOfSight(m_BlockedCells, path->GetData(), path->GetSize(), &smoothed->m_Path);
+	}
+	else
+	{
+		ai::PathSmoother::RemoveCollinear(path->GetData(), path->GetSize(), &smoothed->m_Path);
+	}
+
+	smoothed->m_uGridVersion = gridVersion;
+	smoothed->m_bIsValid = true;
+	return &smoothed->m_Path;
+}
+
+RaigClient::RaigClientImpl::PathRequest *RaigClient::RaigClientImpl::GetRequest(int requestId)
+{
+	if(requestId < 0)
+	{
+		return NULL;
+	}
+
+	PathRequest *request = &m_Requests[requestId % MAX_PENDING_REQUESTS];
+	if(request->m_iId != requestId)
+	{
+		// Slot has been reused by a newer request
+		return NULL;
+	}
+
+	return request;
+}
+
+RaigClient::RaigClientImpl::PathRequest *RaigClient::RaigClientImpl::GetReplyRequest(Server *server, int requestId)
+{
+	if(requestId < 0)
+	{
+		if(server->m_PendingRequests.empty())
+		{
+			return NULL;
+		}
+		requestId = server->m_PendingRequests.front();
+	}
+
+	PathRequest *request = GetRequest(requestId);
+	if(request == NULL || request->m_eState != REQUEST_PENDING)
+	{
+		return NULL;
+	}
+
+	return request;
+}
+
+void RaigClient::RaigClientImpl::CompleteRequest(PathRequest *request, RequestState state)
+{
+	request->m_eState = state;
+
+	if(request->m_iServer != -1)
+	{
+		std::deque<int> &pendingRequests = m_vServers[request->m_iServer]->m_PendingRequests;
+		std::deque<int>::iterator it = std::find(pendingRequests.begin(), pendingRequests.end(), request->m_iId);
+		if(it != pendingRequests.end())
+		{
+			pendingRequests.erase(it);
+		}
+	}
+
+	if(state == REQUEST_COMPLETE)
+	{
+		m_iLastCompletedId = request->m_iId;
+		m_bIsLegacyPathValid = false;
+	}
+
+	// Repairs are internal to the client
+	if(request->m_iRepairPathId != -1)
+	{
+		return;
+	}
+
+	m_vFinishedRequests.push_back(request->m_iId);
+
+	int64_t latencyUs = -1;
+	if(request->m_iServer != -1)
+	{
+		std::chrono::steady_clock::duration latency = std::chrono::steady_clock::now() - request->m_RequestTime;
+		latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+		if(m_Telemetry.IsRunning())
+		{
+			RecordTelemetry(request, state, latencyUs);
+		}
+	}
+
+	if(state != REQUEST_COMPLETE)
+	{
+		m_FailedCount.Add();
+		return;
+	}
+
+	m_CompletedCount.Add();
+	m_PathNodes.Record(request->m_Path.GetSize());
+	if(latencyUs != -1)
+	{
+		m_RequestLatency.Record(latencyUs);
+	}
+}
+
+void RaigClient::RaigClientImpl::ReleaseRequest(PathRequest *request)
+{
+	request->m_eState = REQUEST_FREE;
+	request->m_iId = -1;
+	request->m_Path.Clear();
+}
+
+void RaigClient::RaigClientImpl::RecordTelemetry(const PathRequest *request, RequestState state, int64_t latencyUs)
+{
+	// One line per request, the uploader joins them into one post
+	char event[128];
+	int size = snprintf(event, sizeof(event), "type=path&id=%d&server=%d&state=%s&nodes=%d&latency_us=%lld",
+		request->m_iId, request->m_iServer, state == REQUEST_COMPLETE ? "complete" : "failed",
+		state == REQUEST_COMPLETE ? request->m_Path.GetSize() : 0, (long long)latencyUs);
+	if(size > 0 && size < (int)sizeof(event))
+	{
+		m_Telemetry.Record(event, size);
+	}
+}
+
+void RaigClient::RaigClientImpl::AbandonPendingRequests(Server *server)
+{
+	// Requests sent before the connection dropped will never be answered
+	while(!server->m_PendingRequests.empty())
+	{
+		PathRequest *request = GetRequest(server->m_PendingRequests.front());
+		server->m_PendingRequests.pop_front();
+
+		if(request != NULL)
+		{
+			if(request->m_iRepairPathId == -1)
+			{
+				m_AbandonedCount.Add();
+			}
+			request->m_Path.Clear();
+			CompleteRequest(request, REQUEST_FAILED);
+		}
+	}
+}
+
+void RaigClient::RaigClientImpl::AddObserver(base::Observer *observer)
+{
+	if(std::find(m_vObservers.begin(), m_vObservers.end(), observer) == m_vObservers.end())
+	{
+		m_vObservers.push_back(observer);
+	}
+}
+
+void RaigClient::RaigClientImpl::RemoveObserver(base::Observer *observer)
+{
+	m_vObservers.erase(std::remove(m_vObservers.begin(), m_vObservers.end(), observer), m_vObservers.end());
+}
+
+void RaigClient::RaigClientImpl::Notify(base::Event::Type type)
+{
+	for(size_t i = 0; i < m_vObservers.size(); i++)
+	{
+		m_vObservers[i]->onNotify(&m_PathNode, base::Event(type));
+	}
+}
+
+void RaigClient::RaigClientImpl::NotifyNode(PathRequest *request, const base::Vector3 &node)
+{
+	if(m_vObservers.empty() || request->m_iRepairPathId != -1)
+	{
+		return;
+	}
+
+	m_PathNode.m_iRequestId = request->m_iId;
+	m_PathNode.m_Location = node;
+	m_PathNode.m_bIsComplete = false;
+	Notify(base::Event::NODE);
+}
+
+void RaigClient::RaigClientImpl::AddNode(PathRequest *request, const base::Vector3 &node)
+{
+	if(!request->m_Path.IsEmpty())
+	{
+		// Step from the end of the path the node joins towards the node, a
+		// corner is reached from the one before in a straight line
+		const base::Vector3 *nodes = request->m_Path.GetData();
+		base::Vector3 cell = request->m_bIsForward ? nodes[request->m_Path.GetSize() - 1] : nodes[0];
+		int stepX = node.m_iX > cell.m_iX ? 1 : (node.m_iX < cell.m_iX ? -1 : 0);
+		int stepZ = node.m_iZ > cell.m_iZ ? 1 : (node.m_iZ < cell.m_iZ ? -1 : 0);
+		int stepId = node.m_iId > cell.m_iId ? 1 : -1;
+
+		while(abs(node.m_iX - cell.m_iX) > 1 || abs(node.m_iZ - cell.m_iZ) > 1)
+		{
+			cell.m_iX += cell.m_iX != node.m_iX ? stepX : 0;
+			cell.m_iZ += cell.m_iZ != node.m_iZ ? stepZ : 0;
+			cell.m_iId += stepId;
+
+			AddPathNode(request, cell);
+		}
+	}
+
+	AddPathNode(request, node);
+}
+
+void RaigClient::RaigClientImpl::AddPathNode(PathRequest *request, const base::Vector3 &node)
+{
+	if(request->m_bIsForward)
+	{
+		request->m_Path.Append(&node, 1);
+	}
+	else
+	{
+		request->m_Path.PushFront(node);
+	}
+	NotifyNode(request, node);
+}
+
+void RaigClient::RaigClientImpl::DispatchFinishedRequests()
+{
+	// Callbacks may make requests that finish straight away, those are
+	// dispatched in the same pass
+	for(size_t i = 0; i < m_vFinishedRequests.size(); i++)
+	{
+		PathRequest *request = GetRequest(m_vFinishedRequests[i]);
+		if(request == NULL)
+		{
+			// Slot reused before the dispatch
+			continue;
+		}
+
+		bool isComplete = request->m_eState == REQUEST_COMPLETE;
+		if(request->m_Callback != NULL)
+		{
+			request->m_Callback(request->m_iId, isComplete, request->m_pUserData);
+		}
+
+		m_PathNode.m_iRequestId = request->m_iId;
+		m_PathNode.m_bIsComplete = isComplete;
+		Notify(base::Event::FINISH);
+	}
+
+	m_vFinishedRequests.clear();
+}
+
+void RaigClient::RaigClientImpl::SetSendHighWaterMark(size_t bytes)
+{
+	m_uSendHighWaterMark = bytes;
+	for(size_t i = 0; i < m_vServers.size(); i++)
+	{
+		m_vServers[i]->m_NetManager->SetHighWaterMark(bytes);
+	}
+}
+
+int RaigClient::RaigClientImpl::Flush()
+{
+	// Pending cell updates go out with the queued requests
+	FlushCellUpdates();
+
+	int queued = 0;
+	bool isFailed = m_vServers.empty();
+	for(size_t i = 0; i < m_vServers.size(); i++)
+	{
+		int result = m_vServers[i]->m_NetManager->Flush();
+		if(result < 0)
+		{
+			isFailed = true;
+		}
+		else
+		{
+			queued += result;
+		}
+	}
+
+	return isFailed ? -1 : queued;
+}
+
+void RaigClient::RaigClientImpl::Update()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Send the cell updates made since the last frame
+	FlushCellUpdates();
+
+	RepairTrackedPaths();
+
+	RefinePaths();
+
+	ReceivePackets();
+
+	DispatchFinishedRequests();
+
+	// Everything queued this frame goes out together
+	for(size_t i = 0; i < m_vServers.size(); i++)
+	{
+		m_vServers[i]->m_NetManager->Flush();
+	}
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	m_UpdateTime.Record(std::chrono::duration_cast<std::chrono::microseconds>(now - start).count());
+
+	if(m_iStatsDumpMs > 0 && now >= m_NextStatsDump)
+	{
+		m_NextStatsDump = now + std::chrono::milliseconds(m_iStatsDumpMs);
+
+		Stats stats = GetStats();
+		if(m_StatsCallback != NULL)
+		{
+			m_StatsCallback(stats, m_pStatsUserData);
+		}
+		else
+		{
+			PrintStats(stats);
+		}
+	}
+}
+
+RaigClient::Stats RaigClient::RaigClientImpl::GetStats()
+{
+	Stats stats;
+	CopyHistogram(m_RequestLatency, &stats.m_RequestLatency);
+	CopyHistogram(m_PathNodes, &stats.m_PathNodes);
+	CopyHistogram(m_UpdateTime, &stats.m_UpdateTime);
+
+	stats.m_uRequests = m_RequestCount.Get();
+	stats.m_uCompleted = m_CompletedCount.Get();
+	stats.m_uFailed = m_FailedCount.Get();
+	stats.m_uDropped = m_DroppedCount.Get();
+	stats.m_uAbandoned = m_AbandonedCount.Get();
+
+	stats.m_uBytesSent = 0;
+	stats.m_uBytesReceived = 0;
+	stats.m_uSendCalls = 0;
+	stats.m_uRecvCalls = 0;
+	stats.m_uReconnects = 0;
+	stats.m_uConnectFailures = 0;
+	stats.m_uDroppedSends = 0;
+	stats.m_uSendQueueBytes = 0;
+	stats.m_iPendingRequests = 0;
+
+	const http::HttpDao::Counters &telemetry = m_Telemetry.GetCounters();
+	stats.m_uTelemetryPosted = telemetry.m_Posted.Get();
+	stats.m_uTelemetryDropped = telemetry.m_Dropped.Get();
+
+	for(size_t i = 0; i < m_vServers.size(); i++)
+	{
+		Server *server = m_vServers[i].get();
+		const net::NetManager::Counters &counters = server->m_NetManager->GetCounters();
+
+		stats.m_uBytesSent += counters.m_BytesSent.Get();
+		stats.m_uBytesReceived += counters.m_BytesReceived.Get();
+		stats.m_uSendCalls += counters.m_SendCalls.Get();
+		stats.m_uRecvCalls += counters.m_RecvCalls.Get();
+		stats.m_uConnectFailures += counters.m_ConnectFailures.Get();
+		stats.m_uDroppedSends += counters.m_DroppedSends.Get();
+
+		// Every connection after the first is a reconnect
+		uint64_t connects = counters.m_Connects.Get();
+		stats.m_uReconnects += connects > 1 ? connects - 1 : 0;
+
+		stats.m_uSendQueueBytes += server->m_NetManager->GetSendQueueSize();
+		stats.m_iPendingRequests += (int)server->m_PendingRequests.size();
+	}
+
+	return stats;
+}
+
+void RaigClient::RaigClientImpl::SetStatsDump(int intervalMs, StatsCallback callback, void *userData)
+{
+	m_iStatsDumpMs = intervalMs;
+	m_StatsCallback = callback;
+	m_pStatsUserData = userData;
+	m_NextStatsDump = std::chrono::steady_clock::now() + std::chrono::milliseconds(intervalMs);
+}
+
+bool RaigClient::RaigClientImpl::SetTelemetry(const std::string &url, int intervalMs, int batchEvents)
+{
+	if(url.empty())
+	{
+		m_Telemetry.Stop();
+		return true;
+	}
+
+	return m_Telemetry.Start(url, intervalMs, batchEvents);
+}
+
+void RaigClient::RaigClientImpl::PrintStats(const Stats &stats)
+{
+	const StatsHistogram &latency = stats.m_RequestLatency;
+	const StatsHistogram &update = stats.m_UpdateTime;
+
+	RAIG_LOG_INFO("requests %llu complete %llu failed %llu dropped %llu abandoned %llu pending %d",
+		(unsigned long long)stats.m_uRequests, (unsigned long long)stats.m_uCompleted, (unsigned long long)stats.m_uFailed,
+		(unsigned long long)stats.m_uDropped, (unsigned long long)stats.m_uAbandoned, stats.m_iPendingRequests);
+	RAIG_LOG_INFO("latency us p50 <=%llu p99 <=%llu max %llu, nodes per path avg %.1f, update us avg %.1f max %llu",
+		(unsigned long long)GetPercentile(latency, 0.5), (unsigned long long)GetPercentile(latency, 0.99), (unsigned long long)latency.m_uMax,
+		stats.m_PathNodes.m_uCount > 0 ? (double)stats.m_PathNodes.m_uSum / stats.m_PathNodes.m_uCount : 0.0,
+		update.m_uCount > 0 ? (double)update.m_uSum / update.m_uCount : 0.0, (unsigned long long)update.m_uMax);
+	RAIG_LOG_INFO("sent %llu bytes in %llu calls, received %llu bytes in %llu calls, queued %llu bytes, reconnects %llu",
+		(unsigned long long)stats.m_uBytesSent, (unsigned long long)stats.m_uSendCalls, (unsigned long long)stats.m_uBytesReceived,
+		(unsigned long long)stats.m_uRecvCalls, (unsigned long long)stats.m_uSendQueueBytes, (unsigned long long)stats.m_uReconnects);
+}
+
+void RaigClient::RaigClientImpl::ReceivePackets()
+{
+	if(m_bIsThreaded)
+	{
+		for(size_t i = 0; i < m_vServers.size(); i++)
+		{
+			ReceiveQueuedPackets(m_vServers[i].get());
+		}
+		CheckResyncTimeouts();
+		return;
+	}
+
+	// Only the sockets with data are read
+	m_vReadyServers.resize(m_vServers.size());
+	int ready = m_vServers.empty() ? 0 : m_Poller.Wait(&m_vReadyServers[0], (int)m_vReadyServers.size(), 0);
+	for(int i = 0; i < ready; i++)
+	{
+		ReceiveServerPackets(m_vReadyServers[i]);
+	}
+
+	for(size_t i = 0; i < m_vServers.size(); i++)
+	{
+		Server *server = m_vServers[i].get();
+
+		// Re-connect to server, the attempts are spaced out by the net
+		// manager and never block the update
+		if(server->m_NetManager->GetState() != net::NetManager::CONNECTED)
+		{
+			// Requests sent on the lost connection will never be answered
+			AbandonPendingRequests(server);
+
+			m_Poller.Unwatch((int)i);
+			if(server->m_NetManager->Reconnect())
+			{
+				RAIG_LOG_INFO("Re-connection successful");
+				m_Poller.Watch((int)i, server->m_NetManager->GetSocket());
+				BeginResync(server);
+			}
+		}
+	}
+
+	CheckResyncTimeouts();
+}
+
+void RaigClient::RaigClientImpl::ReceiveServerPackets(int index)
+{
+	Server *server = m_vServers[index].get();
+
+	// Process every packet received, a whole path is handled in one update
+	const char *packet = NULL;
+	int result;
+	while((result = server->m_NetManager->ReadPacket(&packet)) >= 0)
+	{
+		ProcessPacket(server, packet, result);
+	}
+}
+
+void RaigClient::RaigClientImpl::ReceiveQueuedPackets(Server *server)
+{
+	const char *packet = NULL;
+	int result;
+	while((result = server->m_NetManager->ReadPacket(&packet)) >= 0)
+	{
+		if(result > 0)
+		{
+			ProcessPacket(server, packet, result);
+		}
+		else if(server->m_NetManager->GetState() == net::NetManager::CONNECTED)
+		{
+			// The network thread has connected, or reconnected
+			BeginResync(server);
+		}
+		else
+		{
+			// Requests sent on the lost connection will never be answered
+			AbandonPendingRequests(server);
+		}
+	}
+}
+
+void RaigClient::RaigClientImpl::BeginResync(Server *server)
+{
+	AbandonPendingRequests(server); // Game client has reconnected to the server, old requests are lost
+
+	OfferBinaryFraming(server);
+	server->m_bIsSynced = false;
+	server->m_HelloTime = std::chrono::steady_clock::now();
+}
+
+void RaigClient::RaigClientImpl::ResyncConnection(Server *server, int heldVersion)
+{
+	server->m_bIsSynced = true;
+	if(m_iGameWorldWidth <= 0)
+	{
+		// No world yet, CreateGameWorld() sends it
+		return;
+	}
+
+	if(server->m_PacketWriter.GetFraming() == net::Packet::BINARY)
+	{
+		if(heldVersion != m_iWorldVersion)
+		{
+			SendSnapshot(server);
+		}
+		return;
+	}
+
+	// Send RAIG game world size and service type used initially, then
+	// every blocked cell
+	SendGameWorld(server);
+	SendBlockedList(server);
+}
+
+void RaigClient::RaigClientImpl::CheckResyncTimeouts()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < m_vServers.size(); i++)
+	{
+		Server *server = m_vServers[i].get();
+		if(!server->m_bIsSynced && server->m_NetManager->GetState() == net::NetManager::CONNECTED &&
+			now - server->m_HelloTime >= std::chrono::milliseconds(SERVER_HELLO_TIMEOUT_MS))
+		{
+			// The server does not know HELLO, it keeps the ASCII framing
+			ResyncConnection(server, -1);
+		}
+	}
+}
+
+void RaigClient::RaigClientImpl::ProcessPacket(Server *server, const char *packet, int size)
+{
+	if(!m_PacketReader.Parse(packet, size))
+	{
+		return;
+	}
+
+	switch(m_PacketReader.GetCode())
+	{
+	case net::Packet::HELLO:
+		// Server accepted the binary framing, packets sent from now on use it
+		if(m_PacketReader.GetField(0) >= PACKET_VERSION && server->m_PacketWriter.GetFraming() == net::Packet::ASCII)
+		{
+			server->m_PacketWriter.SetFraming(net::Packet::BINARY);
+
+			if(server->m_bIsSynced)
+			{
+				// Answered after the ASCII fallback sent the world, which
+				// the server holds without a version. Send it again whole.
+				ResyncConnection(server, -1);
+				break;
+			}
+		}
+
+		if(!server->m_bIsSynced)
+		{
+			// Version of the world the server holds, 0 if none
+			ResyncConnection(server, m_PacketReader.GetField(1));
+		}
+		break;
+
+	case net::Packet::NODE:
+	case net::Packet::END:
+	{
+		// Binary packets are tagged with the request id, ASCII packets
+		// belong to the oldest pending request
+		bool isTagged = m_PacketReader.GetFraming() == net::Packet::BINARY;
+		int field = isTagged ? 1 : 0;
+		int locationId = m_PacketReader.GetField(field++);
+		int locationX = m_PacketReader.GetField(field++);
+		int locationZ = m_PacketReader.GetField(field++);
+
+		PathRequest *request = GetReplyRequest(server, isTagged ? m_PacketReader.GetField(0) : -1);
+		if(request == NULL)
+		{
+			break;
+		}
+
+		if(m_PacketReader.GetCode() == net::Packet::NODE)
+		{
+			if(locationId == request->m_iRecvSequence)
+			{
 				// Already processed the node
-				return;
+				break;
 			}
-			m_iRecvSequence = locationId;
+			request->m_iRecvSequence = locationId;
 
-			// Add vector to the path
-			m_vPath.push_back(std::unique_ptr<base::Vector3>(new base::Vector3(locationId, locationX, 0, locationZ)));
-			ClearBuffer();
+			// The server sends the goal first unless the request is streamed
+			AddNode(request, base::Vector3(locationId, locationX, 0, locationZ));
 		}
-		else if(statusCode == RaigClientImpl::END)
+		else
 		{
-			// Parse the buffer and add the final location to the path vector
-			char *nodeId = strtok((char*)NULL, "_");
-			char *nodeX = strtok((char*)NULL, "_");
-			char *nodeZ = strtok((char*)NULL, "_");
+			// Add the final location, the path is already in order
+			AddNode(request, base::Vector3(locationId, locationX, 0, locationZ));
+			m_PathCache.Insert(request->m_Start.m_iX, request->m_Start.m_iZ, request->m_Goal.m_iX, request->m_Goal.m_iZ,
+				request->m_Path.GetData(), request->m_Path.GetSize(), request->m_uWorldVersion, m_BlockedCells);
+			if(request->m_iRepairPathId != -1)
+			{
+				CompleteRepair(request);
+			}
+			CompleteRequest(request, REQUEST_COMPLETE); // Received an END packet, the slot can be reused
+		}
+		break;
+	}
 
-			int locationId = std::atoi(nodeId);
-			int locationX = std::atoi(nodeX);
-			int locationZ = std::atoi(nodeZ);
+	case net::Packet::EMPTY:
+	{
+		// The server found no path, the request fails and is not cached
+		bool isTagged = m_PacketReader.GetFraming() == net::Packet::BINARY;
+		PathRequest *request = GetReplyRequest(server, isTagged ? m_PacketReader.GetField(0) : -1);
+		if(request == NULL)
+		{
+			break;
+		}
 
-			// Add vector to the path
-			m_vPath.push_back(std::unique_ptr<base::Vector3>(new base::Vector3(locationId, locationX, 0, locationZ)));
-			std::reverse(m_vPath.begin(), m_vPath.end()); // Reverse path before client game uses it
-			m_vCompletedPath = std::move(m_vPath);
-			m_bIsReqestComplete = true; // Received an END packet, allow more requests
-			ClearBuffer();
+		request->m_Path.Clear();
+		if(request->m_iRepairPathId != -1)
+		{
+			FailRepair(request);
 		}
+		CompleteRequest(request, REQUEST_FAILED);
+		break;
+	}
+
+	default:
+		break;
 	}
 }
 
 void RaigClient::RaigClientImpl::CleanUp()
 {
-	m_vPath.clear();
-	m_vBlockedCells.clear();
-	m_vCompletedPath.clear();
-	Close(m_iSocketFileDescriptor);
+	for(int i = 0; i < MAX_PENDING_REQUESTS; i++)
+	{
+		m_Requests[i].m_Path.Clear();
+	}
+	for(size_t i = 0; i < m_vServers.size(); i++)
+	{
+		m_vServers[i]->m_PendingRequests.clear();
+		m_vServers[i]->m_NetManager->CleanUp();
+	}
+	m_BlockedCells.Clear();
 }
 
 } // namespace raig
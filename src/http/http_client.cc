@@ -3,65 +3,473 @@
 // found in the LICENSE file.
 // https://github.com/damorton/libraig.git
 
-#include "http_client.h"
+#include "http/http_client.h"
 
-#include <sstream>
+#ifdef _WIN32
+#include <winsock2.h> // setsockopt()
+#else
+#include <fcntl.h> // fcntl()
+#include <netdb.h> // getaddrinfo()
+#include <poll.h> // poll()
+#include <sys/socket.h> // setsockopt()
+#include <sys/time.h> // timeval
+#endif
+#include <cctype> // tolower()
+#include <cerrno> // errno
+#include <cstdlib> // atoi()
+#include <cstring> // strlen()
+#include <sstream> // stringstream
 
-//#include "curl/curl.h"
+#include "libsocket/include/socket.h" // libsocket
 
 namespace http{
 
 HttpDao::HttpDao()
+	: m_Queue(HTTP_QUEUE_SIZE)
 {
+	m_iQueuedEvents = 0;
+	m_bIsRunning = false;
+	m_bIsStopping = false;
+	m_bIsWoken = false;
+	m_iIntervalMs = HTTP_DEFAULT_INTERVAL_MS;
+	m_iBatchEvents = HTTP_DEFAULT_BATCH_EVENTS;
+	m_iSocketFileDescriptor = -1;
+}
 
+HttpDao::~HttpDao()
+{
+	Stop();
 }
 
-void HttpDao::Create(std::string username, std::string password)
+bool HttpDao::ParseUrl(const std::string &url, std::string *host, std::string *service, std::string *path)
+{
+	const char *scheme = "http://";
+	size_t schemeSize = strlen(scheme);
+	if(url.size() <= schemeSize || url.compare(0, schemeSize, scheme) != 0)
+	{
+		return false;
+	}
+
+	size_t slash = url.find('/', schemeSize);
+	std::string authority = url.substr(schemeSize, slash == std::string::npos ? std::string::npos : slash - schemeSize);
+	*path = slash == std::string::npos ? "/" : url.substr(slash);
+
+	size_t colon = authority.rfind(':');
+	if(colon == std::string::npos)
+	{
+		*host = authority;
+		*service = "80";
+	}
+	else
+	{
+		*host = authority.substr(0, colon);
+		*service = authority.substr(colon + 1);
+	}
+
+	return !host->empty() && !service->empty();
+}
+
+bool HttpDao::Start(const std::string &url, int intervalMs, int batchEvents)
 {
-	/*
-	CURL *curl;
-	CURLcode res;
+	Stop();
 
-	curl_global_init(CURL_GLOBAL_ALL);
-	curl = curl_easy_init();
+	if(!ParseUrl(url, &m_strHost, &m_strService, &m_strPath))
+	{
+		return false;
+	}
+	m_iIntervalMs = intervalMs > 0 ? intervalMs : HTTP_DEFAULT_INTERVAL_MS;
+	m_iBatchEvents = batchEvents > 0 ? batchEvents : HTTP_DEFAULT_BATCH_EVENTS;
+
+	// Events left from the last run were dropped when it stopped
+	m_Queue.Clear();
+	m_iQueuedEvents = 0;
+	m_bIsStopping = false;
+	m_bIsWoken = false;
+
+	m_bIsRunning = true;
+	m_Thread = std::thread(&HttpDao::RunThread, this);
+	return true;
+}
+
+void HttpDao::Stop()
+{
+	if(!m_Thread.joinable())
+	{
+		return;
+	}
+
+	m_bIsRunning = false;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bIsStopping = true;
+	}
+	m_Condition.notify_one();
+	m_Thread.join();
+}
 
+bool HttpDao::Record(const char *event, size_t size)
+{
+	if(!m_bIsRunning || size > HTTP_MAX_EVENT_SIZE || !m_Queue.Push(0, event, size))
+	{
+		m_Counters.m_Dropped.Add();
+		return false;
+	}
+
+	int queued = m_iQueuedEvents.fetch_add(1, std::memory_order_relaxed);
+	m_Counters.m_Queued.Add();
+
+	// The uploader sleeps until the first event and then until the
+	// interval, only a full batch needs it sooner
+	if(queued == 0 || queued + 1 == m_iBatchEvents)
+	{
+		Wake();
+	}
+	return true;
+}
+
+void HttpDao::Wake()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bIsWoken = true;
+	}
+	m_Condition.notify_one();
+}
+
+void HttpDao::Create(std::string username, std::string password)
+{
 	std::stringstream ss;
 	ss << "text=" << username << "&" << "complete=" << password;
-	std::string data = ss.str();
+	Record(ss.str());
+}
 
-	if(curl) {
-	// First set the URL that is about to receive our POST. This URL can just as well be a https:// URL if that is what should receive the data. 
-	curl_easy_setopt(curl, CURLOPT_URL, "https://raig-dashboard.herokuapp.com/api/v1/raig");
-	// Now specify the POST data 
-	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
+void HttpDao::RunThread()
+{
+	Clock::time_point postTime = Clock::now() + std::chrono::milliseconds(m_iIntervalMs);
+
+	bool isStopping = false;
+	while(!isStopping)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			int queued = m_iQueuedEvents.load(std::memory_order_relaxed);
+			if(queued == 0)
+			{
+				m_Condition.wait(lock, [this]{ return m_bIsWoken || m_bIsStopping; });
+
+				// The first event waits for a whole interval
+				postTime = Clock::now() + std::chrono::milliseconds(m_iIntervalMs);
+			}
+			else if(queued < m_iBatchEvents)
+			{
+				m_Condition.wait_until(lock, postTime, [this]{ return m_bIsWoken || m_bIsStopping; });
+			}
+			m_bIsWoken = false;
+			isStopping = m_bIsStopping;
+		}
 
-	// Perform the request, res will get the return code 
-	// res = curl_easy_perform(curl);
-	// Check for errors 
-	if(res != CURLE_OK)
-	  fprintf(stderr, "curl_easy_perform() failed: %s\n",
-			  curl_easy_strerror(res));
+		// A full batch goes at once, a partial one waits for the interval.
+		// Once stopping everything queued goes, unless a post fails.
+		while(m_iQueuedEvents.load(std::memory_order_relaxed) >= m_iBatchEvents || (Clock::now() >= postTime && !m_Queue.IsEmpty()) || (isStopping && !m_Queue.IsEmpty()))
+		{
+			int events = TakeBatch();
+			if(Post())
+			{
+				m_Counters.m_Posted.Add(events);
+			}
+			else
+			{
+				m_Counters.m_PostFailures.Add();
+				m_Counters.m_Dropped.Add(events);
 
-	// always cleanup 
-	curl_easy_cleanup(curl);
+				// Each batch left would wait as long on the endpoint
+				while(isStopping && (events = TakeBatch()) > 0)
+				{
+					m_Counters.m_Dropped.Add(events);
+				}
+			}
+			m_Counters.m_Posts.Add();
+			postTime = Clock::now() + std::chrono::milliseconds(m_iIntervalMs);
+		}
 	}
-	curl_global_cleanup();
-	*/
+
+	Disconnect();
 }
 
-void HttpDao::Read()
+int HttpDao::TakeBatch()
 {
+	m_strBody.clear();
+
+	int events = 0;
+	uint32_t tag;
+	while(events < m_iBatchEvents && m_Queue.Pop(&tag, &m_vEvent))
+	{
+		if(!m_vEvent.empty())
+		{
+			m_strBody.append(&m_vEvent[0], m_vEvent.size());
+		}
+		m_strBody.push_back('\n');
+		events++;
+	}
+	m_iQueuedEvents.fetch_sub(events, std::memory_order_relaxed);
 
+	return events;
 }
 
-void HttpDao::Update()
+bool HttpDao::Post()
 {
+	std::stringstream ss;
+	ss << "POST " << m_strPath << " HTTP/1.1\r\n"
+		<< "Host: " << m_strHost << "\r\n"
+		<< "Content-Type: text/plain\r\n"
+		<< "Content-Length: " << m_strBody.size() << "\r\n"
+		<< "Connection: keep-alive\r\n"
+		<< "\r\n";
+	m_strRequest = ss.str();
+	m_strRequest.append(m_strBody);
+
+	// A kept alive connection may have been closed by the endpoint since
+	// the last post, that post is tried once more on a new connection
+	for(int attempt = 0; attempt < 2; attempt++)
+	{
+		bool isReused = m_iSocketFileDescriptor != -1;
+		if(!isReused && !Connect())
+		{
+			return false;
+		}
+
+		int status = -1;
+		if(SendAll(m_strRequest.c_str(), m_strRequest.size()))
+		{
+			status = ReadResponse();
+		}
+		if(status != -1)
+		{
+			return status >= 200 && status < 300;
+		}
+
+		Disconnect();
+		if(!isReused)
+		{
+			return false;
+		}
+	}
 
+	return false;
 }
 
-void HttpDao::Delete()
+bool HttpDao::Connect()
 {
+#ifdef _WIN32
+	m_iSocketFileDescriptor = Connection(m_strHost.c_str(), m_strService.c_str(), TYPE_CLIENT, SOCK_STREAM);
+#else
+	m_iSocketFileDescriptor = ConnectWithin(HTTP_TIMEOUT_MS);
+#endif
+	if(m_iSocketFileDescriptor < 0)
+	{
+		m_iSocketFileDescriptor = -1;
+		return false;
+	}
+
+	// A stalled endpoint fails the post instead of holding the uploader
+#ifdef _WIN32
+	DWORD timeout = HTTP_TIMEOUT_MS;
+#else
+	struct timeval timeout;
+	timeout.tv_sec = HTTP_TIMEOUT_MS / 1000;
+	timeout.tv_usec = (HTTP_TIMEOUT_MS % 1000) * 1000;
+#endif
+	setsockopt(m_iSocketFileDescriptor, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+	setsockopt(m_iSocketFileDescriptor, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+
+	return true;
+}
+
+#ifndef _WIN32
+int HttpDao::ConnectWithin(int timeoutMs)
+{
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	struct addrinfo *addresses = NULL;
+	if(getaddrinfo(m_strHost.c_str(), m_strService.c_str(), &hints, &addresses) != 0)
+	{
+		return -1;
+	}
+
+	// The addresses share the timeout
+	Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+	int result = -1;
+	for(struct addrinfo *address = addresses; address != NULL && result == -1; address = address->ai_next)
+	{
+		int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if(fd == -1)
+		{
+			continue;
+		}
+
+		int flags = fcntl(fd, F_GETFL, 0);
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+		bool isConnected = connect(fd, address->ai_addr, address->ai_addrlen) == 0;
+		if(!isConnected && errno == EINPROGRESS)
+		{
+			int remainingMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+
+			struct pollfd descriptor;
+			descriptor.fd = fd;
+			descriptor.events = POLLOUT;
+			descriptor.revents = 0;
+
+			// Writable once the connect has finished, SO_ERROR tells how
+			int error = 0;
+			socklen_t size = sizeof(error);
+			isConnected = remainingMs > 0 && poll(&descriptor, 1, remainingMs) == 1
+				&& getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size) == 0 && error == 0;
+		}
+
+		if(isConnected)
+		{
+			// The sends and recvs block, bounded by their own timeouts
+			fcntl(fd, F_SETFL, flags);
+			result = fd;
+		}
+		else
+		{
+			Close(fd);
+		}
+	}
+
+	freeaddrinfo(addresses);
+	return result;
+}
+#endif
+
+void HttpDao::Disconnect()
+{
+	if(m_iSocketFileDescriptor != -1)
+	{
+		Close(m_iSocketFileDescriptor);
+		m_iSocketFileDescriptor = -1;
+	}
+}
+
+bool HttpDao::SendAll(const char *data, size_t size)
+{
+	int flags = 0;
+#ifdef MSG_NOSIGNAL
+	// A closed connection fails the send instead of raising SIGPIPE
+	flags = MSG_NOSIGNAL;
+#endif
+
+	while(size > 0)
+	{
+		int bytesSent = Send(m_iSocketFileDescriptor, const_cast<char*>(data), size, flags);
+		if(bytesSent <= 0)
+		{
+			return false;
+		}
+		m_Counters.m_BytesSent.Add(bytesSent);
+		data += bytesSent;
+		size -= bytesSent;
+	}
+
+	return true;
+}
+
+// Case-insensitive compare of the start of a header line
+static bool IsHeader(const std::string &headers, size_t position, const char *name)
+{
+	for(; *name != '\0'; name++, position++)
+	{
+		if(position >= headers.size() || tolower((unsigned char)headers[position]) != *name)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int HttpDao::ReadResponse()
+{
+	m_strResponse.clear();
+
+	char data[1024];
+	size_t headerSize = std::string::npos;
+	while(headerSize == std::string::npos)
+	{
+		int bytesRecv = Recv(m_iSocketFileDescriptor, data, sizeof(data), 0);
+		if(bytesRecv <= 0 || m_strResponse.size() + bytesRecv > HTTP_MAX_RESPONSE_SIZE)
+		{
+			return -1;
+		}
+		m_strResponse.append(data, bytesRecv);
+
+		size_t end = m_strResponse.find("\r\n\r\n");
+		if(end != std::string::npos)
+		{
+			headerSize = end + 4;
+		}
+	}
+
+	// HTTP/1.1 200 OK
+	if(m_strResponse.compare(0, 5, "HTTP/") != 0)
+	{
+		return -1;
+	}
+	size_t space = m_strResponse.find(' ');
+	if(space == std::string::npos || space > headerSize)
+	{
+		return -1;
+	}
+	int status = atoi(m_strResponse.c_str() + space + 1);
+
+	// Without a length the body runs to the end of the connection, it is
+	// not read and the connection is closed after this response
+	long contentLength = -1;
+	bool isKeptAlive = m_strResponse.compare(0, 8, "HTTP/1.0") != 0;
+	for(size_t line = m_strResponse.find("\r\n") + 2; line < headerSize - 2; line = m_strResponse.find("\r\n", line) + 2)
+	{
+		if(IsHeader(m_strResponse, line, "content-length:"))
+		{
+			contentLength = atol(m_strResponse.c_str() + line + strlen("content-length:"));
+		}
+		else if(IsHeader(m_strResponse, line, "connection:"))
+		{
+			size_t value = m_strResponse.find_first_not_of(' ', line + strlen("connection:"));
+			isKeptAlive = IsHeader(m_strResponse, value, "keep-alive");
+		}
+	}
+	if(status == 204 || status == 304)
+	{
+		contentLength = 0;
+	}
+
+	if(contentLength < 0 || contentLength > HTTP_MAX_RESPONSE_SIZE)
+	{
+		isKeptAlive = false;
+	}
+	else
+	{
+		size_t responseSize = headerSize + contentLength;
+		while(m_strResponse.size() < responseSize)
+		{
+			int bytesRecv = Recv(m_iSocketFileDescriptor, data, sizeof(data), 0);
+			if(bytesRecv <= 0)
+			{
+				return -1;
+			}
+			m_strResponse.append(data, bytesRecv);
+		}
+	}
+
+	if(!isKeptAlive)
+	{
+		Disconnect();
+	}
 
+	return status;
 }
 
 } // namespace http
@@ -6,18 +6,139 @@
 #ifndef HTTP_CLIENT_H
 #define HTTP_CLIENT_H
 
-#include <memory>
-#include <string>
+#include <stddef.h> // size_t
+
+#include <atomic> // atomic<>()
+#include <chrono> // steady_clock
+#include <condition_variable> // condition_variable
+#include <mutex> // mutex
+#include <string> // string
+#include <thread> // thread
+#include <vector> // vector<>()
+
+#include "base/spsc_ring.h"
+#include "base/stats.h"
 
 namespace http{
 
+#define HTTP_QUEUE_SIZE (256 * 1024) // Bytes of events waiting for the uploader
+#define HTTP_MAX_EVENT_SIZE 1024 // Longer events are dropped
+#define HTTP_DEFAULT_INTERVAL_MS 1000 // Longest wait before queued events are posted
+#define HTTP_DEFAULT_BATCH_EVENTS 256 // Events that are posted without waiting
+#define HTTP_TIMEOUT_MS 2000 // Longest wait on the connect and each send or recv to the endpoint
+#define HTTP_MAX_RESPONSE_SIZE (64 * 1024) // Larger responses close the connection
+
+// Telemetry uploader. Events are short lines such as "type=path&id=3"
+// recorded on the game thread into a lock-free ring. A background thread
+// takes them out and posts them, one per line, in a single HTTP/1.1 POST
+// every intervalMs or as soon as batchEvents are waiting, over a connection
+// kept alive between posts. Record() never blocks or allocates: when the
+// ring is full, because the endpoint is slow or down, the event is dropped
+// and counted. A batch whose post fails is dropped as well.
+//
+// Only http:// endpoints, the library has no TLS. Post to a collector on
+// the local network or to a relay in front of an https endpoint.
 class HttpDao {
 public:
+
+	// Readable from any thread
+	struct Counters{
+		base::Counter m_Queued; // Events accepted by Record()
+		base::Counter m_Dropped; // Events not queued, or lost with a failed post
+		base::Counter m_Posted; // Events in a post the endpoint accepted
+		base::Counter m_Posts;
+		base::Counter m_PostFailures; // No connection, timeout or not a 2xx response
+		base::Counter m_BytesSent;
+	};
+
 	HttpDao();
+
+	// Stops the uploader, see Stop()
+	~HttpDao();
+
+	// Starts the uploader thread posting to url, http://host[:port][/path].
+	// Stops the previous uploader first. Returns false, and leaves the
+	// uploader stopped, if url is not an http:// url.
+	bool Start(const std::string &url, int intervalMs, int batchEvents);
+
+	// Posts the events still queued and stops the uploader thread. Once a
+	// post fails the events left are dropped, so a stalled endpoint holds
+	// it for one post.
+	void Stop();
+
+	bool IsRunning() const { return m_bIsRunning; }
+
+	// Queues one event, one thread only. Returns false if it was dropped
+	// because the uploader is not running, the event is longer than
+	// HTTP_MAX_EVENT_SIZE or the queue is full.
+	bool Record(const char *event, size_t size);
+
+	bool Record(const std::string &event){ return Record(event.c_str(), event.size()); }
+
+	// Records the event of the original dashboard, text=username&complete=password
 	void Create(std::string username, std::string password);
-	void Read();
-	void Update();
-	void Delete();
+
+	const Counters &GetCounters() const { return m_Counters; }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	// Splits url into the host, port and path of the request
+	static bool ParseUrl(const std::string &url, std::string *host, std::string *service, std::string *path);
+
+	void RunThread();
+
+	void Wake();
+
+	// Moves up to m_iBatchEvents queued events into m_strBody. Returns the
+	// number of events.
+	int TakeBatch();
+
+	// Sends m_strBody and reads the response. Returns true on a 2xx status.
+	bool Post();
+
+	bool Connect();
+
+	// Non-blocking connect to m_strHost waiting up to timeoutMs, the socket
+	// is returned blocking. Returns the socket or -1.
+	int ConnectWithin(int timeoutMs);
+
+	void Disconnect();
+
+	bool SendAll(const char *data, size_t size);
+
+	// Reads one response, leaves the connection open if the endpoint keeps
+	// it alive. Returns the status code or -1.
+	int ReadResponse();
+
+	base::SpscRing m_Queue;
+
+	// Events in m_Queue, the uploader posts early once there are enough
+	std::atomic<int> m_iQueuedEvents;
+
+	std::thread m_Thread;
+	std::atomic<bool> m_bIsRunning;
+
+	// Wakes the uploader thread when it is stopped, when the queue is no
+	// longer empty and when a batch is full
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	bool m_bIsStopping;
+	bool m_bIsWoken;
+
+	// Only used by the uploader thread while it runs
+	std::string m_strHost;
+	std::string m_strService;
+	std::string m_strPath;
+	int m_iIntervalMs;
+	int m_iBatchEvents;
+	int m_iSocketFileDescriptor;
+	std::string m_strBody;
+	std::string m_strRequest;
+	std::vector<char> m_vEvent;
+	std::string m_strResponse;
+
+	Counters m_Counters;
 };
 
 } // namespace http
@@ -5,27 +5,109 @@
 
 #include "net/net_manager.h"
 
+#include <cerrno> // errno
+#ifdef _WIN32
+#include <winsock2.h> // setsockopt()
+#else
+#include <netdb.h> // getaddrinfo()
+#include <netinet/in.h> // IPPROTO_TCP
+#include <netinet/tcp.h> // TCP_NODELAY
+#include <poll.h> // poll()
+#include <sys/socket.h> // sendmsg()
+#include <sys/uio.h> // iovec
+#endif
+#include <chrono> // milliseconds
 #include <cstring> // strlen()
-#include <iostream>
 
 #include "libsocket/include/socket.h" // libsocket
+#include "base/log.h"
 
 namespace net{
 
+// Requests and cell updates are small writes the server answers straight
+// away, Nagle would hold each one back until the last was acknowledged
+static void SetNoDelay(int socket)
+{
+	int noDelay = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+}
+
 NetManager::NetManager()
 {
-	// Send data to web application
-	//std::unique_ptr<http::HttpDao> m_HttpDao (new http::HttpDao());
-	// user, password
-	//m_HttpDao->Create("David", "true");
+	m_iSocketFileDescriptor = -1;
+	m_eState = CONNECTION_FAILED;
+	m_uHighWaterMark = NET_SEND_HIGH_WATER_MARK;
+	m_iRetryDelayMs = 0;
+	m_RetryTime = Clock::now();
+	m_Random.seed((unsigned int)(Clock::now().time_since_epoch().count() ^ (uintptr_t)this));
+	m_uPacketSize = 0;
+	m_bIsThreaded = false;
+	m_bIsRunning = false;
+	m_uConnection = 0;
+	m_eQueueState = CONNECTION_FAILED;
+	m_uQueueConnection = 0;
+	m_pAddresses = NULL;
+	m_pAddress = NULL;
+}
+
+NetManager::~NetManager()
+{
+	CleanUp();
+}
+
+void NetManager::CleanUp()
+{
+	if(m_Thread.joinable())
+	{
+		// The network thread closes its socket when it stops
+		m_bIsRunning = false;
+		m_Thread.join();
+	}
+
+	if(m_iSocketFileDescriptor != -1)
+	{
+		Close(m_iSocketFileDescriptor);
+		m_iSocketFileDescriptor = -1;
+	}
+	m_eState = CONNECTION_FAILED;
+	FreeAddresses();
+}
+
+void NetManager::SetThreaded(bool isThreaded)
+{
+	if(m_Thread.joinable())
+	{
+		// The network thread already owns the socket
+		return;
+	}
+
+	m_bIsThreaded = isThreaded;
+	if(isThreaded && m_SendQueue == NULL)
+	{
+		m_SendQueue.reset(new base::SpscRing(NET_QUEUE_SIZE));
+		m_RecvQueue.reset(new base::SpscRing(NET_QUEUE_SIZE));
+	}
 }
 
 int NetManager::Init(std::shared_ptr<std::string> hostname, std::shared_ptr<std::string> service)
 {
-	printf("hostname: %s server: %s\n", hostname.get()->c_str(), service.get()->c_str());
+	if(m_bIsThreaded)
+	{
+		if(!m_Thread.joinable())
+		{
+			m_strHostname = hostname;
+			m_strService = service;
+			m_bIsRunning = true;
+			m_Thread = std::thread(&NetManager::RunThread, this);
+		}
+		return -1;
+	}
+
+	RAIG_LOG_INFO("Init() hostname: %s server: %s", hostname.get()->c_str(), service.get()->c_str());
 	// Store hostname and service for reconnection attempts
 	m_strHostname = hostname;
 	m_strService = service;
+	Resolve();
 
 	// Initialize connection to the raig server
 	// TODO: give libsocket a namespace
@@ -34,43 +116,541 @@ int NetManager::Init(std::shared_ptr<std::string> hostname, std::shared_ptr<std:
 	if(m_iSocketFileDescriptor == -1)
 	{
 		m_eState = CONNECTION_FAILED;
-		printf("InitConnection() Connection failed. Socketfd %d\n", m_iSocketFileDescriptor);
+		RAIG_LOG_WARNING("Init() Connection failed. Socketfd %d", m_iSocketFileDescriptor);
+		ScheduleRetry();
 		return -1;
 	}
 
-	std::cout << "Init() connection successful" << std::endl;
+	RAIG_LOG_INFO("Init() connection successful");
 
-	m_eState = CONNECTED;
 	SetNonBlocking(m_iSocketFileDescriptor);
+	SetNoDelay(m_iSocketFileDescriptor);
+	OnConnected();
 
 	return m_iSocketFileDescriptor;
 }
 
+bool NetManager::Reconnect()
+{
+	if(m_bIsThreaded || m_eState == CONNECTED)
+	{
+		return false;
+	}
+
+	if(m_eState == CONNECTION_FAILED)
+	{
+		if(m_iSocketFileDescriptor != -1)
+		{
+			// Socket of the lost connection
+			Close(m_iSocketFileDescriptor);
+			m_iSocketFileDescriptor = -1;
+			OnDisconnected();
+		}
+
+		if(Clock::now() < m_RetryTime)
+		{
+			return false;
+		}
+
+		m_iSocketFileDescriptor = StartConnect();
+		if(m_iSocketFileDescriptor == -1)
+		{
+			ScheduleRetry();
+			return false;
+		}
+
+		m_eState = CONNECTING;
+		m_ConnectTime = Clock::now();
+	}
+
+	int result = CheckConnect();
+	if(result == 0 && Clock::now() - m_ConnectTime < std::chrono::milliseconds(NET_CONNECT_TIMEOUT_MS))
+	{
+		return false;
+	}
+
+	if(result <= 0)
+	{
+		Close(m_iSocketFileDescriptor);
+		m_iSocketFileDescriptor = -1;
+		m_eState = CONNECTION_FAILED;
+
+		// The next address is tried at once, the backoff starts once they
+		// have all failed
+		if(!NextAddress())
+		{
+			ScheduleRetry();
+		}
+		return false;
+	}
+
+	OnConnected();
+	return true;
+}
+
+void NetManager::OnConnected()
+{
+	m_eState = CONNECTED;
+	m_Counters.m_Connects.Add();
+
+	// Start reading at a packet boundary on the new connection, data
+	// queued for the old connection is dropped
+	m_ReadBuffer.Clear();
+	m_uPacketSize = 0;
+	m_SendBuffer.Clear();
+}
+
+bool NetManager::Resolve()
+{
+	FreeAddresses();
+#ifdef _WIN32
+	return true;
+#else
+	// A lookup can block for seconds, the game thread only waits on it in
+	// Init() and in the reconnects while nothing has been found
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if(getaddrinfo(m_strHostname.get()->c_str(), m_strService.get()->c_str(), &hints, &m_pAddresses) != 0)
+	{
+		RAIG_LOG_WARNING("Resolve() could not look up %s", m_strHostname.get()->c_str());
+		m_pAddresses = NULL;
+		return false;
+	}
+	m_pAddress = m_pAddresses;
+	return true;
+#endif
+}
+
+void NetManager::FreeAddresses()
+{
+#ifndef _WIN32
+	if(m_pAddresses != NULL)
+	{
+		freeaddrinfo(m_pAddresses);
+	}
+#endif
+	m_pAddresses = NULL;
+	m_pAddress = NULL;
+}
+
+int NetManager::StartConnect()
+{
+#ifdef _WIN32
+	// Blocking connect through libsocket, CheckConnect() reports it done
+	int socket = Connection(m_strHostname.get()->c_str(), m_strService.get()->c_str(), TYPE_CLIENT, SOCK_STREAM);
+	if(socket != -1)
+	{
+		SetNonBlocking(socket);
+		SetNoDelay(socket);
+	}
+	return socket;
+#else
+	if(m_pAddresses == NULL && !Resolve())
+	{
+		return -1;
+	}
+
+	for(; m_pAddress != NULL; m_pAddress = m_pAddress->ai_next)
+	{
+		int fd = socket(m_pAddress->ai_family, m_pAddress->ai_socktype, m_pAddress->ai_protocol);
+		if(fd == -1)
+		{
+			continue;
+		}
+
+		SetNonBlocking(fd);
+		SetNoDelay(fd);
+		if(connect(fd, m_pAddress->ai_addr, m_pAddress->ai_addrlen) == 0 || errno == EINPROGRESS)
+		{
+			return fd;
+		}
+		Close(fd);
+	}
+
+	m_pAddress = m_pAddresses;
+	return -1;
+#endif
+}
+
+bool NetManager::NextAddress()
+{
+	if(m_pAddress != NULL && m_pAddress->ai_next != NULL)
+	{
+		m_pAddress = m_pAddress->ai_next;
+		return true;
+	}
+	m_pAddress = m_pAddresses;
+	return false;
+}
+
+int NetManager::CheckConnect()
+{
+#ifdef _WIN32
+	return 1;
+#else
+	struct pollfd descriptor;
+	descriptor.fd = m_iSocketFileDescriptor;
+	descriptor.events = POLLOUT;
+	descriptor.revents = 0;
+
+	int ready = poll(&descriptor, 1, 0);
+	if(ready == 0)
+	{
+		return 0;
+	}
+
+	// Writable once the connect has finished, SO_ERROR tells how
+	int error = 0;
+	socklen_t size = sizeof(error);
+	if(ready < 0 || getsockopt(m_iSocketFileDescriptor, SOL_SOCKET, SO_ERROR, &error, &size) != 0 || error != 0)
+	{
+		return -1;
+	}
+
+	return 1;
+#endif
+}
+
+void NetManager::OnDisconnected()
+{
+	Backoff();
+}
+
+int NetManager::ScheduleRetry()
+{
+	m_Counters.m_ConnectFailures.Add();
+	return Backoff();
+}
+
+int NetManager::Backoff()
+{
+	m_iRetryDelayMs = m_iRetryDelayMs == 0 ? NET_RECONNECT_MIN_DELAY_MS : m_iRetryDelayMs * 2;
+	if(m_iRetryDelayMs > NET_RECONNECT_MAX_DELAY_MS)
+	{
+		m_iRetryDelayMs = NET_RECONNECT_MAX_DELAY_MS;
+	}
+
+	// Wait between half and all of the delay
+	int delay = m_iRetryDelayMs / 2 + (int)(m_Random() % (m_iRetryDelayMs / 2 + 1));
+	m_RetryTime = Clock::now() + std::chrono::milliseconds(delay);
+	return delay;
+}
+
 int NetManager::SendData(char* buffer)
 {
-	m_SendBuffer = buffer;
-	size_t size = strlen(buffer) + 1;
+	return SendData(buffer, strlen(buffer) + 1);
+}
+
+int NetManager::SendData(char* buffer, size_t size)
+{
+	if(m_bIsThreaded)
+	{
+		if(m_eQueueState != CONNECTED || !m_SendQueue->Push(m_uQueueConnection, buffer, size))
+		{
+			m_Counters.m_DroppedSends.Add();
+			return -1;
+		}
+		return (int)size;
+	}
+
+	if(m_eState != CONNECTED)
+	{
+		m_Counters.m_DroppedSends.Add();
+		return -1;
+	}
+
+	m_SendBuffer.Write(buffer, size);
+	return (int)size;
+}
+
+int NetManager::Flush()
+{
+	if(m_bIsThreaded)
+	{
+		return 0;
+	}
+
+	if(m_eState != CONNECTED)
+	{
+		return -1;
+	}
+
+	return FlushSocket();
+}
+
+bool NetManager::IsSendQueueFull() const
+{
+	return GetSendQueueSize() >= m_uHighWaterMark;
+}
+
+size_t NetManager::GetSendQueueSize() const
+{
+	return m_bIsThreaded ? m_SendQueue->GetSize() : m_SendBuffer.GetSize();
+}
+
+int NetManager::FlushSocket()
+{
+	while(m_SendBuffer.GetSize() > 0)
+	{
+		const char *data[2];
+		size_t sizes[2];
+		int count = m_SendBuffer.GetReadSegments(data, sizes);
+
+		int bytesSent = WriteSegments(data, sizes, count);
+		m_Counters.m_SendCalls.Add();
+		if(bytesSent > 0)
+		{
+			m_Counters.m_BytesSent.Add(bytesSent);
+
+			// May be a short write, the rest is sent by the next loop
+			m_SendBuffer.Consume(bytesSent);
+			continue;
+		}
+
+		if(bytesSent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			// Kernel buffer is full, keep the data for the next flush
+			break;
+		}
+
+		m_eState = CONNECTION_FAILED;
+		return -1;
+	}
+
+	return (int)m_SendBuffer.GetSize();
+}
+
+int NetManager::WriteSegments(const char **data, const size_t *sizes, int count)
+{
+#ifdef _WIN32
+	// No vectored write through libsocket, the second run goes next call
+	return Send(m_iSocketFileDescriptor, const_cast<char*>(data[0]), sizes[0], 0);
+#else
+	struct iovec vectors[2];
+	for(int i = 0; i < count; i++)
+	{
+		vectors[i].iov_base = const_cast<char*>(data[i]);
+		vectors[i].iov_len = sizes[i];
+	}
+
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = vectors;
+	message.msg_iovlen = count;
+
 	int flags = 0;
-	int bytesSents = 0;
+#ifdef MSG_NOSIGNAL
+	// A closed connection is reported by the return value, not SIGPIPE
+	flags = MSG_NOSIGNAL;
+#endif
+
+	return (int)sendmsg(m_iSocketFileDescriptor, &message, flags);
+#endif
+}
+
+int NetManager::ReadPacket(const char **packet)
+{
+	if(!m_bIsThreaded)
+	{
+		return ReadSocketPacket(packet);
+	}
+
+	uint32_t record;
+	if(!m_RecvQueue->Pop(&record, &m_vRecvRecord))
+	{
+		return -1;
+	}
+
+	switch(record)
+	{
+	case RECORD_PACKET:
+		*packet = &m_vRecvRecord[0];
+		return (int)m_vRecvRecord.size();
+	case RECORD_CONNECTED:
+		m_eQueueState = CONNECTED;
+		m_uQueueConnection = Packet::ReadUInt32(&m_vRecvRecord[0]);
+		return 0;
+	default:
+		m_eQueueState = CONNECTION_FAILED;
+		return 0;
+	}
+}
+
+void NetManager::RunThread()
+{
+	// Packet read from the socket but not queued yet
+	const char *packet = NULL;
+	int packetSize = 0;
+
+	while(m_bIsRunning)
+	{
+		if(m_eState != CONNECTED)
+		{
+			packetSize = 0;
+
+			// Waits in short sleeps so the thread stops quickly
+			if(Clock::now() < m_RetryTime)
+			{
+				Sleep(NET_IDLE_SLEEP_MS);
+				continue;
+			}
+
+			if(!Connect())
+			{
+				continue;
+			}
+		}
+
+		bool isBusy = false;
+
+		// Take records while the socket keeps up, the rest wait in the
+		// queue and the game thread sees it fill up
+		uint32_t connection;
+		while(m_SendBuffer.GetSize() < NET_READ_SIZE && m_SendQueue->Pop(&connection, &m_vSendRecord))
+		{
+			isBusy = true;
+			if(connection == m_uConnection)
+			{
+				m_SendBuffer.Write(&m_vSendRecord[0], m_vSendRecord.size());
+			}
+		}
+
+		if(m_SendBuffer.GetSize() > 0 && FlushSocket() < 0)
+		{
+			Disconnect();
+		}
+
+		while(m_eState == CONNECTED)
+		{
+			if(packetSize == 0)
+			{
+				packetSize = ReadSocketPacket(&packet);
+				if(packetSize < 0)
+				{
+					packetSize = 0;
+					break;
+				}
+			}
+
+			if((size_t)packetSize + 64 > NET_QUEUE_SIZE)
+			{
+				RAIG_LOG_ERROR("RunThread() Packet of %d bytes does not fit the queue", packetSize);
+				Disconnect();
+				break;
+			}
+
+			if(!m_RecvQueue->Push(RECORD_PACKET, packet, packetSize))
+			{
+				// The game thread is behind, keep the packet for later
+				break;
+			}
+			packetSize = 0;
+			isBusy = true;
+		}
+
+		if(m_eState != CONNECTED && m_iSocketFileDescriptor != -1)
+		{
+			// Lost while reading
+			Disconnect();
+		}
+
+		if(!isBusy)
+		{
+			Sleep(NET_IDLE_SLEEP_MS);
+		}
+	}
+
+	if(m_iSocketFileDescriptor != -1)
+	{
+		Close(m_iSocketFileDescriptor);
+		m_iSocketFileDescriptor = -1;
+	}
+}
+
+bool NetManager::Connect()
+{
+	m_iSocketFileDescriptor = StartConnect();
+	if(m_iSocketFileDescriptor == -1)
+	{
+		ScheduleRetry();
+		return false;
+	}
+
+	// Checked in short sleeps so CleanUp() does not wait for the connect
+	int result = 0;
+	Clock::time_point connectTime = Clock::now();
+	while(m_bIsRunning && (result = CheckConnect()) == 0 && Clock::now() - connectTime < std::chrono::milliseconds(NET_CONNECT_TIMEOUT_MS))
+	{
+		Sleep(NET_IDLE_SLEEP_MS);
+	}
+
+	if(result <= 0)
+	{
+		Close(m_iSocketFileDescriptor);
+		m_iSocketFileDescriptor = -1;
+		if(m_bIsRunning && !NextAddress())
+		{
+			ScheduleRetry();
+		}
+		return false;
+	}
+
+	OnConnected();
+
+	char connection[4];
+	Packet::WriteUInt32(connection, ++m_uConnection);
+	PushRecord(RECORD_CONNECTED, connection, sizeof(connection));
+	return true;
+}
+
+void NetManager::Disconnect()
+{
+	if(m_iSocketFileDescriptor != -1)
+	{
+		Close(m_iSocketFileDescriptor);
+		m_iSocketFileDescriptor = -1;
+	}
 
-	bytesSents = Send(m_iSocketFileDescriptor, buffer, size, flags);
+	m_eState = CONNECTION_FAILED;
+	OnDisconnected();
+	PushRecord(RECORD_FAILED, NULL, 0);
+}
 
-	return bytesSents;
+void NetManager::PushRecord(Record record, const char *data, size_t size)
+{
+	while(m_bIsRunning && !m_RecvQueue->Push(record, data, size))
+	{
+		Sleep(NET_IDLE_SLEEP_MS);
+	}
+}
+
+void NetManager::Sleep(int milliseconds)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
 }
 
-int NetManager::ReadData(char* buffer, int size)
+int NetManager::ReadSocketPacket(const char **packet)
 {
-	m_ReadBuffer = buffer;
+	if(m_eState != CONNECTED)
+	{
+		return -1;
+	}
+
+	// The packet returned by the previous call has been processed
+	m_ReadBuffer.Consume(m_uPacketSize);
+	m_uPacketSize = 0;
+
 	int flags = 0;
 	int bytesRecv = 0;
-	char temp[MAX_BUFFER_SIZE] = "\0";
-	int continueReading = 1;
-
-	// Continue to loop until full TCP segment has been received and parsed. The issue here is that
-	// a segment can contain the end of one vector packet and the beginning of another which causes an
-	// error when reading partial data. The solution was to only read the full size of a packet each time
-	// from the kernel buffer. If a partial packet was received at the end of a TCP segment, reduce the number
-	// of bytes read from the kernel buffer corresponding to the end of the previous segment packet data.
+	bool isDrained = false;
+
+	// A TCP segment can contain the end of one packet and the beginning of
+	// another. Each recv call reads as much as the kernel has into the ring
+	// buffer and the packets are taken from the front one call at a time,
+	// the socket is only read again once no whole packet is buffered.
 	// Example:
 	//
 	//		20 Byte packet
@@ -79,53 +659,76 @@ int NetManager::ReadData(char* buffer, int size)
 	//		| 		20 Bytes 	|		10 Bytes		~|~		10 Bytes	|		20 Bytes 	|
 	//
 	//
-	do{
-		bytesRecv = Recv(m_iSocketFileDescriptor, buffer, size, flags);
-
-		// Normal non-blocking receive when connected
-		if(bytesRecv == -1 && m_eState == CONNECTED)
+	while(true)
+	{
+		size_t buffered = m_ReadBuffer.GetSize();
+		size_t packetSize = 0;
+		if(buffered > 0)
 		{
-			// Non blocking socket returns -1 if there is no data to read
-			// in the buffer. Returns 0 on shutdown.
-			break;
+			// The header tells ASCII and binary packets apart and gives the
+			// size of a binary packet
+			char header[PACKET_HEADER_SIZE];
+			size_t headerSize = buffered < PACKET_HEADER_SIZE ? buffered : PACKET_HEADER_SIZE;
+			m_ReadBuffer.Peek(0, header, headerSize);
+
+			packetSize = Packet::GetPacketSize(header, headerSize);
+			if(packetSize > 0 && (packetSize < PACKET_HEADER_SIZE || packetSize > MAX_PACKET_SIZE))
+			{
+				// Stream is out of sync, drop the connection
+				RAIG_LOG_ERROR("ReadPacket() Invalid packet size %d", (int)packetSize);
+				m_eState = CONNECTION_FAILED;
+				return -1;
+			}
 		}
 
-		// Server shutdown connection
-		if(bytesRecv == 0 && m_eState == CONNECTED)
+		if(packetSize > 0 && buffered >= packetSize)
 		{
-			m_eState = CONNECTION_FAILED;
+			// The server answers, the next loss is retried quickly
+			m_iRetryDelayMs = 0;
+
+			*packet = m_ReadBuffer.GetData(packetSize);
+			m_uPacketSize = packetSize;
+			return (int)packetSize;
 		}
 
-		if(m_eState == CONNECTION_FAILED)
+		if(isDrained)
 		{
-			break;
+			return -1;
 		}
 
-		if(bytesRecv > 0 && bytesRecv < MAX_BUFFER_SIZE && m_eState == CONNECTED)
-		{
-			size -= bytesRecv;
+		// Make room for the rest of a large packet
+		size_t needed = packetSize > buffered ? packetSize - buffered : 0;
+		size_t space = 0;
+		char *data = m_ReadBuffer.GetWriteSpace(needed > NET_READ_SIZE ? needed : NET_READ_SIZE, &space);
 
-			if(size > 0)
-			{
-				strcat(temp, buffer);
-				temp[bytesRecv] = '\0';
-			}
-			else
+		bytesRecv = Recv(m_iSocketFileDescriptor, data, space, flags);
+		m_Counters.m_RecvCalls.Add();
+
+		// Non blocking socket returns -1 if there is no data to read
+		// in the buffer. Returns 0 on shutdown.
+		if(bytesRecv == -1)
+		{
+			if(errno != EAGAIN && errno != EWOULDBLOCK)
 			{
-				strcat(temp, buffer);
-				strcpy(buffer, temp);
+				// Reset by the server
+				m_eState = CONNECTION_FAILED;
 			}
+			return -1;
 		}
-		else if(bytesRecv > 0)
+
+		// Server shutdown connection
+		if(bytesRecv == 0)
 		{
-			size -= bytesRecv;
+			m_eState = CONNECTION_FAILED;
+			return -1;
 		}
 
-	}while(size > 0);
+		m_ReadBuffer.CommitWrite(bytesRecv);
+		m_Counters.m_BytesReceived.Add(bytesRecv);
 
-	temp[0] = '\0';
-
-	return bytesRecv;
+		// A short read means the kernel buffer is empty
+		isDrained = (size_t)bytesRecv < space;
+	}
 }
 
 } // namespace net
@@ -6,13 +6,32 @@
 #ifndef NET_NET_MANAGER_H_
 #define NET_NET_MANAGER_H_
 
+#include <stdint.h> // uint32_t
+
+#include <atomic> // atomic<>()
+#include <chrono> // steady_clock
+#include <memory> // unique_ptr<>()
+#include <random> // minstd_rand
 #include <string> // string
+#include <thread> // thread
+#include <vector> // vector<>()
+
+#include "base/io_buffer.h"
+#include "base/spsc_ring.h"
+#include "base/stats.h"
+#include "net/packet.h"
 
-#include "http/http_client.h"
+struct addrinfo;
 
 namespace net{
 
-#define MAX_BUFFER_SIZE 13
+#define NET_READ_SIZE (16 * 1024) // Free space offered to each recv call
+#define NET_SEND_HIGH_WATER_MARK (256 * 1024) // Default send queue limit in bytes
+#define NET_QUEUE_SIZE (1 << 22) // Bytes queued each way in threaded mode
+#define NET_RECONNECT_MIN_DELAY_MS 100 // First wait after a failed connection attempt
+#define NET_RECONNECT_MAX_DELAY_MS 10000 // The wait doubles up to this
+#define NET_CONNECT_TIMEOUT_MS 5000 // A connect still in progress after this has failed
+#define NET_IDLE_SLEEP_MS 1 // Network thread sleep when there is nothing to do
 
 class NetManager {
 public:
@@ -20,38 +39,155 @@ public:
 	enum State{
 		CONNECTED,
 		CONNECTION_FAILED,
+		CONNECTING // Non-blocking connect in progress, see Reconnect()
 	};
 
-	enum PacketCode{
-		GAMEWORLD,
-		PATH,
-		NODE,
-		END,
-		EMPTY,
-		CELL_BLOCKED,
-		CELL_OPEN
+	// Each counter has one writer, the network thread counts the socket I/O
+	// in threaded mode. Readable from any thread.
+	struct Counters{
+		base::Counter m_BytesSent;
+		base::Counter m_BytesReceived;
+		base::Counter m_SendCalls;
+		base::Counter m_RecvCalls;
+		base::Counter m_Connects;
+		base::Counter m_ConnectFailures;
+		base::Counter m_DroppedSends; // SendData() calls that queued nothing
 	};
 
 	NetManager();
 
+	~NetManager();
+
+	// In threaded mode a background thread owns the socket. It connects,
+	// reconnects, sends and receives, and the calls below only move data
+	// through lock-free queues so they never block the game thread. Call
+	// before Init().
+	void SetThreaded(bool isThreaded);
+
+	bool IsThreaded() const { return m_bIsThreaded; }
+
     // Connects the application to the server at hostname using the port number service.
     // Uses the Connection() function of the libsocket library.
+    // In threaded mode starts the network thread and returns -1, the
+    // connection is made in the background.
 	int Init(std::shared_ptr<std::string> hostname, std::shared_ptr<std::string> service);
 
-	State GetState(){ return m_eState; }
+	State GetState(){ return m_bIsThreaded ? m_eQueueState : m_eState; }
+
+	// Call every update while not connected. Starts a non-blocking connect
+	// once the backoff delay has passed and checks on it on later calls, so
+	// it never blocks on the network. Failed attempts, and connections lost
+	// before the server sent a packet, wait twice as long as the last one,
+	// up to NET_RECONNECT_MAX_DELAY_MS, with random jitter so many clients
+	// do not retry in step. Returns true once, when the connection is made.
+	// The network thread reconnects by itself in threaded mode.
+	bool Reconnect();
+
+	// Socket of the connection, -1 if not connected. Owned by the network
+	// thread in threaded mode.
+	int GetSocket() const { return m_iSocketFileDescriptor; }
 
 	// send buffer to the server
 	int SendData(char* buffer);
 
-	// read data from the network into the buffer
-	int ReadData(char* buffer, int size = MAX_BUFFER_SIZE);
+	// Queues size bytes of buffer for the server, sent by the next Flush().
+	// Several packets written back to back go out together. In threaded
+	// mode -1 is returned if the queue to the network thread is full.
+	int SendData(char* buffer, size_t size);
+
+	// Writes the queued data with vectored writes until the socket would
+	// block, what the socket does not take stays queued for the next call.
+	// Returns the number of bytes still queued or -1 if the connection
+	// failed. The network thread flushes by itself in threaded mode.
+	int Flush();
+
+	// Callers should hold back new requests while the queue is at or over
+	// the high-water mark, SendData() still queues so nothing is lost
+	void SetHighWaterMark(size_t bytes){ m_uHighWaterMark = bytes; }
 
-	http::HttpDao *GetDao(){ return m_HttpDao.get(); }
+	bool IsSendQueueFull() const;
+
+	// Bytes queued and not sent yet, in threaded mode the bytes waiting for
+	// the network thread
+	size_t GetSendQueueSize() const;
+
+	const Counters &GetCounters() const { return m_Counters; }
+
+	// Reads the next packet from the network. Returns the size of the packet
+	// and points packet at it, or -1 if a whole packet has not arrived yet.
+	// The packet is valid until the next call. In threaded mode returns 0
+	// when the network thread has made or lost the connection, GetState()
+	// has the new state.
+	int ReadPacket(const char **packet);
+
+	// Stops the network thread and closes the connection, the destructor
+	// calls it
+	void CleanUp();
 
 private:
 
+	// Records queued by the network thread for the game thread
+	enum Record{
+		RECORD_PACKET,
+		RECORD_CONNECTED, // Data is the connection number
+		RECORD_FAILED
+	};
+
 	// Private members and functions
-	void CleanUp();
+	// Socket side of ReadPacket() and SendData()
+	int ReadSocketPacket(const char **packet);
+
+	int FlushSocket();
+
+	// One writev() or sendmsg() of the runs, returns the bytes written
+	int WriteSegments(const char **data, const size_t *sizes, int count);
+
+	// Network thread
+	void RunThread();
+
+	// Connects like Reconnect(), waiting for the connect in short sleeps
+	// that end once the thread is stopped. Returns false, having set the
+	// backoff, if it failed.
+	bool Connect();
+
+	void Disconnect();
+
+	// Clears the buffers for a new connection. The backoff is kept until
+	// the first packet arrives, a server that accepts and drops every
+	// connection is retried no faster than one that refuses them.
+	void OnConnected();
+
+	// Waits before reconnecting after a connection was lost
+	void OnDisconnected();
+
+	// Looks up m_strHostname once, the reconnects go through the addresses
+	// found. Returns false if none were.
+	bool Resolve();
+
+	void FreeAddresses();
+
+	// Returns a socket with a connect in progress to m_pAddress or one of
+	// the addresses after it, or -1 once none are left
+	int StartConnect();
+
+	// Moves m_pAddress past the one whose connect failed. Returns false,
+	// and goes back to the first address, if it was the last one.
+	bool NextAddress();
+
+	// Returns 1 once the connect started by StartConnect() has finished, 0
+	// while it is in progress and -1 if it failed
+	int CheckConnect();
+
+	// Waits before the next connection attempt, returns the wait
+	int ScheduleRetry();
+
+	// Doubles the backoff delay and sets m_RetryTime, returns the wait
+	int Backoff();
+
+	// Queues a connection change, waits for room so it is never lost
+	void PushRecord(Record record, const char *data, size_t size);
+
+	void Sleep(int milliseconds);
 
 	// Connection socket descriptor
 	int m_iSocketFileDescriptor;
@@ -62,11 +198,48 @@ private:
 	std::shared_ptr<std::string> m_strHostname;
 	std::shared_ptr<std::string> m_strService;
 
-    // TODO:: Implement IOBuffers to replace char* buffers
-	char* m_SendBuffer;
-	char* m_ReadBuffer;
-
-	std::unique_ptr<http::HttpDao> m_HttpDao;
+	// Addresses of m_strHostname, the connect in progress or the next one
+	// is to m_pAddress
+	struct addrinfo *m_pAddresses;
+	struct addrinfo *m_pAddress;
+
+	// Reconnection backoff
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point m_RetryTime;
+	Clock::time_point m_ConnectTime;
+	int m_iRetryDelayMs;
+	std::minstd_rand m_Random;
+
+	// Bytes queued for the socket. Written by the network thread in
+	// threaded mode.
+	base::IOBuffer m_SendBuffer;
+	size_t m_uHighWaterMark;
+
+	// Bytes received and not processed yet. m_uPacketSize is the size of
+	// the packet returned by the last ReadPacket(), consumed by the next.
+	base::IOBuffer m_ReadBuffer;
+	size_t m_uPacketSize;
+
+	Counters m_Counters;
+
+	bool m_bIsThreaded;
+	std::thread m_Thread;
+	std::atomic<bool> m_bIsRunning;
+
+	// Game thread to network thread, records are tagged with the number of
+	// the connection they were sent on. Data sent before the game thread
+	// saw a reconnect is dropped.
+	std::unique_ptr<base::SpscRing> m_SendQueue;
+	std::vector<char> m_vSendRecord;
+	uint32_t m_uConnection;
+
+	// Network thread to game thread, packets and connection changes
+	std::unique_ptr<base::SpscRing> m_RecvQueue;
+	std::vector<char> m_vRecvRecord;
+
+	// Game thread view of the connection, updated by the records read
+	State m_eQueueState;
+	uint32_t m_uQueueConnection;
 };
 
 }
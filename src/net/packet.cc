@@ -0,0 +1,268 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "net/packet.h"
+
+#include <cstdio> // snprintf()
+#include <cstring> // memchr()
+
+#include "base/log.h"
+
+namespace net{
+
+/*
+ * Packet implementation
+ */
+size_t Packet::GetPacketSize(const char *data, size_t size, size_t asciiSize)
+{
+	if(size == 0)
+	{
+		return 0;
+	}
+
+	if(!IsBinary(data))
+	{
+		return asciiSize;
+	}
+
+	if(size < PACKET_HEADER_SIZE)
+	{
+		return 0;
+	}
+
+	return PACKET_HEADER_SIZE + ReadUInt32(data + 4);
+}
+
+void Packet::WriteUInt32(char *data, uint32_t value)
+{
+	// Little-endian regardless of the host byte order
+	data[0] = (char)(value & 0xff);
+	data[1] = (char)((value >> 8) & 0xff);
+	data[2] = (char)((value >> 16) & 0xff);
+	data[3] = (char)((value >> 24) & 0xff);
+}
+
+uint32_t Packet::ReadUInt32(const char *data)
+{
+	const uint8_t *bytes = (const uint8_t*)data;
+	return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+/*
+ * PacketWriter implementation
+ */
+PacketWriter::PacketWriter()
+{
+	m_eFraming = Packet::ASCII;
+}
+
+bool PacketWriter::Write(Packet::PacketCode code, const int *fields, int count, uint8_t flags)
+{
+	if(m_eFraming == Packet::BINARY)
+	{
+		WriteBinary(code, fields, count, flags);
+		return true;
+	}
+
+	return WriteAscii(code, fields, count);
+}
+
+bool PacketWriter::WriteAscii(Packet::PacketCode code, const int *fields, int count)
+{
+	int f[PACKET_MAX_FIELDS] = { 0 };
+	for(int i = 0; i < count && i < PACKET_MAX_FIELDS; i++)
+	{
+		f[i] = fields[i];
+	}
+
+	// Digits of each field in the layouts understood by the RAIG server
+	static const int gameWorldDigits[] = { 3, 2, 2 };
+	static const int pathDigits[] = { 2, 2, 2, 2, 4 };
+	static const int helloDigits[] = { 2, 13 };
+	static const int cellDigits[] = { 2, 2, 2 };
+
+	const int *digits;
+	int digitCount;
+	switch(code)
+	{
+	case Packet::GAMEWORLD: digits = gameWorldDigits; digitCount = 3; break;
+	case Packet::PATH: digits = pathDigits; digitCount = 5; break;
+	case Packet::HELLO: digits = helloDigits; digitCount = 2; break;
+	default: digits = cellDigits; digitCount = 3; break;
+	}
+
+	// A wider or negative value would change the size of the packet and
+	// misalign every packet after it on the stream
+	for(int i = 0; i < digitCount; i++)
+	{
+		long long limit = 1;
+		for(int j = 0; j < digits[i]; j++)
+		{
+			limit *= 10;
+		}
+		if(f[i] < 0 || f[i] >= limit)
+		{
+			RAIG_LOG_ERROR("Packet %d field %d value %d does not fit the ASCII framing", (int)code, i, f[i]);
+			return false;
+		}
+	}
+
+	// Layouts padded to PACKET_ASCII_SEND_SIZE with the terminator
+	char packet[PACKET_ASCII_SEND_SIZE + 1];
+	int size;
+	switch(code)
+	{
+	case Packet::GAMEWORLD:
+		size = snprintf(packet, sizeof(packet), "%02d_%03d_%02d_%02d_000000", code, f[0], f[1], f[2]);
+		break;
+	case Packet::PATH:
+		size = snprintf(packet, sizeof(packet), "%02d_%02d_%02d_%02d_%02d_%04d", code, f[0], f[1], f[2], f[3], f[4]);
+		break;
+	case Packet::HELLO:
+		size = snprintf(packet, sizeof(packet), "%02d_%02d_%013d", code, f[0], f[1]);
+		break;
+	default:
+		size = snprintf(packet, sizeof(packet), "%02d_%02d_%02d_%02d_0000000", code, f[0], f[1], f[2]);
+		break;
+	}
+
+	if(size != PACKET_ASCII_SEND_SIZE - 1)
+	{
+		RAIG_LOG_ERROR("Packet %d does not fit the ASCII framing", (int)code);
+		return false;
+	}
+
+	m_vBuffer.insert(m_vBuffer.end(), packet, packet + PACKET_ASCII_SEND_SIZE);
+	return true;
+}
+
+void PacketWriter::WriteBinary(Packet::PacketCode code, const int *fields, int count, uint8_t flags)
+{
+	size_t offset = m_vBuffer.size();
+	m_vBuffer.resize(offset + PACKET_HEADER_SIZE + count * 4);
+
+	char *packet = &m_vBuffer[offset];
+	packet[0] = (char)PACKET_MAGIC;
+	packet[1] = (char)PACKET_VERSION;
+	packet[2] = (char)code;
+	packet[3] = (char)flags;
+	Packet::WriteUInt32(packet + 4, (uint32_t)(count * 4));
+
+	for(int i = 0; i < count; i++)
+	{
+		Packet::WriteUInt32(packet + PACKET_HEADER_SIZE + i * 4, (uint32_t)fields[i]);
+	}
+}
+
+/*
+ * PacketReader implementation
+ */
+PacketReader::PacketReader()
+{
+	m_eCode = Packet::EMPTY;
+	m_eFraming = Packet::ASCII;
+	m_uFlags = 0;
+	m_pPayload = NULL;
+	m_uPayloadSize = 0;
+	m_iFieldCount = 0;
+}
+
+bool PacketReader::Parse(const char *data, size_t size)
+{
+	m_iFieldCount = 0;
+	m_uFlags = 0;
+	m_pPayload = NULL;
+	m_uPayloadSize = 0;
+
+	if(size == 0)
+	{
+		return false;
+	}
+
+	if(Packet::IsBinary(data))
+	{
+		if(size < PACKET_HEADER_SIZE || Packet::GetPacketSize(data, size) != size)
+		{
+			return false;
+		}
+
+		m_eFraming = Packet::BINARY;
+		m_eCode = (Packet::PacketCode)(uint8_t)data[2];
+		m_uFlags = (uint8_t)data[3];
+		m_pPayload = data + PACKET_HEADER_SIZE;
+		m_uPayloadSize = size - PACKET_HEADER_SIZE;
+		m_iFieldCount = (int)(m_uPayloadSize / 4);
+		return true;
+	}
+
+	// Decode the '_' separated decimal fields without modifying the packet,
+	// the packet ends at the first '\0' or after size bytes
+	m_eFraming = Packet::ASCII;
+	const char *end = (const char*)memchr(data, '\0', size);
+	if(end == NULL)
+	{
+		end = data + size;
+	}
+
+	int values[PACKET_MAX_FIELDS + 1];
+	int count = 0;
+	const char *c = data;
+	while(c < end && count <= PACKET_MAX_FIELDS)
+	{
+		bool negative = false;
+		if(*c == '-')
+		{
+			negative = true;
+			c++;
+		}
+
+		const char *digits = c;
+		int value = 0;
+		while(c < end && *c >= '0' && *c <= '9')
+		{
+			value = value * 10 + (*c - '0');
+			c++;
+		}
+
+		if(c == digits || (c < end && *c != '_'))
+		{
+			return false;
+		}
+
+		values[count++] = negative ? -value : value;
+		c++; // skip '_'
+	}
+
+	if(count == 0)
+	{
+		return false;
+	}
+
+	m_eCode = (Packet::PacketCode)values[0];
+	m_iFieldCount = count - 1;
+	for(int i = 1; i < count; i++)
+	{
+		m_iFields[i - 1] = values[i];
+	}
+
+	return true;
+}
+
+int PacketReader::GetField(int index) const
+{
+	if(index < 0 || index >= m_iFieldCount)
+	{
+		return 0;
+	}
+
+	if(m_eFraming == Packet::BINARY)
+	{
+		return (int)Packet::ReadUInt32(m_pPayload + index * 4);
+	}
+
+	return m_iFields[index];
+}
+
+} // namespace net
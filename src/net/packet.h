@@ -0,0 +1,176 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef NET_PACKET_H_
+#define NET_PACKET_H_
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t, uint32_t
+
+#include <vector> // vector<>()
+
+namespace net{
+
+// Packets are sent in one of two framings:
+//
+//		ASCII	Zero padded decimal fields separated by '_' and terminated by
+//				'\0'. Clients send 20 byte packets, the server 13 byte packets.
+//
+//		BINARY	A fixed header followed by the payload, a list of
+//				little-endian int32 fields.
+//
+//				| magic u8 | version u8 | code u8 | flags u8 | payload length u32 |
+//
+// Every connection starts in ASCII. The client offers the binary framing with
+// a HELLO packet and switches to it when the server answers with a HELLO.
+// The first byte of a binary packet is never a digit so both framings can be
+// told apart on the same stream.
+//
+// The client's HELLO also carries the version of its world, and the
+// server's answer the version it holds. A server that holds the same
+// version is sent only the changes that follow, any other server one
+// SNAPSHOT of the whole grid.
+//
+// A PATH or PATH_BATCH with PACKET_FLAG_CORNERS asks for the corners of the
+// path only. The server leaves out the NODE packets of cells where the path
+// goes on in the same direction and keeps the sequence number of each node
+// it sends, the cells between two corners are the steps from one to the
+// other.
+//
+// With PACKET_FLAG_FORWARD the server sends the nodes from the start to the
+// goal, so the client can use the start of a long path before the rest has
+// arrived. The END packet carries the goal.
+//
+// A path the server cannot answer, because the goal cannot be reached or a
+// node does not fit the ASCII layout, is answered with a single EMPTY
+// packet instead of any NODE or END packet.
+
+#define PACKET_MAGIC 0x52 // 'R'
+#define PACKET_VERSION 1
+#define PACKET_HEADER_SIZE 8
+#define PACKET_ASCII_SIZE 13 // Size of an ASCII packet sent by the server
+#define PACKET_ASCII_SEND_SIZE 20 // Size of an ASCII packet sent by the client
+#define PACKET_MAX_FIELDS 8
+#define MAX_PACKET_SIZE (1 << 24) // Larger packets are a protocol error
+
+#define PACKET_FLAG_CORNERS 0x01 // PATH and PATH_BATCH, binary only
+#define PACKET_FLAG_FORWARD 0x02 // PATH and PATH_BATCH, binary only
+
+class Packet{
+public:
+
+	enum PacketCode{
+		GAMEWORLD,
+		PATH,
+		NODE,
+		END,
+		EMPTY, // No path, same fields as NODE
+		CELL_BLOCKED,
+		CELL_OPEN,
+		HELLO, // Protocol version, world version
+		PATH_BATCH, // Binary only, a count then id, sx, sz, gx, gz per path
+		SNAPSHOT, // Binary only, world version, width, height, service,
+			// grid encoding, count, then count encoded fields
+		VERSION // Binary only, world version after the cell updates before it
+	};
+
+	// Encodings of the grid in a SNAPSHOT
+	enum GridEncoding{
+		RUN_LENGTH, // Lengths of alternating runs of open and blocked cells in
+			// row major order, starting with open
+		BITMAP // One bit per cell in row major order, cell i is bit i % 32
+			// of field i / 32
+	};
+
+	enum Framing{
+		ASCII,
+		BINARY
+	};
+
+	// Returns the size of the packet starting at data, or 0 if more than
+	// size bytes are needed to tell. ASCII packets are asciiSize bytes, the
+	// size of a binary packet is known once its header has arrived.
+	static size_t GetPacketSize(const char *data, size_t size, size_t asciiSize = PACKET_ASCII_SIZE);
+
+	static bool IsBinary(const char *data) { return (uint8_t)data[0] == PACKET_MAGIC; }
+
+	static void WriteUInt32(char *data, uint32_t value);
+
+	static uint32_t ReadUInt32(const char *data);
+};
+
+// Appends packets to a buffer in the framing negotiated with the server so
+// several packets can be sent with one call to NetManager::SendData()
+class PacketWriter{
+public:
+	PacketWriter();
+
+	void SetFraming(Packet::Framing framing){ m_eFraming = framing; }
+
+	Packet::Framing GetFraming() const { return m_eFraming; }
+
+	// Flags are sent in the binary framing only. Returns false, and writes
+	// nothing, if a field does not fit its width in the ASCII framing.
+	bool Write(Packet::PacketCode code, const int *fields, int count, uint8_t flags = 0);
+
+	char *GetData(){ return m_vBuffer.empty() ? NULL : &m_vBuffer[0]; }
+
+	size_t GetSize() const { return m_vBuffer.size(); }
+
+	bool IsEmpty() const { return m_vBuffer.empty(); }
+
+	void Clear(){ m_vBuffer.clear(); }
+
+private:
+	bool WriteAscii(Packet::PacketCode code, const int *fields, int count);
+
+	void WriteBinary(Packet::PacketCode code, const int *fields, int count, uint8_t flags);
+
+	Packet::Framing m_eFraming;
+
+	// Capacity is kept between flushes
+	std::vector<char> m_vBuffer;
+};
+
+// Reads the fields of one packet in place, the packet is not copied or
+// modified. Binary fields are decoded from the payload on access, ASCII
+// fields are decoded by Parse().
+class PacketReader{
+public:
+	PacketReader();
+
+	// Parses the packet, returns false if it is malformed
+	bool Parse(const char *data, size_t size);
+
+	Packet::PacketCode GetCode() const { return m_eCode; }
+
+	Packet::Framing GetFraming() const { return m_eFraming; }
+
+	// Header flags of a binary packet, 0 for ASCII packets
+	uint8_t GetFlags() const { return m_uFlags; }
+
+	int GetFieldCount() const { return m_iFieldCount; }
+
+	// Fields following the packet code, 0 if the packet is shorter
+	int GetField(int index) const;
+
+	// Raw payload of a binary packet
+	const char *GetPayload() const { return m_pPayload; }
+
+	size_t GetPayloadSize() const { return m_uPayloadSize; }
+
+private:
+	Packet::PacketCode m_eCode;
+	Packet::Framing m_eFraming;
+	uint8_t m_uFlags;
+	const char *m_pPayload;
+	size_t m_uPayloadSize;
+	int m_iFields[PACKET_MAX_FIELDS];
+	int m_iFieldCount;
+};
+
+} // namespace net
+
+#endif
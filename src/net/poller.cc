@@ -0,0 +1,166 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "net/poller.h"
+
+#ifdef __linux__
+#include <sys/epoll.h> // epoll_create1()
+#include <unistd.h> // close()
+#endif
+
+namespace net{
+
+#define POLLER_READ 1
+#define POLLER_WRITE 2
+
+Poller::Poller()
+{
+	m_iPollFileDescriptor = -1;
+#ifdef __linux__
+	m_iPollFileDescriptor = epoll_create1(0);
+#endif
+}
+
+Poller::~Poller()
+{
+#ifdef __linux__
+	if(m_iPollFileDescriptor != -1)
+	{
+		close(m_iPollFileDescriptor);
+	}
+#endif
+}
+
+void Poller::Watch(int index, int socket)
+{
+	if((int)m_vSockets.size() <= index)
+	{
+		m_vSockets.resize(index + 1, -1);
+		m_vEvents.resize(index + 1, 0);
+	}
+
+	Unwatch(index);
+	m_vSockets[index] = socket;
+	m_vEvents[index] = POLLER_READ;
+
+#ifdef __linux__
+	if(m_iPollFileDescriptor != -1 && socket != -1)
+	{
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.u64 = 0;
+		event.data.fd = index;
+		epoll_ctl(m_iPollFileDescriptor, EPOLL_CTL_ADD, socket, &event);
+	}
+#endif
+}
+
+void Poller::WatchWrite(int index, bool isWatched)
+{
+	if(index >= (int)m_vSockets.size() || m_vSockets[index] == -1)
+	{
+		return;
+	}
+
+	m_vEvents[index] = isWatched ? m_vEvents[index] | POLLER_WRITE : m_vEvents[index] & ~POLLER_WRITE;
+	Modify(index);
+}
+
+void Poller::WatchRead(int index, bool isWatched)
+{
+	if(index >= (int)m_vSockets.size() || m_vSockets[index] == -1)
+	{
+		return;
+	}
+
+	m_vEvents[index] = isWatched ? m_vEvents[index] | POLLER_READ : m_vEvents[index] & ~POLLER_READ;
+	Modify(index);
+}
+
+void Poller::Modify(int index)
+{
+#ifdef __linux__
+	if(m_iPollFileDescriptor != -1)
+	{
+		struct epoll_event event;
+		event.events = 0;
+		if(m_vEvents[index] & POLLER_READ)
+		{
+			event.events |= EPOLLIN;
+		}
+		if(m_vEvents[index] & POLLER_WRITE)
+		{
+			event.events |= EPOLLOUT;
+		}
+		event.data.u64 = 0;
+		event.data.fd = index;
+		epoll_ctl(m_iPollFileDescriptor, EPOLL_CTL_MOD, m_vSockets[index], &event);
+	}
+#else
+	(void)index;
+#endif
+}
+
+void Poller::Unwatch(int index)
+{
+	if(index >= (int)m_vSockets.size() || m_vSockets[index] == -1)
+	{
+		return;
+	}
+
+	int socket = m_vSockets[index];
+	m_vSockets[index] = -1;
+
+#ifdef __linux__
+	for(size_t i = 0; i < m_vSockets.size(); i++)
+	{
+		if(m_vSockets[i] == socket)
+		{
+			// The old socket was closed and its number reused by another index
+			return;
+		}
+	}
+
+	if(m_iPollFileDescriptor != -1)
+	{
+		// Fails harmlessly if the socket was closed and dropped already
+		struct epoll_event event;
+		epoll_ctl(m_iPollFileDescriptor, EPOLL_CTL_DEL, socket, &event);
+	}
+#endif
+}
+
+int Poller::Wait(int *indices, int capacity, int timeoutMs)
+{
+	int count = 0;
+
+#ifdef __linux__
+	if(m_iPollFileDescriptor != -1)
+	{
+		struct epoll_event events[POLLER_MAX_EVENTS];
+		int maxEvents = capacity < POLLER_MAX_EVENTS ? capacity : POLLER_MAX_EVENTS;
+
+		int ready = epoll_wait(m_iPollFileDescriptor, events, maxEvents, timeoutMs);
+		for(int i = 0; i < ready; i++)
+		{
+			// Errors and hang ups are reported too, the read finds them
+			indices[count++] = events[i].data.fd;
+		}
+		return count;
+	}
+#endif
+
+	(void)timeoutMs;
+	for(int i = 0; i < (int)m_vSockets.size() && count < capacity; i++)
+	{
+		if(m_vSockets[i] != -1)
+		{
+			indices[count++] = i;
+		}
+	}
+	return count;
+}
+
+} // namespace net
@@ -0,0 +1,59 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef NET_POLLER_H_
+#define NET_POLLER_H_
+
+#include <vector> // vector<>()
+
+namespace net{
+
+#define POLLER_MAX_EVENTS 64 // Readiness events taken by one epoll_wait()
+
+// Readiness of many sockets with one call, so a client with a pool of
+// connections only reads the sockets that have data. Uses epoll on Linux,
+// elsewhere every watched socket is reported ready and reading it returns
+// nothing when it has no data.
+class Poller{
+public:
+	Poller();
+
+	~Poller();
+
+	// Watch socket for reading, Wait() reports it as index. Watching the
+	// socket of an index again replaces the old one, a closed socket is
+	// dropped by the kernel.
+	void Watch(int index, int socket);
+
+	void Unwatch(int index);
+
+	// Also report the socket of index when it can be written, for sockets
+	// with data left to send. Watch() clears it.
+	void WatchWrite(int index, bool isWatched);
+
+	// Stop reporting the socket of index when it can be read, for peers
+	// that do not take what is sent to them. Watch() sets it again.
+	void WatchRead(int index, bool isWatched);
+
+	// Writes up to capacity indices of the sockets that can be read,
+	// waiting up to timeoutMs. Returns the number of indices written.
+	int Wait(int *indices, int capacity, int timeoutMs);
+
+private:
+	int m_iPollFileDescriptor;
+
+	// Hands the events of index to epoll
+	void Modify(int index);
+
+	// Socket watched for each index or -1
+	std::vector<int> m_vSockets;
+
+	// POLLER_READ and POLLER_WRITE for each index
+	std::vector<int> m_vEvents;
+};
+
+} // namespace net
+
+#endif
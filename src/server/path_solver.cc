@@ -0,0 +1,96 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "server/path_solver.h"
+
+#include <cstdio> // snprintf()
+
+namespace server{
+
+// Largest sequence number and coordinates of the 13 byte ASCII layout
+#define ASCII_MAX_SEQUENCE 999
+#define ASCII_MAX_COORDINATE 99
+
+void PathSolver::Solve(const base::CellGrid &grid, const PathJob &job, net::Packet::Framing framing, std::vector<char> *out)
+{
+	m_Writer.SetFraming(framing);
+
+	if(!m_Search.FindPath(grid, job.m_iStartX, job.m_iStartZ, job.m_iGoalX, job.m_iGoalZ, job.m_eAlgorithm, &m_Path)
+		|| (framing == net::Packet::ASCII && !FitsAscii()))
+	{
+		// No path, or one the client cannot be sent, the request fails
+		WriteNode(net::Packet::EMPTY, job.m_iRequestId, base::Vector3(0, 0, 0, 0), out);
+		Flush(out);
+		return;
+	}
+
+	const base::Vector3 *nodes = m_Path.GetData();
+	int size = m_Path.GetSize();
+	bool isForward = (job.m_uFlags & PACKET_FLAG_FORWARD) != 0;
+	bool isCorners = (job.m_uFlags & PACKET_FLAG_CORNERS) != 0;
+
+	for(int i = 0; i < size; i++)
+	{
+		int index = isForward ? i : size - 1 - i;
+		if(isCorners && index > 0 && index < size - 1
+			&& nodes[index].m_iX - nodes[index - 1].m_iX == nodes[index + 1].m_iX - nodes[index].m_iX
+			&& nodes[index].m_iZ - nodes[index - 1].m_iZ == nodes[index + 1].m_iZ - nodes[index].m_iZ)
+		{
+			continue;
+		}
+
+		base::Vector3 node(index, nodes[index].m_iX, 0, nodes[index].m_iZ);
+		WriteNode(i == size - 1 ? net::Packet::END : net::Packet::NODE, job.m_iRequestId, node, out);
+	}
+
+	Flush(out);
+}
+
+bool PathSolver::FitsAscii() const
+{
+	const base::Vector3 *nodes = m_Path.GetData();
+	int size = m_Path.GetSize();
+	if(size - 1 > ASCII_MAX_SEQUENCE)
+	{
+		return false;
+	}
+
+	for(int i = 0; i < size; i++)
+	{
+		if(nodes[i].m_iX < 0 || nodes[i].m_iX > ASCII_MAX_COORDINATE || nodes[i].m_iZ < 0 || nodes[i].m_iZ > ASCII_MAX_COORDINATE)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void PathSolver::WriteNode(net::Packet::PacketCode code, int requestId, const base::Vector3 &node, std::vector<char> *out)
+{
+	if(m_Writer.GetFraming() == net::Packet::BINARY)
+	{
+		int fields[] = { requestId, node.m_iId, node.m_iX, node.m_iZ };
+		m_Writer.Write(code, fields, 4);
+		return;
+	}
+
+	// The 13 byte layout of the RAIG server, untagged, FitsAscii() has
+	// checked the fields
+	char packet[32];
+	snprintf(packet, sizeof(packet), "%02d_%03d_%02d_%02d", code, node.m_iId, node.m_iX, node.m_iZ);
+	out->insert(out->end(), packet, packet + PACKET_ASCII_SIZE);
+}
+
+void PathSolver::Flush(std::vector<char> *out)
+{
+	if(!m_Writer.IsEmpty())
+	{
+		out->insert(out->end(), m_Writer.GetData(), m_Writer.GetData() + m_Writer.GetSize());
+		m_Writer.Clear();
+	}
+}
+
+} // namespace server
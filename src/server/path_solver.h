@@ -0,0 +1,48 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef SERVER_PATH_SOLVER_H_
+#define SERVER_PATH_SOLVER_H_
+
+#include <vector> // vector<>()
+
+#include "ai/grid_search.h"
+#include "base/cell_grid.h"
+#include "base/path_buffer.h"
+#include "net/packet.h"
+#include "server/session.h"
+
+namespace server{
+
+// Answers path jobs. Holds the search arrays and buffers reused from one
+// job to the next, each thread answering jobs has its own.
+class PathSolver{
+public:
+	// Searches the path of job over grid and appends its NODE and END
+	// packets to out. A goal that cannot be reached, or an ASCII path with
+	// a field too wide for its layout, is answered with one EMPTY packet.
+	//
+	// Nodes are numbered from the start and sent goal first unless the job
+	// has PACKET_FLAG_FORWARD, with PACKET_FLAG_CORNERS the nodes where the
+	// path goes on in the same direction are left out.
+	void Solve(const base::CellGrid &grid, const PathJob &job, net::Packet::Framing framing, std::vector<char> *out);
+
+private:
+	// Whether every node of m_Path fits the 13 byte ASCII layout
+	bool FitsAscii() const;
+
+	void WriteNode(net::Packet::PacketCode code, int requestId, const base::Vector3 &node, std::vector<char> *out);
+
+	// Appends the packets written for the job to out
+	void Flush(std::vector<char> *out);
+
+	ai::GridSearch m_Search;
+	base::PathBuffer m_Path;
+	net::PacketWriter m_Writer;
+};
+
+} // namespace server
+
+#endif
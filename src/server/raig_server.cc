@@ -0,0 +1,453 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "server/raig_server.h"
+
+#include <arpa/inet.h> // inet_pton()
+#include <errno.h> // errno
+#include <fcntl.h> // fcntl()
+#include <netinet/in.h> // sockaddr_in
+#include <netinet/tcp.h> // TCP_NODELAY
+#include <stdint.h> // uint64_t
+#include <sys/eventfd.h> // eventfd()
+#include <sys/socket.h> // socket()
+#include <unistd.h> // close()
+
+#include <cstring> // memset()
+
+namespace server{
+
+#define SERVER_LISTEN_INDEX 0
+#define SERVER_WAKE_INDEX 1
+#define SERVER_FIRST_CONNECTION 2
+#define SERVER_READ_SIZE (64 * 1024)
+#define SERVER_MAX_READS 16 // Reads of a connection before the others are served
+#define SERVER_MAX_WRITE_SIZE (4 * 1024 * 1024) // Replies not taken by a client before it is no longer read
+#define SERVER_MAX_JOBS 1024 // Paths of a client searched before it is no longer read
+#define SERVER_LISTEN_BACKLOG 128
+
+static void SetNonBlocking(int socket)
+{
+	fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+}
+
+RaigServer::RaigServer(int threads)
+	: m_iListenSocket(-1), m_bIsRunning(false)
+{
+	m_iWakeDescriptor = eventfd(0, EFD_NONBLOCK);
+	m_Poller.Watch(SERVER_WAKE_INDEX, m_iWakeDescriptor);
+	m_vConnections.resize(SERVER_FIRST_CONNECTION);
+
+	m_pPool.reset(new WorkStealingPool(threads));
+	m_vWorkers.resize(m_pPool->GetThreadCount());
+}
+
+RaigServer::~RaigServer()
+{
+	m_pPool.reset();
+
+	for(size_t i = SERVER_FIRST_CONNECTION; i < m_vConnections.size(); i++)
+	{
+		if(m_vConnections[i])
+		{
+			close(m_vConnections[i]->m_iSocket);
+		}
+	}
+
+	if(m_iListenSocket != -1)
+	{
+		close(m_iListenSocket);
+	}
+	if(m_iWakeDescriptor != -1)
+	{
+		close(m_iWakeDescriptor);
+	}
+}
+
+int RaigServer::Listen(const char *address, int port)
+{
+	struct sockaddr_in socketAddress;
+	memset(&socketAddress, 0, sizeof(socketAddress));
+	socketAddress.sin_family = AF_INET;
+	socketAddress.sin_port = htons(port);
+	if(inet_pton(AF_INET, address, &socketAddress.sin_addr) != 1)
+	{
+		return -1;
+	}
+
+	m_iListenSocket = socket(AF_INET, SOCK_STREAM, 0);
+	if(m_iListenSocket == -1)
+	{
+		return -1;
+	}
+
+	int reuse = 1;
+	setsockopt(m_iListenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	socklen_t length = sizeof(socketAddress);
+	if(bind(m_iListenSocket, (struct sockaddr*)&socketAddress, sizeof(socketAddress)) == -1
+		|| listen(m_iListenSocket, SERVER_LISTEN_BACKLOG) == -1
+		|| getsockname(m_iListenSocket, (struct sockaddr*)&socketAddress, &length) == -1)
+	{
+		close(m_iListenSocket);
+		m_iListenSocket = -1;
+		return -1;
+	}
+
+	SetNonBlocking(m_iListenSocket);
+	m_Poller.Watch(SERVER_LISTEN_INDEX, m_iListenSocket);
+	return ntohs(socketAddress.sin_port);
+}
+
+void RaigServer::Run()
+{
+	int indices[POLLER_MAX_EVENTS];
+
+	m_bIsRunning = true;
+	while(m_bIsRunning)
+	{
+		int count = m_Poller.Wait(indices, POLLER_MAX_EVENTS, -1);
+		for(int i = 0; i < count; i++)
+		{
+			int index = indices[i];
+			if(index == SERVER_LISTEN_INDEX)
+			{
+				Accept();
+			}
+			else if(index == SERVER_WAKE_INDEX)
+			{
+				uint64_t value = 0;
+				while(read(m_iWakeDescriptor, &value, sizeof(value)) > 0)
+				{
+				}
+				SendReady();
+			}
+			else if(index < (int)m_vConnections.size() && m_vConnections[index])
+			{
+				// Readiness for reading and writing is not told apart, both
+				// calls return at once when there is nothing to do
+				Connection *connection = m_vConnections[index].get();
+				if(!Receive(connection) || !Send(connection))
+				{
+					Close(index);
+				}
+			}
+		}
+	}
+}
+
+void RaigServer::Stop()
+{
+	m_bIsRunning = false;
+
+	uint64_t value = 1;
+	ssize_t written = write(m_iWakeDescriptor, &value, sizeof(value));
+	(void)written;
+}
+
+void RaigServer::Accept()
+{
+	int socket = -1;
+	while((socket = accept(m_iListenSocket, NULL, NULL)) != -1)
+	{
+		SetNonBlocking(socket);
+
+		// Replies are written whole, do not hold them back for more
+		int noDelay = 1;
+		setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+		int index = (int)m_vConnections.size();
+		if(!m_vFreeIndices.empty())
+		{
+			index = m_vFreeIndices.back();
+			m_vFreeIndices.pop_back();
+		}
+		else
+		{
+			m_vConnections.resize(index + 1);
+		}
+
+		std::shared_ptr<Connection> connection(new Connection());
+		connection->m_iSocket = socket;
+		connection->m_iIndex = index;
+		m_vConnections[index] = connection;
+		m_Poller.Watch(index, socket);
+	}
+}
+
+bool RaigServer::Receive(Connection *connection)
+{
+	// A client that does not take its replies is not read until it does,
+	// Send() watches it for reading again
+	std::vector<char> &data = connection->m_vRead;
+	for(int i = 0; i < SERVER_MAX_READS && !IsFull(connection); i++)
+	{
+		size_t size = data.size();
+		data.resize(size + SERVER_READ_SIZE);
+
+		ssize_t bytes = recv(connection->m_iSocket, &data[size], SERVER_READ_SIZE, 0);
+		data.resize(size + (bytes > 0 ? bytes : 0));
+
+		if(bytes == 0 || (bytes == -1 && errno != EAGAIN && errno != EWOULDBLOCK))
+		{
+			return false;
+		}
+		if(bytes == -1)
+		{
+			break;
+		}
+
+		// Only the last packet, still arriving, is kept between reads
+		if(!ProcessPackets(m_vConnections[connection->m_iIndex]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool RaigServer::IsFull(Connection *connection)
+{
+	std::lock_guard<std::mutex> lock(connection->m_Mutex);
+	return connection->m_vWrite.size() - connection->m_uSent + connection->m_uWaiting > SERVER_MAX_WRITE_SIZE
+		|| connection->m_iSearching > SERVER_MAX_JOBS;
+}
+
+bool RaigServer::ProcessPackets(const std::shared_ptr<Connection> &connection)
+{
+	// Clients send 20 byte ASCII packets
+	std::vector<char> &data = connection->m_vRead;
+	size_t offset = 0;
+	while(offset < data.size())
+	{
+		size_t size = net::Packet::GetPacketSize(&data[offset], data.size() - offset, PACKET_ASCII_SEND_SIZE);
+		if(size > MAX_PACKET_SIZE)
+		{
+			return false;
+		}
+		if(size == 0 || offset + size > data.size())
+		{
+			break;
+		}
+
+		if(m_Reader.Parse(&data[offset], size))
+		{
+			m_vReply.clear();
+			if(!connection->m_Session.ProcessPacket(m_Reader, &m_vReply, &m_vJobs))
+			{
+				return false;
+			}
+
+			if(!m_vReply.empty())
+			{
+				std::lock_guard<std::mutex> lock(connection->m_Mutex);
+				if(connection->m_uOrdered == connection->m_uWritten)
+				{
+					connection->m_vWrite.insert(connection->m_vWrite.end(), m_vReply.begin(), m_vReply.end());
+				}
+				else
+				{
+					// Behind the paths still searched
+					WriteOrdered(connection.get(), connection->m_uOrdered++, &m_vReply);
+				}
+			}
+		}
+		offset += size;
+
+		// Before the next packet changes the grid the jobs search over
+		SubmitJobs(connection);
+	}
+	data.erase(data.begin(), data.begin() + offset);
+	return true;
+}
+
+void RaigServer::SubmitJobs(const std::shared_ptr<Connection> &connection)
+{
+	if(m_vJobs.empty())
+	{
+		return;
+	}
+
+	Session &session = connection->m_Session;
+	net::Packet::Framing framing = session.GetFraming();
+
+	// Binary replies asked for after ASCII ones still searched are held
+	// back too, the client reads the ASCII ones first
+	bool isOrdered = framing == net::Packet::ASCII;
+	{
+		std::lock_guard<std::mutex> lock(connection->m_Mutex);
+		isOrdered = isOrdered || connection->m_uOrdered != connection->m_uWritten;
+		connection->m_iSearching += (int)m_vJobs.size();
+	}
+
+	std::shared_ptr<const base::CellGrid> grid = session.GetGrid();
+	for(size_t i = 0; i < m_vJobs.size(); i++)
+	{
+		PathJob job = m_vJobs[i];
+		unsigned long long sequence = isOrdered ? connection->m_uOrdered++ : 0;
+		m_pPool->Submit([this, connection, grid, job, framing, isOrdered, sequence](int worker){
+			std::vector<char> &reply = m_vWorkers[worker].m_vReply;
+			reply.clear();
+			m_vWorkers[worker].m_Solver.Solve(*grid, job, framing, &reply);
+			{
+				std::lock_guard<std::mutex> lock(connection->m_Mutex);
+				connection->m_iSearching--;
+				if(isOrdered)
+				{
+					WriteOrdered(connection.get(), sequence, &reply);
+				}
+				else
+				{
+					connection->m_vWrite.insert(connection->m_vWrite.end(), reply.begin(), reply.end());
+				}
+			}
+			SetReady(connection);
+		});
+	}
+	m_vJobs.clear();
+}
+
+void RaigServer::WriteOrdered(Connection *connection, unsigned long long sequence, std::vector<char> *reply)
+{
+	if(sequence != connection->m_uWritten)
+	{
+		connection->m_uWaiting += reply->size();
+		connection->m_Replies[sequence].swap(*reply);
+		return;
+	}
+
+	std::vector<char> &data = connection->m_vWrite;
+	data.insert(data.end(), reply->begin(), reply->end());
+	connection->m_uWritten++;
+
+	std::map<unsigned long long, std::vector<char> >::iterator it = connection->m_Replies.begin();
+	while(it != connection->m_Replies.end() && it->first == connection->m_uWritten)
+	{
+		data.insert(data.end(), it->second.begin(), it->second.end());
+		connection->m_uWaiting -= it->second.size();
+		connection->m_uWritten++;
+		it = connection->m_Replies.erase(it);
+	}
+}
+
+void RaigServer::SetReady(const std::shared_ptr<Connection> &connection)
+{
+	{
+		std::lock_guard<std::mutex> lock(connection->m_Mutex);
+		if(connection->m_bIsReady)
+		{
+			return;
+		}
+		connection->m_bIsReady = true;
+	}
+
+	bool isFirst = false;
+	{
+		std::lock_guard<std::mutex> lock(m_ReadyMutex);
+		isFirst = m_vReady.empty();
+		m_vReady.push_back(connection);
+	}
+
+	// One wake up for the connections answered before the I/O thread runs
+	if(isFirst)
+	{
+		uint64_t value = 1;
+		ssize_t written = write(m_iWakeDescriptor, &value, sizeof(value));
+		(void)written;
+	}
+}
+
+void RaigServer::SendReady()
+{
+	std::vector<std::shared_ptr<Connection> > ready;
+	{
+		std::lock_guard<std::mutex> lock(m_ReadyMutex);
+		ready.swap(m_vReady);
+	}
+
+	for(size_t i = 0; i < ready.size(); i++)
+	{
+		Connection *connection = ready[i].get();
+		{
+			std::lock_guard<std::mutex> lock(connection->m_Mutex);
+			connection->m_bIsReady = false;
+		}
+
+		// Closed while its paths were searched
+		int index = connection->m_iIndex;
+		if(m_vConnections[index] != ready[i])
+		{
+			continue;
+		}
+
+		if(!Send(connection))
+		{
+			Close(index);
+		}
+	}
+}
+
+bool RaigServer::Send(Connection *connection)
+{
+	bool isPending = false;
+	bool isFull = false;
+	{
+		std::lock_guard<std::mutex> lock(connection->m_Mutex);
+		std::vector<char> &data = connection->m_vWrite;
+		while(connection->m_uSent < data.size())
+		{
+			ssize_t bytes = send(connection->m_iSocket, &data[connection->m_uSent], data.size() - connection->m_uSent, MSG_NOSIGNAL);
+			if(bytes == -1)
+			{
+				if(errno != EAGAIN && errno != EWOULDBLOCK)
+				{
+					return false;
+				}
+				isPending = true;
+				break;
+			}
+			connection->m_uSent += bytes;
+		}
+
+		if(!isPending)
+		{
+			data.clear();
+			connection->m_uSent = 0;
+		}
+		else if(connection->m_uSent > data.size() - connection->m_uSent)
+		{
+			// The workers may append before all is sent, drop what was
+			data.erase(data.begin(), data.begin() + connection->m_uSent);
+			connection->m_uSent = 0;
+		}
+		isFull = data.size() - connection->m_uSent + connection->m_uWaiting > SERVER_MAX_WRITE_SIZE
+			|| connection->m_iSearching > SERVER_MAX_JOBS;
+	}
+
+	// Wait for room in the socket only while something is left to send
+	if(isPending != connection->m_bIsWriteWatched)
+	{
+		m_Poller.WatchWrite(connection->m_iIndex, isPending);
+		connection->m_bIsWriteWatched = isPending;
+	}
+	if(isFull == connection->m_bIsReadWatched)
+	{
+		m_Poller.WatchRead(connection->m_iIndex, !isFull);
+		connection->m_bIsReadWatched = !isFull;
+	}
+	return true;
+}
+
+void RaigServer::Close(int index)
+{
+	// Jobs still queued keep the connection and write to it, their replies
+	// are never sent
+	m_Poller.Unwatch(index);
+	close(m_vConnections[index]->m_iSocket);
+	m_vConnections[index].reset();
+	m_vFreeIndices.push_back(index);
+}
+
+} // namespace server
@@ -0,0 +1,156 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef SERVER_RAIG_SERVER_H_
+#define SERVER_RAIG_SERVER_H_
+
+#include <stddef.h> // size_t
+
+#include <atomic> // atomic<>()
+#include <map> // map<>()
+#include <memory> // shared_ptr<>()
+#include <mutex> // mutex
+#include <vector> // vector<>()
+
+#include "net/packet.h"
+#include "net/poller.h"
+#include "server/path_solver.h"
+#include "server/session.h"
+#include "server/work_stealing_pool.h"
+
+namespace server{
+
+// Reference RAIG server, speaks the protocol of net/packet.h with many
+// game clients at once. Linux only.
+//
+// One thread accepts connections, reads the packets and applies the world
+// changes of each client in order, waiting on the sockets with epoll. Path
+// requests are searched on a WorkStealingPool and the replies handed back
+// to the I/O thread, which is woken through an eventfd. Binary replies are
+// tagged with the request id so they may go out in any order. ASCII
+// replies are not, they are numbered when asked for and written to the
+// connection in that order. A client is not read while it leaves too many
+// replies unsent.
+class RaigServer{
+public:
+	// 0 threads is one per core
+	explicit RaigServer(int threads);
+
+	~RaigServer();
+
+	// Listens on port of address, port 0 picks a free one. Returns the port
+	// or -1.
+	int Listen(const char *address, int port);
+
+	// Serves the clients until Stop() is called
+	void Run();
+
+	// Safe from other threads and signal handlers
+	void Stop();
+
+	int GetThreadCount() const { return m_pPool->GetThreadCount(); }
+
+private:
+	struct Connection{
+		Connection()
+			: m_iSocket(-1), m_iIndex(-1), m_uSent(0), m_uOrdered(0), m_uWritten(0), m_uWaiting(0), m_iSearching(0),
+			m_bIsReady(false),
+			m_bIsReadWatched(true), m_bIsWriteWatched(false)
+		{
+		}
+
+		int m_iSocket;
+		int m_iIndex; // Index of the connection in the poller
+
+		// Bytes received and not processed yet, I/O thread only
+		std::vector<char> m_vRead;
+		Session m_Session;
+
+		// Replies written by the workers and the I/O thread, m_uSent of
+		// them are sent
+		std::mutex m_Mutex;
+		std::vector<char> m_vWrite;
+		size_t m_uSent;
+
+		// Replies that go out in the order they were asked for, those of
+		// ASCII clients and any asked for while one of them is searched.
+		// m_uOrdered of them were asked for (I/O thread only), m_uWritten
+		// are in m_vWrite and the others wait in m_Replies, m_uWaiting
+		// bytes in all.
+		unsigned long long m_uOrdered;
+		unsigned long long m_uWritten;
+		std::map<unsigned long long, std::vector<char> > m_Replies;
+		size_t m_uWaiting;
+
+		int m_iSearching; // Jobs on the pool
+
+		bool m_bIsReady; // In m_vReady
+
+		// I/O thread only
+		bool m_bIsReadWatched;
+		bool m_bIsWriteWatched;
+	};
+
+	void Accept();
+
+	// Returns false once the connection is closed
+	bool Receive(Connection *connection);
+
+	// More than SERVER_MAX_WRITE_SIZE bytes of replies are left to send or
+	// more than SERVER_MAX_JOBS paths are searched
+	bool IsFull(Connection *connection);
+
+	// Writes reply, numbered sequence, to the connection once the replies
+	// before it are. Takes its bytes, the lock of the connection is held.
+	void WriteOrdered(Connection *connection, unsigned long long sequence, std::vector<char> *reply);
+
+	bool Send(Connection *connection);
+
+	void Close(int index);
+
+	// Returns false if the client broke the protocol and is to be dropped
+	bool ProcessPackets(const std::shared_ptr<Connection> &connection);
+
+	// Queues the jobs of the last packet on the pool
+	void SubmitJobs(const std::shared_ptr<Connection> &connection);
+
+	// Called by the workers when a reply has been added to the connection
+	void SetReady(const std::shared_ptr<Connection> &connection);
+
+	// Sends the replies of the connections the workers have answered
+	void SendReady();
+
+	int m_iListenSocket;
+	int m_iWakeDescriptor; // eventfd the workers and Stop() write to
+	std::atomic<bool> m_bIsRunning;
+
+	net::Poller m_Poller;
+
+	// Indexed by poller index, the first indices are the listening socket
+	// and the eventfd
+	std::vector<std::shared_ptr<Connection> > m_vConnections;
+	std::vector<int> m_vFreeIndices;
+
+	net::PacketReader m_Reader;
+	std::vector<PathJob> m_vJobs;
+	std::vector<char> m_vReply; // Replies of the I/O thread to a packet
+
+	// State of each worker, replies are written to m_vReply and copied to
+	// the connection so its lock is not held during the search
+	struct Worker{
+		PathSolver m_Solver;
+		std::vector<char> m_vReply;
+	};
+	std::vector<Worker> m_vWorkers;
+	std::mutex m_ReadyMutex;
+	std::vector<std::shared_ptr<Connection> > m_vReady;
+
+	// Destroyed first so the workers stop before the state they use goes
+	std::unique_ptr<WorkStealingPool> m_pPool;
+};
+
+} // namespace server
+
+#endif
@@ -0,0 +1,55 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+// Reference RAIG server
+//
+//		raig_server [port] [threads] [address]
+//
+// Listens on 0.0.0.0:27000 with one search thread per core by default.
+
+#include <signal.h> // signal()
+
+#include <cstdio> // printf()
+#include <cstdlib> // atoi()
+
+#include "server/raig_server.h"
+
+#define SERVER_DEFAULT_PORT 27000
+#define SERVER_DEFAULT_ADDRESS "0.0.0.0"
+
+static server::RaigServer *s_pServer = NULL;
+
+static void OnSignal(int)
+{
+	if(s_pServer != NULL)
+	{
+		s_pServer->Stop();
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int port = argc > 1 ? atoi(argv[1]) : SERVER_DEFAULT_PORT;
+	int threads = argc > 2 ? atoi(argv[2]) : 0;
+	const char *address = argc > 3 ? argv[3] : SERVER_DEFAULT_ADDRESS;
+
+	server::RaigServer raigServer(threads);
+	port = raigServer.Listen(address, port);
+	if(port == -1)
+	{
+		printf("raig_server: could not listen on %s\n", address);
+		return 1;
+	}
+
+	s_pServer = &raigServer;
+	signal(SIGINT, OnSignal);
+	signal(SIGTERM, OnSignal);
+
+	printf("raig_server: listening on %s:%d with %d search threads\n", address, port, raigServer.GetThreadCount());
+	raigServer.Run();
+
+	s_pServer = NULL;
+	return 0;
+}
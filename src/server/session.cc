@@ -0,0 +1,187 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "server/session.h"
+
+namespace server{
+
+// Values of raig::RaigClient::AiService sent with GAMEWORLD and SNAPSHOT
+#define SESSION_SERVICE_BFS 2
+#define SESSION_SERVICE_DFS 3
+
+Session::Session()
+	: m_Grid(new base::CellGrid()), m_iWorldVersion(0), m_eAlgorithm(ai::GridSearch::ASTAR)
+{
+}
+
+bool Session::ProcessPacket(const net::PacketReader &reader, std::vector<char> *out, std::vector<PathJob> *jobs)
+{
+	switch(reader.GetCode())
+	{
+	case net::Packet::HELLO:
+	{
+		// Always accept the binary framing, the answer is the first binary
+		// packet
+		m_Writer.SetFraming(net::Packet::BINARY);
+		int fields[] = { PACKET_VERSION, m_iWorldVersion };
+		m_Writer.Write(net::Packet::HELLO, fields, 2);
+		break;
+	}
+
+	case net::Packet::GAMEWORLD:
+		if(!ResetGrid(reader.GetField(0), reader.GetField(1)))
+		{
+			return false;
+		}
+		m_eAlgorithm = GetAlgorithm(reader.GetField(2));
+		m_iWorldVersion = 0;
+		break;
+
+	case net::Packet::SNAPSHOT:
+		if(!ApplySnapshot(reader))
+		{
+			return false;
+		}
+		break;
+
+	case net::Packet::VERSION:
+		m_iWorldVersion = reader.GetField(0);
+		break;
+
+	case net::Packet::CELL_BLOCKED:
+		GetWritableGrid()->Block(reader.GetField(0), reader.GetField(2));
+		break;
+
+	case net::Packet::CELL_OPEN:
+		GetWritableGrid()->Open(reader.GetField(0), reader.GetField(2));
+		break;
+
+	case net::Packet::PATH:
+		AddJob(reader, 0, reader.GetField(4), jobs);
+		break;
+
+	case net::Packet::PATH_BATCH:
+		// The count is the client's, it must match the fields that came
+		if(reader.GetField(0) < 0 || reader.GetField(0) != (reader.GetFieldCount() - 1) / 5)
+		{
+			return false;
+		}
+		for(int i = 0; i < reader.GetField(0); i++)
+		{
+			int field = 1 + i * 5;
+			AddJob(reader, field + 1, reader.GetField(field), jobs);
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	if(!m_Writer.IsEmpty())
+	{
+		out->insert(out->end(), m_Writer.GetData(), m_Writer.GetData() + m_Writer.GetSize());
+		m_Writer.Clear();
+	}
+	return true;
+}
+
+base::CellGrid *Session::GetWritableGrid()
+{
+	if(m_Grid.use_count() > 1)
+	{
+		m_Grid.reset(new base::CellGrid(*m_Grid));
+	}
+	return m_Grid.get();
+}
+
+bool Session::ResetGrid(int width, int height)
+{
+	if(width < 0 || height < 0 || (long long)width * height > SESSION_MAX_CELLS)
+	{
+		return false;
+	}
+
+	base::CellGrid *grid = GetWritableGrid();
+	grid->Clear();
+	grid->Resize(width, height);
+	return true;
+}
+
+bool Session::ApplySnapshot(const net::PacketReader &reader)
+{
+	if(!ResetGrid(reader.GetField(1), reader.GetField(2)))
+	{
+		return false;
+	}
+	base::CellGrid *grid = GetWritableGrid();
+	m_eAlgorithm = GetAlgorithm(reader.GetField(3));
+	m_iWorldVersion = reader.GetField(0);
+
+	int count = reader.GetField(5);
+	if(count < 0 || count != reader.GetFieldCount() - 6)
+	{
+		return false;
+	}
+	if(reader.GetField(4) == net::Packet::BITMAP)
+	{
+		std::vector<uint32_t> bits(grid->GetWordCount(), 0);
+		for(int i = 0; i < count && i < (int)bits.size(); i++)
+		{
+			bits[i] = (uint32_t)reader.GetField(6 + i);
+		}
+		if(!bits.empty())
+		{
+			grid->AssignBits(&bits[0], [](int, int, bool){});
+		}
+		return true;
+	}
+
+	// Runs alternate between open and blocked, starting with open
+	long long index = 0;
+	for(int i = 0; i < count; i++)
+	{
+		int run = reader.GetField(6 + i);
+		if(run < 0)
+		{
+			return false;
+		}
+		if(i % 2 == 1)
+		{
+			grid->BlockRun(index, run);
+		}
+		index += run;
+	}
+	return true;
+}
+
+void Session::AddJob(const net::PacketReader &reader, int field, int requestId, std::vector<PathJob> *jobs)
+{
+	PathJob job;
+	job.m_iRequestId = requestId;
+	job.m_iStartX = reader.GetField(field);
+	job.m_iStartZ = reader.GetField(field + 1);
+	job.m_iGoalX = reader.GetField(field + 2);
+	job.m_iGoalZ = reader.GetField(field + 3);
+
+	// The flags only exist in the binary header
+	job.m_uFlags = GetFraming() == net::Packet::BINARY ? reader.GetFlags() : 0;
+	job.m_eAlgorithm = m_eAlgorithm;
+	jobs->push_back(job);
+}
+
+ai::GridSearch::Algorithm Session::GetAlgorithm(int service)
+{
+	switch(service)
+	{
+	case SESSION_SERVICE_BFS:
+		return ai::GridSearch::BFS;
+	case SESSION_SERVICE_DFS:
+		return ai::GridSearch::DFS;
+	default:
+		return ai::GridSearch::ASTAR;
+	}
+}
+
+} // namespace server
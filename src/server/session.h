@@ -0,0 +1,84 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef SERVER_SESSION_H_
+#define SERVER_SESSION_H_
+
+#include <stdint.h> // uint8_t
+
+#include <memory> // shared_ptr<>()
+#include <vector> // vector<>()
+
+#include "ai/grid_search.h"
+#include "base/cell_grid.h"
+#include "net/packet.h"
+
+namespace server{
+
+// Largest world a session accepts, the cells of a BITMAP SNAPSHOT of
+// MAX_PACKET_SIZE
+#define SESSION_MAX_CELLS ((long long)(MAX_PACKET_SIZE - PACKET_HEADER_SIZE) / 4 * 32)
+
+// A path asked for by a PATH or PATH_BATCH packet
+struct PathJob{
+	int m_iRequestId;
+	int m_iStartX;
+	int m_iStartZ;
+	int m_iGoalX;
+	int m_iGoalZ;
+	uint8_t m_uFlags;
+	ai::GridSearch::Algorithm m_eAlgorithm;
+};
+
+// Protocol state of one client connection and the world it uploaded. The
+// grid is built from GAMEWORLD, SNAPSHOT and the cell updates, HELLO is
+// answered with the version of the world held so a reconnecting client
+// knows whether to resend it.
+//
+// Paths may be searched on other threads while later packets change the
+// world. The grid is copied on write: a job keeps the grid that was
+// current when its request arrived, and the session copies it before the
+// next change if any job still holds it.
+class Session{
+public:
+	Session();
+
+	// Applies a packet from the client. Replies are appended to out and
+	// the paths asked for to jobs. Returns false if the client sent a world
+	// larger than SESSION_MAX_CELLS, a malformed one, or a PATH_BATCH whose
+	// count does not match its fields. The connection should be dropped.
+	bool ProcessPacket(const net::PacketReader &reader, std::vector<char> *out, std::vector<PathJob> *jobs);
+
+	// Framing of the replies, BINARY once the client sent HELLO
+	net::Packet::Framing GetFraming() const { return m_Writer.GetFraming(); }
+
+	std::shared_ptr<const base::CellGrid> GetGrid() const { return m_Grid; }
+
+	int GetWorldVersion() const { return m_iWorldVersion; }
+
+private:
+	// Grid that can be changed without affecting the jobs queued
+	base::CellGrid *GetWritableGrid();
+
+	// Clears the grid and sizes it for a width x height world, returns
+	// false if the size is out of bounds
+	bool ResetGrid(int width, int height);
+
+	bool ApplySnapshot(const net::PacketReader &reader);
+
+	void AddJob(const net::PacketReader &reader, int field, int requestId, std::vector<PathJob> *jobs);
+
+	static ai::GridSearch::Algorithm GetAlgorithm(int service);
+
+	std::shared_ptr<base::CellGrid> m_Grid;
+	int m_iWorldVersion;
+	ai::GridSearch::Algorithm m_eAlgorithm;
+
+	net::PacketWriter m_Writer;
+};
+
+} // namespace server
+
+#endif
@@ -0,0 +1,123 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#include "server/work_stealing_pool.h"
+
+namespace server{
+
+WorkStealingPool::WorkStealingPool(int threads)
+	: m_uNext(0), m_iQueued(0), m_bIsStopping(false), m_uStolen(0)
+{
+	if(threads <= 0)
+	{
+		threads = (int)std::thread::hardware_concurrency();
+	}
+	if(threads <= 0)
+	{
+		threads = 1;
+	}
+
+	for(int i = 0; i < threads; i++)
+	{
+		m_vQueues.push_back(std::unique_ptr<Queue>(new Queue()));
+	}
+
+	// Every queue exists before a worker can steal from it
+	for(int i = 0; i < threads; i++)
+	{
+		m_vThreads.push_back(std::thread(&WorkStealingPool::Run, this, i));
+	}
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bIsStopping = true;
+	}
+	m_Condition.notify_all();
+
+	for(size_t i = 0; i < m_vThreads.size(); i++)
+	{
+		m_vThreads[i].join();
+	}
+}
+
+void WorkStealingPool::Submit(Job job)
+{
+	Queue *queue = m_vQueues[m_uNext.fetch_add(1, std::memory_order_relaxed) % m_vQueues.size()].get();
+	{
+		std::lock_guard<std::mutex> lock(queue->m_Mutex);
+		queue->m_Jobs.push_back(std::move(job));
+	}
+
+	// Counted under the lock the workers wait with so the wake up is not
+	// lost between their check and their wait
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_iQueued.fetch_add(1, std::memory_order_relaxed);
+	}
+	m_Condition.notify_one();
+}
+
+void WorkStealingPool::Run(int worker)
+{
+	Job job;
+	while(true)
+	{
+		if(Take(worker, &job))
+		{
+			job(worker);
+			job = nullptr;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Condition.wait(lock, [this]{ return m_iQueued.load(std::memory_order_relaxed) > 0 || m_bIsStopping; });
+		if(m_bIsStopping && m_iQueued.load(std::memory_order_relaxed) == 0)
+		{
+			return;
+		}
+	}
+}
+
+bool WorkStealingPool::Take(int worker, Job *job)
+{
+	if(Pop(m_vQueues[worker].get(), job))
+	{
+		return true;
+	}
+
+	// Start with the next worker so the thieves do not all try the same
+	// queue first
+	int count = (int)m_vQueues.size();
+	for(int i = 1; i < count; i++)
+	{
+		if(Pop(m_vQueues[(worker + i) % count].get(), job))
+		{
+			m_uStolen.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool WorkStealingPool::Pop(Queue *queue, Job *job)
+{
+	std::lock_guard<std::mutex> lock(queue->m_Mutex);
+	if(queue->m_Jobs.empty())
+	{
+		return false;
+	}
+
+	// Oldest first, the client waits on every path of a batch
+	*job = std::move(queue->m_Jobs.front());
+	queue->m_Jobs.pop_front();
+	m_iQueued.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+} // namespace server
@@ -0,0 +1,77 @@
+// Copyright (c) 2016 David Morton
+// Use of this source code is governed by a license that can be
+// found in the LICENSE file.
+// https://github.com/damorton/libraig.git
+
+#ifndef SERVER_WORK_STEALING_POOL_H_
+#define SERVER_WORK_STEALING_POOL_H_
+
+#include <atomic> // atomic<>()
+#include <condition_variable> // condition_variable
+#include <deque> // deque<>()
+#include <functional> // function<>()
+#include <memory> // unique_ptr<>()
+#include <mutex> // mutex
+#include <thread> // thread
+#include <vector> // vector<>()
+
+namespace server{
+
+// Thread pool with one job queue per worker. Jobs are spread over the
+// queues as they are submitted, a worker whose queue is empty steals from
+// the others so a few long searches do not hold up the jobs queued behind
+// them.
+//
+// Each queue has its own lock, a worker and a thief only meet on the same
+// queue. Workers sleep when every queue is empty.
+class WorkStealingPool{
+public:
+	// Called with the index of the worker running it, so jobs can use
+	// per-worker state without locking
+	typedef std::function<void(int worker)> Job;
+
+	// 0 threads is one per core
+	explicit WorkStealingPool(int threads);
+
+	// Finishes the jobs queued, then joins the workers
+	~WorkStealingPool();
+
+	void Submit(Job job);
+
+	int GetThreadCount() const { return (int)m_vThreads.size(); }
+
+	// Jobs taken from the queue of another worker
+	unsigned long long GetStolenCount() const { return m_uStolen.load(std::memory_order_relaxed); }
+
+private:
+	struct Queue{
+		std::mutex m_Mutex;
+		std::deque<Job> m_Jobs;
+	};
+
+	void Run(int worker);
+
+	// Takes the oldest job of the worker's queue, else of another queue
+	bool Take(int worker, Job *job);
+
+	bool Pop(Queue *queue, Job *job);
+
+	std::vector<std::unique_ptr<Queue> > m_vQueues;
+	std::vector<std::thread> m_vThreads;
+
+	// Queue the next job is submitted to
+	std::atomic<unsigned int> m_uNext;
+
+	// Jobs submitted and not taken yet. Workers wait on the condition
+	// while it is 0.
+	std::atomic<int> m_iQueued;
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	bool m_bIsStopping;
+
+	std::atomic<unsigned long long> m_uStolen;
+};
+
+} // namespace server
+
+#endif